@@ -24,7 +24,11 @@
 #include <QApplication>
 #include <QIcon>
 #include <QThread>
+#include <QProcess>
 #include <QByteArray>
+#include <QDir>
+#include <QFileInfo>
+#include <QStringList>
 
 #include <cstdio>
 #include <cstdlib>
@@ -62,9 +66,199 @@ using namespace dunnart;
 static void usage(char *title, char *editor);
 
 
+// Options from the command line that apply to each canvas.
+struct CanvasOptions
+{
+    CanvasOptions()
+        : roundedCorners(false),
+          crossingPenalty(-1),
+          nudgeDistance(0)
+    {
+    }
+    void applyTo(Canvas *canvas) const
+    {
+        if (roundedCorners)
+        {
+            canvas->setOptConnRoundingDist(7);
+        }
+        if (crossingPenalty >= 0)
+        {
+            canvas->router()->setRoutingParameter(Avoid::crossingPenalty,
+                    crossingPenalty);
+        }
+        if (nudgeDistance > 0)
+        {
+            canvas->setNudgeDistance(nudgeDistance);
+        }
+    }
+
+    // The command line options that give these settings.
+    QStringList arguments(void) const
+    {
+        QStringList args;
+        if (roundedCorners)
+        {
+            args << "-y";
+        }
+        if (crossingPenalty >= 0)
+        {
+            args << "-z" << QString::number(crossingPenalty, 'g', 15);
+        }
+        if (nudgeDistance > 0)
+        {
+            args << "-w" << QString::number(nudgeDistance, 'g', 15);
+        }
+        return args;
+    }
+
+    bool roundedCorners;
+    double crossingPenalty;
+    double nudgeDistance;
+};
+
+
+// Lays out, routes and saves one diagram in batch mode (-b), on a canvas
+// with no view.
+static bool processBatchFile(const QString& inputFilename,
+        const QString& outputFilename, const CanvasOptions& options)
+{
+    Canvas *canvas = new Canvas();
+    options.applyTo(canvas);
+
+    QString errorMessage;
+    bool success = canvas->processBatchDiagram(inputFilename,
+            outputFilename, errorMessage);
+    if (success)
+    {
+        qDebug("Wrote %s", qPrintable(outputFilename));
+    }
+    else
+    {
+        qWarning("Failed to lay out %s: %s", qPrintable(inputFilename),
+                qPrintable(errorMessage));
+    }
+    delete canvas;
+    return success;
+}
+
+
+// Runs this program in batch mode on one file at a time, with up to jobs
+// of these processes at once.  Returns the number that failed.
+static int runBatchProcesses(const QStringList& inputFilenames,
+        const QString& outputDir, int jobs, const CanvasOptions& options)
+{
+    QStringList arguments = options.arguments();
+    arguments << "-b" << "-j" << "1";
+    if (!outputDir.isEmpty())
+    {
+        arguments << "-o" << outputDir;
+    }
+
+    int failures = 0;
+    int next = 0;
+    QList<QProcess *> processes;
+    while ((next < inputFilenames.size()) || !processes.isEmpty())
+    {
+        while ((next < inputFilenames.size()) && (processes.size() < jobs))
+        {
+            QProcess *process = new QProcess();
+            process->setProcessChannelMode(QProcess::ForwardedChannels);
+            process->start(QCoreApplication::applicationFilePath(),
+                    QStringList(arguments) << inputFilenames[next]);
+            if (process->waitForStarted())
+            {
+                processes.append(process);
+            }
+            else
+            {
+                qWarning("Failed to start a process for %s",
+                        qPrintable(inputFilenames[next]));
+                ++failures;
+                delete process;
+            }
+            ++next;
+        }
+
+        // Wait until one of the processes has finished.
+        int finished = -1;
+        while (!processes.isEmpty() && (finished < 0))
+        {
+            for (int i = 0; (finished < 0) && (i < processes.size()); ++i)
+            {
+                if ((processes[i]->state() == QProcess::NotRunning) ||
+                        processes[i]->waitForFinished(50))
+                {
+                    finished = i;
+                }
+            }
+        }
+        if (finished >= 0)
+        {
+            QProcess *process = processes.takeAt(finished);
+            if ((process->exitStatus() != QProcess::NormalExit) ||
+                    (process->exitCode() != EXIT_SUCCESS))
+            {
+                ++failures;
+            }
+            delete process;
+        }
+    }
+    return failures;
+}
+
+
+// The canvas library keeps shared state that is not thread-safe, such as
+// the inactive item lists and the file IO plugin factory, so files are
+// processed one at a time on this thread.  For more than one job, each
+// file is instead given to a separate process.
+static int runBatch(const QStringList& inputFilenames,
+        const QString& outputDir, int jobs, const CanvasOptions& options)
+{
+    if (jobs <= 0)
+    {
+        jobs = qMax(1, QThread::idealThreadCount());
+    }
+
+    int failures = 0;
+    if ((jobs > 1) && (inputFilenames.size() > 1))
+    {
+        failures = runBatchProcesses(inputFilenames, outputDir, jobs,
+                options);
+    }
+    else
+    {
+        foreach (QString inputFilename, inputFilenames)
+        {
+            // Write "name.svg" to the output directory, or
+            // "name-layout.svg" next to the input if there isn't one.
+            QFileInfo inputInfo(inputFilename);
+            QString outputFilename = (outputDir.isEmpty()) ?
+                    inputInfo.dir().filePath(
+                        inputInfo.completeBaseName() + "-layout.svg") :
+                    QDir(outputDir).filePath(
+                        inputInfo.completeBaseName() + ".svg");
+            if (!processBatchFile(inputFilename, outputFilename, options))
+            {
+                ++failures;
+            }
+        }
+    }
+
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 
 int main(int argc, char *argv[])
 {
+    // Batch mode creates no windows, so doesn't need a display.
+    for (int i = 1; i < argc; ++i)
+    {
+        if ((strcmp(argv[i], "-b") == 0) && qgetenv("QT_QPA_PLATFORM").isEmpty())
+        {
+            qputenv("QT_QPA_PLATFORM", "offscreen");
+        }
+    }
+
     Application app(argc, argv);
 
     namespaces.setPrefix(x_dunnartNs, x_dunnartURI);
@@ -74,21 +268,25 @@ int main(int argc, char *argv[])
     namespaces.setPrefix("xlink", "http://www.w3.org/1999/xlink");
 
     bool save_svg_and_exit = false;
-
-    MainWindow window(&app);
-
-    QIcon appIcon(":/resources/nuvola_icons/kfig.png");
-    app.setWindowIcon(appIcon);
-    window.setWindowIcon(appIcon);
+    bool batch = false;
+    int batch_jobs = 1;
+    QString batch_output_dir;
+    CanvasOptions options;
 
     int c = -1;
-    char args[] = "bhvw:xyz:";
+    char args[] = "bhj:o:vw:xyz:";
     while ((c = mj_getopt(argc, argv, args)) != -1)
     {
         switch (c)
         {
             case 'b':
-                //QT window.canvas()->m_batch_diagram_layout = true;
+                batch = true;
+                break;
+            case 'j':
+                batch_jobs = atoi(mj_optarg);
+                break;
+            case 'o':
+                batch_output_dir = QString(mj_optarg);
                 break;
             case 'x':
                 save_svg_and_exit = true;
@@ -101,14 +299,13 @@ int main(int argc, char *argv[])
                 exit(EXIT_SUCCESS);
                 break;
             case 'y':
-                window.canvas()->setOptConnRoundingDist(7);
+                options.roundedCorners = true;
                 break;
             case 'z':
-                window.canvas()->router()->setRoutingParameter(
-                        Avoid::crossingPenalty, atof(mj_optarg));
+                options.crossingPenalty = atof(mj_optarg);
                 break;
             case'w':
-                window.canvas()->setNudgeDistance(atof(mj_optarg));
+                options.nudgeDistance = atof(mj_optarg);
                 break;
             case '?':
                 qFatal("Please run `%s -h' to see valid options.", argv[0]);
@@ -119,6 +316,24 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (batch)
+    {
+        QStringList inputFilenames;
+        for (int o = mj_optind; o < argc; ++o)
+        {
+            inputFilenames.append(QString(argv[o]));
+        }
+        return runBatch(inputFilenames, batch_output_dir, batch_jobs,
+                options);
+    }
+
+    MainWindow window(&app);
+    options.applyTo(window.canvas());
+
+    QIcon appIcon(":/resources/nuvola_icons/kfig.png");
+    app.setWindowIcon(appIcon);
+    window.setWindowIcon(appIcon);
+
 
 #if 1
     int diagrams = 1;
@@ -127,6 +342,7 @@ int main(int argc, char *argv[])
         if (diagrams > 1)
         {
             window.newCanvasTab();
+            options.applyTo(window.canvas());
         }
         int o = mj_optind;
         
@@ -208,14 +424,18 @@ int main(int argc, char *argv[])
 static void usage(char *title, char *editor)
 {
     printf("%s\n\n"
-"Usage: %s [options] file\n"
+"Usage: %s [options] file ...\n"
 "\n"
 "General Options:\n"
 "   -h                Show usage information.\n"
 "   -v                Show version information.\n"
 "   -x                Load the diagram, then immediately write out SVG and quit.\n"
-"   -b                Batch processing: Run graphlayout, reroute connectors,\n"
-"                     Fit page to diagram, write out SVG and then exit.\n"
+"   -b                Batch processing: For each file, without opening any\n"
+"                     windows, run graphlayout, reroute connectors, write\n"
+"                     out SVG as name-layout.svg and then exit.\n"
+"   -j jobs           Number of files to process at once in batch mode, each\n"
+"                     in its own process (default: 1, 0 for one per core).\n"
+"   -o directory      Write batch mode output to name.svg in this directory.\n"
 "   -y                Enable rounded poly-line segment corners on connectors.\n"
 "   -z xing_penalty   Set the connector crossing penalty (0 to 500).\n"
 "   -w nudge_distance 'Nudge' connectors by this amount to separate then.\n"
@@ -55,6 +55,7 @@ ConnRef::ConnRef(Router *router, const unsigned int id)
       m_hate_crossings(false),
       m_has_fixed_route(false),
       m_route_dist(0),
+      m_search_expanded_nodes(0),
       m_src_vert(NULL),
       m_dst_vert(NULL),
       m_start_vert(NULL),
@@ -85,6 +86,7 @@ ConnRef::ConnRef(Router *router, const ConnEnd& src, const ConnEnd& dst,
       m_hate_crossings(false),
       m_has_fixed_route(false),
       m_route_dist(0),
+      m_search_expanded_nodes(0),
       m_src_vert(NULL),
       m_dst_vert(NULL),
       m_callback_func(NULL),
@@ -315,7 +317,6 @@ void ConnRef::common_updateEndPoint(const unsigned int type, ConnEnd connEnd)
     altered->removeFromGraph(isConn);
 
     makePathInvalid();
-    m_router->setStaticGraphInvalidated(true);
 }
 
 
@@ -640,6 +641,11 @@ void ConnRef::clearFixedRoute(void)
     makePathInvalid();
 }
 
+unsigned int ConnRef::routeSearchExpandedNodeCount(void) const
+{
+    return m_search_expanded_nodes;
+}
+
 Polygon& ConnRef::displayRoute(void)
 {
     if (m_display_route.empty())
@@ -917,6 +923,34 @@ std::pair<bool, bool> ConnRef::assignConnectionPinVisibility(const bool connect)
 
 
 bool ConnRef::generatePath(void)
+{
+    std::pair<bool, bool> isDummyAtEnd;
+    if (!prepareToGeneratePath(isDummyAtEnd))
+    {
+        return false;
+    }
+
+    std::vector<Point> path;
+    std::vector<VertInf *> vertices;
+    if (m_checkpoints.empty())
+    {
+        generateStandardPath(path, vertices);
+    }
+    else
+    {
+        generateCheckpointsPath(path, vertices);
+    }
+
+    finishGeneratingPath(isDummyAtEnd, path, vertices);
+    return true;
+}
+
+
+// The first part of generatePath().  Returns false if the connector is up
+// to date or cannot be routed.  Otherwise the visibility of the connector's
+// endpoints is set up for the search and isDummyAtEnd is set to whether 
+// each endpoint is a dummy vertex for connection pins.
+bool ConnRef::prepareToGeneratePath(std::pair<bool, bool>& isDummyAtEnd)
 {
     // XXX Currently rubber-band routing only works when dragging the
     //     destination point of a connector, but not the source.  The code
@@ -938,6 +972,7 @@ bool ConnRef::generatePath(void)
 
     m_false_path = false;
     m_needs_reroute_flag = false;
+    m_search_expanded_nodes = 0;
 
     m_start_vert = m_src_vert;
 
@@ -947,7 +982,7 @@ bool ConnRef::generatePath(void)
     // visibility to each of the possible pins and tiny distance.  Here we
     // assign this visibility by adding edges to the visibility graph that we
     // later remove.
-    std::pair<bool, bool> isDummyAtEnd = assignConnectionPinVisibility(true);
+    isDummyAtEnd = assignConnectionPinVisibility(true);
     
 
     if (m_router->RubberBandRouting && route().size() > 0)
@@ -962,18 +997,50 @@ bool ConnRef::generatePath(void)
             existingRoute.ps.insert(existingRoute.ps.begin(), 1, firstPoint);
         }
     }
+    return true;
+}
 
-    std::vector<Point> path;
-    std::vector<VertInf *> vertices;
-    if (m_checkpoints.empty())
+
+// Returns whether the route search for this connector, after 
+// prepareToGeneratePath(), may run concurrently with those of other such 
+// connectors.  The search then only reads the visibility graph.
+bool ConnRef::canSearchConcurrently(void) const
+{
+    if ((m_type != ConnType_Orthogonal) || !m_checkpoints.empty() ||
+            m_router->RubberBandRouting)
     {
-        generateStandardPath(path, vertices);
+        return false;
     }
-    else
+    // Connectors compete for exclusive connection pins, so the result 
+    // depends on the order in which they are routed.
+    if ((m_src_connend && m_src_connend->hasExclusivePinChoice()) ||
+            (m_dst_connend && m_dst_connend->hasExclusivePinChoice()))
     {
-        generateCheckpointsPath(path, vertices);
+        return false;
     }
+    return true;
+}
+
 
+// Completes generatePath() for a connector that was prepared with 
+// prepareToGeneratePath(), given the path found by AStarPath::search().
+void ConnRef::generateSearchedPath(const std::pair<bool, bool>& isDummyAtEnd,
+        const std::vector<VertInf *>& searchedPath)
+{
+    COLA_ASSERT(m_checkpoints.empty());
+
+    std::vector<Point> path;
+    std::vector<VertInf *> vertices;
+    generateStandardPath(path, vertices, &searchedPath);
+    finishGeneratingPath(isDummyAtEnd, path, vertices);
+}
+
+
+// The last part of generatePath(), which sets the route from the path 
+// found by the search.
+void ConnRef::finishGeneratingPath(const std::pair<bool, bool>& isDummyAtEnd,
+        std::vector<Point>& path, std::vector<VertInf *>& vertices)
+{
     COLA_ASSERT(vertices.size() >= 2);
     COLA_ASSERT(vertices[0] == src());
     COLA_ASSERT(vertices[vertices.size() - 1] == dst());
@@ -1041,8 +1108,6 @@ bool ConnRef::generatePath(void)
     }
     db_printf("\n\n");
 #endif
-
-    return true;
 }
 
 void ConnRef::generateCheckpointsPath(std::vector<Point>& path,
@@ -1081,9 +1146,8 @@ void ConnRef::generateCheckpointsPath(std::vector<Point>& path,
             }
         }
         
-        AStarPath aStar;
         // Route the connector
-        aStar.search(this, start, end, NULL); 
+        m_router->m_astar_path.search(this, start, end, NULL); 
 
         // Restore changes made for checkpoint visibility directions.
         if (lastSuccessfulIndex > 0)
@@ -1150,7 +1214,8 @@ void ConnRef::generateCheckpointsPath(std::vector<Point>& path,
 
 
 void ConnRef::generateStandardPath(std::vector<Point>& path,
-        std::vector<VertInf *>& vertices)
+        std::vector<VertInf *>& vertices, 
+        const std::vector<VertInf *> *searchedPath)
 {
     VertInf *tar = m_dst_vert;
     size_t existingPathStart = 0;
@@ -1190,8 +1255,17 @@ void ConnRef::generateStandardPath(std::vector<Point>& path,
     unsigned int pathlen = 0;
     while (pathlen == 0)
     {
-        AStarPath aStar;
-        aStar.search(this, src(), dst(), start());
+        if (searchedPath)
+        {
+            // The search has already been done, see
+            // Router::rerouteAndCallbackConnectors().
+            AStarPath::setPathNextLinks(dst(), *searchedPath);
+            searchedPath = NULL;
+        }
+        else
+        {
+            m_router->m_astar_path.search(this, src(), dst(), start());
+        }
         pathlen = dst()->pathLeadsBackTo(src());
         if (pathlen < 2)
         {
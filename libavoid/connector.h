@@ -397,6 +397,17 @@ class AVOID_EXPORT ConnRef
         //!
         void clearFixedRoute(void);
 
+        //! @brief  Returns the number of nodes expanded by the route 
+        //!         searches when this connector was last routed.
+        //!
+        //! This includes any repeated searches in a wider region when the
+        //! searchOrthogonalRoutesInLocalRegion routing option is set.
+        //!
+        //! @return The number of nodes expanded, or zero if the connector
+        //!         has not been routed.
+        //!
+        unsigned int routeSearchExpandedNodeCount(void) const;
+
         void set_route(const PolyLine& route);
         void calcRouteDist(void);
         void makeActive(void);
@@ -421,15 +432,23 @@ class AVOID_EXPORT ConnRef
         friend struct HyperedgeTreeEdge;
         friend struct HyperedgeTreeNode;
         friend class HyperedgeRerouter;
+        friend class AStarPath;
 
         PolyLine& routeRef(void);
         void freeRoutes(void);
         void performCallback(void);
         bool generatePath(void);
+        bool prepareToGeneratePath(std::pair<bool, bool>& isDummyAtEnd);
+        bool canSearchConcurrently(void) const;
+        void generateSearchedPath(const std::pair<bool, bool>& isDummyAtEnd,
+                const std::vector<VertInf *>& searchedPath);
+        void finishGeneratingPath(const std::pair<bool, bool>& isDummyAtEnd,
+                std::vector<Point>& path, std::vector<VertInf *>& vertices);
         void generateCheckpointsPath(std::vector<Point>& path,
                 std::vector<VertInf *>& vertices);
         void generateStandardPath(std::vector<Point>& path,
-                std::vector<VertInf *>& vertices);
+                std::vector<VertInf *>& vertices,
+                const std::vector<VertInf *> *searchedPath = NULL);
         void unInitialise(void);
         void updateEndPoint(const unsigned int type, const ConnEnd& connEnd);
         void common_updateEndPoint(const unsigned int type, ConnEnd connEnd);
@@ -455,6 +474,7 @@ class AVOID_EXPORT ConnRef
         PolyLine m_route;
         Polygon m_display_route;
         double m_route_dist;
+        unsigned int m_search_expanded_nodes;
         ConnRefList::iterator m_connrefs_pos;
         VertInf *m_src_vert;
         VertInf *m_dst_vert;
@@ -170,6 +170,28 @@ bool ConnEnd::isPinConnection(void) const
     return (m_type == ConnEndShapePin) || (m_type == ConnEndJunction);
 }
 
+// Returns whether this ConnEnd could be routed to an exclusive connection 
+// pin, which is then unavailable to other connectors.
+bool ConnEnd::hasExclusivePinChoice(void) const
+{
+    if (!isPinConnection() || !m_anchor_obj)
+    {
+        return false;
+    }
+    for (ShapeConnectionPinSet::const_iterator curr = 
+            m_anchor_obj->m_connection_pins.begin(); 
+            curr != m_anchor_obj->m_connection_pins.end(); ++curr)
+    {
+        ShapeConnectionPin *currPin = *curr;
+        if ((currPin->m_class_id == m_connection_pin_class_id) && 
+                currPin->m_exclusive)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 unsigned int ConnEnd::endpointType(void) const
 {
     COLA_ASSERT(m_conn_ref != NULL);
@@ -238,6 +238,7 @@ class AVOID_EXPORT ConnEnd
         void freeActivePin(void);
         unsigned int endpointType(void) const;
         bool isPinConnection(void) const;
+        bool hasExclusivePinChoice(void) const;
         std::vector<Point> possiblePinPoints(void) const;
         void assignPinVisibilityTo(VertInf *dummyConnectionVert, 
                 VertInf *targetVert);
@@ -32,6 +32,7 @@
 #include "libavoid/timer.h"
 #include "libavoid/vertices.h"
 #include "libavoid/router.h"
+#include "libavoid/obstacle.h"
 #include "libavoid/assertions.h"
 
 
@@ -502,45 +503,33 @@ int EdgeInf::firstBlocker(void)
         ss.insert(contains[jID].begin(), contains[jID].end());
     }
 
-    VertInf *last = m_router->vertices.end();
-    unsigned int lastId = 0;
-    bool seenIntersectionAtEndpoint = false;
-    for (VertInf *k = m_router->vertices.shapesBegin(); k != last; )
+    // Only test the obstacles whose routing boxes the edge passes near.
+    std::vector<Obstacle *> candidates;
+    m_router->m_obstacle_index.segmentCandidates(pti, ptj, candidates);
+    for (size_t c = 0; c < candidates.size(); ++c)
     {
-        VertID kID = k->id;
-        if (k->id == dummyOrthogID)
+        Obstacle *obstacle = candidates[c];
+        if (ss.find(obstacle->id()) != ss.end())
         {
-            // Don't include orthogonal dummy vertices.
-            k = k->lstNext;
+            db_printf("Endpoint is inside shape %u so ignore shape "
+                    "edges.\n", obstacle->id());
+            // One of the endpoints is inside this shape so ignore it.
             continue;
         }
-        if (kID.objID != lastId)
+        bool seenIntersectionAtEndpoint = false;
+        VertInf *first = obstacle->firstVert();
+        VertInf *k = first;
+        do
         {
-            if ((ss.find(kID.objID) != ss.end()))
+            if (segmentShapeIntersect(pti, ptj, k->shPrev->point, k->point, 
+                        seenIntersectionAtEndpoint))
             {
-                unsigned int shapeID = kID.objID;
-                db_printf("Endpoint is inside shape %u so ignore shape "
-                        "edges.\n", kID.objID);
-                // One of the endpoints is inside this shape so ignore it.
-                while ((k != last) && (k->id.objID == shapeID))
-                {
-                    // And skip the other vertices from this shape.
-                    k = k->lstNext;
-                }
-                continue;
+                ss.clear();
+                return obstacle->id();
             }
-            seenIntersectionAtEndpoint = false;
-            lastId = kID.objID;
+            k = k->shNext;
         }
-        Point& kPoint = k->point;
-        Point& kPrevPoint = k->shPrev->point;
-        if (segmentShapeIntersect(pti, ptj, kPrevPoint, kPoint, 
-                    seenIntersectionAtEndpoint))
-        {
-            ss.clear();
-            return kID.objID;
-        }
-        k = k->lstNext;
+        while (k != first);
     }
     ss.clear();
     return 0;
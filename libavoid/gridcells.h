@@ -0,0 +1,91 @@
+/*
+ * vim: ts=4 sw=4 et tw=0 wm=0
+ *
+ * libavoid - Fast, Incremental, Object-avoiding Line Router
+ *
+ * Copyright (C) 2014  Monash University
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * See the file LICENSE.LGPL distributed with the library.
+ *
+ * Licensees holding a valid commercial license may use this file in
+ * accordance with the commercial license agreement provided with the
+ * library.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+*/
+
+//! @file    gridcells.h
+//! @brief   Contains the uniform grid helpers shared by RouteIndex and
+//!          ObstacleIndex.
+
+
+#ifndef AVOID_GRIDCELLS_H
+#define AVOID_GRIDCELLS_H
+
+#include <algorithm>
+#include <cmath>
+
+#include "libavoid/geomtypes.h"
+
+
+namespace Avoid {
+
+// The key of a grid cell in a hash map.
+typedef unsigned long long GridCellKey;
+
+// The cell size is chosen to be this multiple of the mean extent of the
+// indexed items, and changed (reindexing everything) once the mean drifts
+// by more than gridCellSizeSlack times in either direction.
+static const double gridCellSizeFactor = 2;
+static const double gridCellSizeSlack = 4;
+
+// Returns the cell size for items of the given mean extent.
+static inline double gridCellSize(const double meanExtent)
+{
+    return std::max(meanExtent * gridCellSizeFactor, 1.0);
+}
+
+// Returns whether a grid with cells of the given size should be rebuilt
+// with cells of the wanted size.
+static inline bool gridCellSizeChanged(const double cellSize,
+        const double wantedSize)
+{
+    return (cellSize == 0) || (wantedSize > cellSize * gridCellSizeSlack) ||
+            (wantedSize * gridCellSizeSlack < cellSize);
+}
+
+// Returns the index of the cell containing pos.  Indices are clamped to
+// 32 bits so that two of them fit in a GridCellKey.
+static inline long long gridCellCoord(const double pos, const double cellSize)
+{
+    double c = std::floor(pos / cellSize);
+    c = std::max(c, -2147483648.0);
+    c = std::min(c, 2147483647.0);
+    return (long long) c;
+}
+
+static inline GridCellKey gridCellKey(const long long cx, const long long cy)
+{
+    // Shift the unsigned value, since shifting a negative one is undefined.
+    return ((GridCellKey) cx << 32) ^ ((GridCellKey) cy & 0xffffffffULL);
+}
+
+// Boxes that only touch overlap, since items touching each other may still
+// interact.
+static inline bool gridBoxesOverlap(const Box& a, const Box& b)
+{
+    return (a.min.x <= b.max.x) && (b.min.x <= a.max.x) &&
+           (a.min.y <= b.max.y) && (b.min.y <= a.max.y);
+}
+
+
+}
+
+#endif
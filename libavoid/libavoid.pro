@@ -17,7 +17,9 @@ SOURCES += connector.cpp geometry.cpp geomtypes.cpp graph.cpp makepath.cpp ortho
     hyperedgetree.cpp \
     actioninfo.cpp \
     scanline.cpp \
-    hyperedgeimprover.cpp
+    hyperedgeimprover.cpp \
+    routeindex.cpp \
+    obstacleindex.cpp
 HEADERS += assertions.h connector.h debug.h geometry.h geomtypes.h graph.h libavoid.h makepath.h orthogonal.h router.h shape.h timer.h vertices.h viscluster.h visibility.h vpsc.h connend.h connectionpin.h junction.h obstacle.h \
     mtst.h \
     hyperedge.h \
@@ -25,4 +27,7 @@ HEADERS += assertions.h connector.h debug.h geometry.h geomtypes.h graph.h libav
     actioninfo.h \
     scanline.h \
     dllexport.h \
-    hyperedgeimprover.h
+    hyperedgeimprover.h \
+    routeindex.h \
+    obstacleindex.h \
+    gridcells.h
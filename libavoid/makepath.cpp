@@ -58,13 +58,24 @@ class ANode
         int timeStamp;   // Time-stamp used to determine exploration order of
                          // seemingly equal paths during orthogonal routing.
 
+        // Position in the search's node arena, and the next node for the
+        // same vertex.  These belong to the arena slot and are not changed 
+        // when a node is copied into it.
+        unsigned int index;
+        ANode *nextAtVertex;
+        // Whether this node is in the Done set rather than Pending.
+        bool done;
+
         ANode(VertInf *vinf, int time)
             : inf(vinf),
               g(0),
               h(0),
               f(0),
               prevNode(NULL),
-              timeStamp(time)
+              timeStamp(time),
+              index(0),
+              nextAtVertex(NULL),
+              done(false)
         {
         }
         ANode()
@@ -73,107 +84,258 @@ class ANode
               h(0),
               f(0),
               prevNode(NULL),
-              timeStamp(-1)
+              timeStamp(-1),
+              index(0),
+              nextAtVertex(NULL),
+              done(false)
+        {
+        }
+
+        // Copies the search state of another node, but not its place in 
+        // the arena or vertex lists.
+        void setState(const ANode& other)
         {
+            inf = other.inf;
+            g = other.g;
+            h = other.h;
+            f = other.f;
+            prevNode = other.prevNode;
+            timeStamp = other.timeStamp;
         }
 };
 
+
+// An entry in the heap of Pending nodes.  The sort key is copied from the
+// node so that heap operations don't need to look at the nodes themselves.
+struct PendingEntry
+{
+    double f;
+    int timeStamp;
+    unsigned int index;
+
+    PendingEntry(const ANode *node)
+        : f(node->f),
+          timeStamp(node->timeStamp),
+          index(node->index)
+    {
+    }
+};
+
+
+// This returns the opposite result (>) so that when used with stl::make_heap, 
+// the head node of the heap will be the smallest value, rather than the 
+// largest.  This saves us from having to sort the heap (and then reorder
+// it back into a heap) when getting the next node to examine.  This way we
+// get better complexity -- logarithmic pushes and pops to the heap.
+//
+class ANodeCmp
+{
+    public:
+    ANodeCmp()
+    {
+    }
+bool operator()(const PendingEntry& a, const PendingEntry& b) const
+{
+    // We need to use an epsilon here since otherwise the multiple addition
+    // of floating point numbers that makes up the 'f' values cause a problem
+    // with routings occasionally being non-deterministic.
+    if (fabs(a.f - b.f) > 0.0000001)
+    {
+        return a.f > b.f;
+    }
+    if (a.timeStamp != b.timeStamp)
+    {
+        // Tiebreaker, if two paths have equal cost, then choose the one with
+        // the highest timeStamp.  This corresponds to the furthest point
+        // explored along the straight-line path.  When exploring we give the
+        // directions the following timeStamps; left:1, right:2 and forward:3,
+        // then we always try to explore forward first.
+        return a.timeStamp < b.timeStamp;
+    }
+    return false;
+}
+};
+
+
 class AStarPathPrivate
 {
     public:
         AStarPathPrivate()
-            : m_available_nodes(),
-              m_available_array_size(0),
-              m_available_array_index(0),
-              m_available_node_index(0)
+            : m_shared_graph(false),
+              m_expanded_count(0),
+              m_node_count(0),
+              m_vertex_stamp(0),
+              m_vertex_count(0),
+              m_restrict_to_window(false),
+              m_window_excluded(false),
+              m_path_found(false)
         {
         }
         ~AStarPathPrivate()
         {
             // Free memory
-            for (size_t i = 0; i < m_available_nodes.size(); ++i)
+            for (size_t i = 0; i < m_node_blocks.size(); ++i)
             {
-                delete[] m_available_nodes[i];
+                delete[] m_node_blocks[i];
             }
         }
-        // Returns a pointer to an ANode for aStar search, but allocates
-        // these in blocks 
+        // Returns a pointer to an ANode for aStar search.  These are 
+        // allocated in blocks which are kept for later searches.
         ANode *newANode(const ANode& node, const bool addToPending = true)
         {
-            const size_t blockSize = 5000;
-            if ((m_available_array_index + 1 > m_available_array_size) ||
-                    (m_available_node_index >= blockSize))
+            COLA_ASSERT(m_node_count < UINT_MAX);
+            const unsigned int index = m_node_count++;
+            if ((index >> nodeBlockBits) == m_node_blocks.size())
             {
-                m_available_nodes.push_back(new ANode[blockSize]);
-                ++m_available_array_size;
-                m_available_node_index = 0;
-                m_available_array_index = m_available_array_size - 1;
-            }
-            
-            ANode *nodes = m_available_nodes[m_available_array_index];
-            ANode *newNode = &(nodes[m_available_node_index++]);
-            *newNode = node;
-            if (addToPending)
-            {
-                node.inf->aStarPendingNodes.push_back(newNode);
+                m_node_blocks.push_back(new ANode[1u << nodeBlockBits]);
             }
+            ANode *newNode = &nodeAt(index);
+            newNode->setState(node);
+            newNode->index = index;
+            newNode->done = !addToPending;
+
+            // Add it to the list of nodes for its vertex.
+            ANode *& head = vertexNodes(node.inf);
+            newNode->nextAtVertex = head;
+            head = newNode;
             return newNode;
         }
+        ANode& nodeAt(const unsigned int index)
+        {
+            return m_node_blocks[index >> nodeBlockBits]
+                    [index & ((1u << nodeBlockBits) - 1)];
+        }
         void search(ConnRef *lineRef, VertInf *src, VertInf *tar, 
                 VertInf *start);
 
+        // If set, the search leaves the visibility graph unmodified, so that
+        // several searches may run concurrently.
+        bool m_shared_graph;
+        // The path found by the last search, from the target back to the 
+        // source, or empty if there was no path.
+        std::vector<VertInf *> m_path;
+        // The number of nodes expanded by the last search.
+        size_t m_expanded_count;
+
     private:
+        void searchGraph(ConnRef *lineRef, VertInf *src, VertInf *tar, 
+                VertInf *start);
         void determineEndPointLocation(double dist, VertInf *start,
                 VertInf *target, VertInf *other, int level);
         double estimatedCost(ConnRef *lineRef, const Point *last,
                 const Point& curr) const;
-
-        std::vector<ANode *> m_available_nodes;
-        size_t m_available_array_size;
-        size_t m_available_array_index;
-        size_t m_available_node_index;
+        void resetSearchState(void);
+        ANode *& vertexNodes(const VertInf *inf);
+
+        // The nodes are allocated in blocks of 2^nodeBlockBits, so that they
+        // don't move as more are added, and addressed by 32-bit indices.
+        static const unsigned int nodeBlockBits = 12;
+        std::vector<ANode *> m_node_blocks;
+        unsigned int m_node_count;
  
         // For determining estimated cost target.
         std::vector<VertInf *> m_cost_targets;
         std::vector<unsigned int> m_cost_targets_directions;
         std::vector<double> m_cost_targets_displacements;
+
+        // The first of the nodes (in the Pending or Done sets) for each 
+        // vertex reached by the current search, in an open addressing hash
+        // table.  Slots whose stamp isn't the current m_vertex_stamp are 
+        // empty, so the table is cleared between searches by changing it.
+        struct VertexSlot
+        {
+            const VertInf *inf;
+            unsigned int stamp;
+            ANode *nodes;
+        };
+        std::vector<VertexSlot> m_vertex_slots;
+        unsigned int m_vertex_stamp;
+        size_t m_vertex_count;
+
+        // Heap of Pending nodes.
+        std::vector<PendingEntry> m_pending;
+
+        // The visibility edges of the vertex being expanded, in the order 
+        // they are explored.
+        std::vector<EdgeInf *> m_edges;
+
+        // If set, searchGraph() only considers vertices inside m_window, 
+        // and sets m_window_excluded if it left any out.
+        bool m_restrict_to_window;
+        Box m_window;
+        bool m_window_excluded;
+        // Whether searchGraph() reached the target.
+        bool m_path_found;
 };
 
 
+static inline size_t vertexHash(const VertInf *inf)
+{
+    // Fibonacci hashing of the pointer, ignoring its alignment bits.
+    return (size_t) ((((unsigned long long) (size_t) inf) >> 4) * 
+            11400714819323198485ULL >> 32);
+}
 
-// This returns the opposite result (>) so that when used with stl::make_heap, 
-// the head node of the heap will be the smallest value, rather than the 
-// largest.  This saves us from having to sort the heap (and then reorder
-// it back into a heap) when getting the next node to examine.  This way we
-// get better complexity -- logarithmic pushes and pops to the heap.
-//
-class ANodeCmp
+
+void AStarPathPrivate::resetSearchState(void)
 {
-    public:
-    ANodeCmp()
+    m_node_count = 0;
+    m_pending.clear();
+    m_vertex_count = 0;
+    ++m_vertex_stamp;
+    if (m_vertex_stamp == 0)
     {
+        // The stamp has wrapped around, so really clear the table.
+        for (size_t i = 0; i < m_vertex_slots.size(); ++i)
+        {
+            m_vertex_slots[i].stamp = 0;
+        }
+        m_vertex_stamp = 1;
     }
-bool operator()(const ANode *a, const ANode *b)
+}
+
+
+ANode *& AStarPathPrivate::vertexNodes(const VertInf *inf)
 {
-    // We need to use an epsilon here since otherwise the multiple addition
-    // of floating point numbers that makes up the 'f' values cause a problem
-    // with routings occasionally being non-deterministic.
-    if (fabs(a->f - b->f) > 0.0000001)
+    if ((m_vertex_count + 1) * 2 > m_vertex_slots.size())
     {
-        return a->f > b->f;
+        // Grow the table, keeping only the current search's entries.
+        std::vector<VertexSlot> old;
+        old.swap(m_vertex_slots);
+        VertexSlot empty = { NULL, 0, NULL };
+        m_vertex_slots.assign(std::max((size_t) 1024, old.size() * 2), empty);
+        const size_t mask = m_vertex_slots.size() - 1;
+        for (size_t i = 0; i < old.size(); ++i)
+        {
+            if (old[i].stamp == m_vertex_stamp)
+            {
+                size_t slot = vertexHash(old[i].inf) & mask;
+                while (m_vertex_slots[slot].stamp == m_vertex_stamp)
+                {
+                    slot = (slot + 1) & mask;
+                }
+                m_vertex_slots[slot] = old[i];
+            }
+        }
     }
-    if (a->timeStamp != b->timeStamp)
+
+    const size_t mask = m_vertex_slots.size() - 1;
+    size_t slot = vertexHash(inf) & mask;
+    while (m_vertex_slots[slot].stamp == m_vertex_stamp)
     {
-        // Tiebreaker, if two paths have equal cost, then choose the one with
-        // the highest timeStamp.  This corresponds to the furthest point
-        // explored along the straight-line path.  When exploring we give the
-        // directions the following timeStamps; left:1, right:2 and forward:3,
-        // then we always try to explore forward first.
-        return a->timeStamp < b->timeStamp;
+        if (m_vertex_slots[slot].inf == inf)
+        {
+            return m_vertex_slots[slot].nodes;
+        }
+        slot = (slot + 1) & mask;
     }
-    return false;
+    VertexSlot& newSlot = m_vertex_slots[slot];
+    newSlot.inf = inf;
+    newSlot.stamp = m_vertex_stamp;
+    newSlot.nodes = NULL;
+    ++m_vertex_count;
+    return newSlot.nodes;
 }
-};
 
 
 static double Dot(const Point& l, const Point& r)
@@ -920,7 +1082,29 @@ AStarPath::~AStarPath(void)
 
 void AStarPath::search(ConnRef *lineRef, VertInf *src, VertInf *tar, VertInf *start)
 {
+    m_private->m_shared_graph = false;
+    m_private->search(lineRef, src, tar, start);
+    lineRef->m_search_expanded_nodes += m_private->m_expanded_count;
+    setPathNextLinks(tar, m_private->m_path);
+}
+
+void AStarPath::search(ConnRef *lineRef, VertInf *src, VertInf *tar, 
+        VertInf *start, std::vector<VertInf *>& path)
+{
+    m_private->m_shared_graph = true;
     m_private->search(lineRef, src, tar, start);
+    lineRef->m_search_expanded_nodes += m_private->m_expanded_count;
+    path.swap(m_private->m_path);
+}
+
+void AStarPath::setPathNextLinks(VertInf *tar, 
+        const std::vector<VertInf *>& path)
+{
+    tar->pathNext = NULL;
+    for (size_t i = 1; i < path.size(); ++i)
+    {
+        path[i - 1]->pathNext = path[i];
+    }
 }
 
 void AStarPathPrivate::determineEndPointLocation(double dist, VertInf *start, 
@@ -951,17 +1135,93 @@ void AStarPathPrivate::determineEndPointLocation(double dist, VertInf *start,
 #endif
 }
 
+// Searches for the best path from src to tar, as searchGraph() does.
+//
+// If the searchOrthogonalRoutesInLocalRegion option is set, orthogonal 
+// connectors are first searched for in a window around their endpoints 
+// and the neighbours of the target.  The first path found in the window
+// is used, and the window is only widened, and the search repeated, if 
+// there is no path inside it.
+//
+void AStarPathPrivate::search(ConnRef *lineRef, VertInf *src, VertInf *tar, 
+        VertInf *start)
+{
+    m_restrict_to_window = false;
+
+    Router *router = lineRef->router();
+    if ((lineRef->routingType() != ConnType_Orthogonal) || 
+            router->RubberBandRouting || 
+            !router->routingOption(searchOrthogonalRoutesInLocalRegion))
+    {
+        searchGraph(lineRef, src, tar, start);
+        return;
+    }
+
+    Box core;
+    core.min = core.max = src->point;
+    std::vector<VertInf *> ends(1, tar);
+    if (src->id.isDummyPinHelper())
+    {
+        // The source's pins.
+        for (EdgeInfList::const_iterator it = src->orthogVisList.begin();
+                it != src->orthogVisList.end(); ++it)
+        {
+            ends.push_back((*it)->otherVert(src));
+        }
+    }
+    for (EdgeInfList::const_iterator it = tar->orthogVisList.begin(); 
+            it != tar->orthogVisList.end(); ++it)
+    {
+        ends.push_back((*it)->otherVert(tar));
+    }
+    for (size_t i = 0; i < ends.size(); ++i)
+    {
+        const Point& point = ends[i]->point;
+        core.min.x = std::min(core.min.x, point.x);
+        core.min.y = std::min(core.min.y, point.y);
+        core.max.x = std::max(core.max.x, point.x);
+        core.max.y = std::max(core.max.y, point.y);
+    }
+
+    // Start with room for a couple of bends and a detour of half the 
+    // window's narrower side, and widen quickly, since failed searches 
+    // are wasted.
+    double margin = std::min(core.width(), core.height()) / 2 + 
+            (2 * router->routingParameter(segmentPenalty)) + 1;
+    size_t expandedCount = 0;
+    while (true)
+    {
+        m_restrict_to_window = true;
+        m_window.min.x = core.min.x - margin;
+        m_window.min.y = core.min.y - margin;
+        m_window.max.x = core.max.x + margin;
+        m_window.max.y = core.max.y + margin;
+        searchGraph(lineRef, src, tar, start);
+        expandedCount += m_expanded_count;
+        if (m_path_found || !m_window_excluded)
+        {
+            break;
+        }
+        margin *= 4;
+    }
+    m_restrict_to_window = false;
+    m_expanded_count = expandedCount;
+}
+
+
 // Returns the best path from src to tar using the cost function.
 //
 // The path is worked out using the aStar algorithm, and is encoded via
 // prevNode values for each ANode which point back to the previous ANode.
-// At completion, this order is written into the pathNext links in each 
-// of the VerInfs along the path.
+// At completion, this order is written into m_path, and then by 
+// AStarPath::search() into the pathNext links in each of the VerInfs 
+// along the path.
 //
 // The aStar STL code is originally based on public domain code available 
 // on the internet.
 //
-void AStarPathPrivate::search(ConnRef *lineRef, VertInf *src, VertInf *tar, VertInf *start)
+void AStarPathPrivate::searchGraph(ConnRef *lineRef, VertInf *src, 
+        VertInf *tar, VertInf *start)
 {
     ANodeCmp pendingCmp;
 
@@ -972,6 +1232,17 @@ void AStarPathPrivate::search(ConnRef *lineRef, VertInf *src, VertInf *tar, Vert
         start = src;
     }
 
+    // Reuse the nodes and tables of any previous search.
+    resetSearchState();
+
+    m_path.clear();
+    m_expanded_count = 0;
+    m_window_excluded = false;
+    m_path_found = false;
+    m_cost_targets.clear();
+    m_cost_targets_directions.clear();
+    m_cost_targets_displacements.clear();
+
 
     // Find a target point to use for cost estimate for orthogonal routing.
     //
@@ -1062,8 +1333,7 @@ void AStarPathPrivate::search(ConnRef *lineRef, VertInf *src, VertInf *tar, Vert
     endPoints.push_back(tar->point);
     
     // Heap of PENDING nodes.
-    std::vector<ANode *> PENDING;
-    PENDING.reserve(1000);
+    std::vector<PendingEntry>& PENDING = m_pending;
 
     size_t exploredCount = 0;
     ANode node, ati;
@@ -1122,13 +1392,12 @@ void AStarPathPrivate::search(ConnRef *lineRef, VertInf *src, VertInf *tar, Vert
             {
                 bool addToPending = false;
                 bestNode = newANode(node, addToPending);
-                bestNode->inf->aStarDoneNodes.push_back(bestNode);
                 ++exploredCount;
             }
             else
             {
                 ANode * newNode = newANode(node);
-                PENDING.push_back(newNode);
+                PENDING.push_back(PendingEntry(newNode));
             }
 
             rIndx++;
@@ -1148,7 +1417,6 @@ void AStarPathPrivate::search(ConnRef *lineRef, VertInf *src, VertInf *tar, Vert
             bool addToPending = false;
             bestNode = newANode(ANode(start->pathNext, timestamp++), 
                     addToPending);
-            bestNode->inf->aStarDoneNodes.push_back(bestNode);
             ++exploredCount;
         }
 
@@ -1162,11 +1430,9 @@ void AStarPathPrivate::search(ConnRef *lineRef, VertInf *src, VertInf *tar, Vert
 
         // Populate the PENDING container with the first location
         ANode *newNode = newANode(node);
-        PENDING.push_back(newNode);
+        PENDING.push_back(PendingEntry(newNode));
     }
 
-    tar->pathNext = NULL;
-
     // Create a heap from PENDING for sorting
     using std::make_heap; using std::push_heap; using std::pop_heap;
     make_heap( PENDING.begin(), PENDING.end(), pendingCmp);
@@ -1174,26 +1440,11 @@ void AStarPathPrivate::search(ConnRef *lineRef, VertInf *src, VertInf *tar, Vert
     // Continue until the queue is empty.
     while (!PENDING.empty())
     {
-        TIMER_VAR_ADD(router, 0, 1);
         // Set the Node with lowest f value to BESTNODE.
         // Since the ANode operator< is reversed, the head of the
         // heap is the node with the lowest f value.
-        bestNode = PENDING.front();
-        VertInf *bestNodeInf = bestNode->inf;
-
-        // Remove this node from the aStarPendingList
-        std::list<ANode *>::iterator finishIt = 
-                bestNodeInf->aStarPendingNodes.end();
-        for (std::list<ANode *>::iterator currInd = 
-                bestNodeInf->aStarPendingNodes.begin(); currInd != finishIt; 
-                ++currInd)
-        {
-            if (*currInd == bestNode)
-            {
-                bestNodeInf->aStarPendingNodes.erase(currInd);
-                break;
-            }
-        }
+        const PendingEntry best = PENDING.front();
+        bestNode = &nodeAt(best.index);
 
         // Pop off the heap.  Actually this moves the
         // far left value to the far right.  The node
@@ -1203,8 +1454,19 @@ void AStarPathPrivate::search(ConnRef *lineRef, VertInf *src, VertInf *tar, Vert
         // Remove node from right (the value we pop_heap'd)
         PENDING.pop_back();
 
-        // Add the bestNode into the Done set.
-        bestNodeInf->aStarDoneNodes.push_back(bestNode);
+        if (best.timeStamp != bestNode->timeStamp)
+        {
+            // A stale entry for a node that has since been replaced.
+            continue;
+        }
+        if (!m_shared_graph)
+        {
+            TIMER_VAR_ADD(router, 0, 1);
+        }
+        VertInf *bestNodeInf = bestNode->inf;
+
+        // Move the bestNode into the Done set.
+        bestNode->done = true;
         ++exploredCount;
 
         VertInf *prevInf = (bestNode->prevNode) ? bestNode->prevNode->inf : NULL;
@@ -1223,20 +1485,28 @@ void AStarPathPrivate::search(ConnRef *lineRef, VertInf *src, VertInf *tar, Vert
 
         if (bestNodeInf == tar)
         {
-            TIMER_VAR_ADD(router, 1, PENDING.size());
+            if (!m_shared_graph)
+            {
+                TIMER_VAR_ADD(router, 1, PENDING.size());
+            }
             // This node is our goal.
+            m_path_found = true;
 #ifdef ASTAR_DEBUG
             db_printf("LINE %10d  Steps: %4d  Cost: %g\n", lineRef->id(), 
                     (int) exploredCount, bestNode->f);
 #endif
      
-            // Correct all the pathNext pointers.
+            // Record the path.
             for (ANode *curr = bestNode; curr->prevNode; curr = curr->prevNode)
             {
 #ifdef ASTAR_DEBUG
                 db_printf("[%.12f, %.12f]\n", curr->inf->point.x, curr->inf->point.y);
 #endif
-                curr->inf->pathNext = curr->prevNode->inf;
+                if (m_path.empty())
+                {
+                    m_path.push_back(curr->inf);
+                }
+                m_path.push_back(curr->prevNode->inf);
             }
 #ifdef ASTAR_DEBUG
             db_printf("\n", count);
@@ -1247,17 +1517,20 @@ void AStarPathPrivate::search(ConnRef *lineRef, VertInf *src, VertInf *tar, Vert
         }
 
         // Check adjacent points in graph and add them to the queue.
-        EdgeInfList& visList = (!isOrthogonal) ?
+        const EdgeInfList& visList = (!isOrthogonal) ?
                 bestNodeInf->visList : bestNodeInf->orthogVisList;
+        m_edges.assign(visList.begin(), visList.end());
         if (isOrthogonal)
         {
-            // We would like to explore in a structured way, 
-            // so sort the points in the visList...
+            // We would like to explore in a structured way, so sort the
+            // points in a copy of the visList.  The visList itself is left
+            // alone, so the order of ties doesn't depend on earlier 
+            // searches and other searches may read it at the same time.
             CmpVisEdgeRotation compare(prevInf);
-            visList.sort(compare);
+            std::stable_sort(m_edges.begin(), m_edges.end(), compare);
         }
-        EdgeInfList::const_iterator finish = visList.end();
-        for (EdgeInfList::const_iterator edge = visList.begin(); 
+        std::vector<EdgeInf *>::const_iterator finish = m_edges.end();
+        for (std::vector<EdgeInf *>::const_iterator edge = m_edges.begin(); 
                 edge != finish; ++edge)
         {
             if ((*edge)->isDisabled())
@@ -1280,6 +1553,16 @@ void AStarPathPrivate::search(ConnRef *lineRef, VertInf *src, VertInf *tar, Vert
             {
                 continue;
             }
+            if (m_restrict_to_window && 
+                    ((node.inf->point.x < m_window.min.x) ||
+                     (node.inf->point.x > m_window.max.x) ||
+                     (node.inf->point.y < m_window.min.y) ||
+                     (node.inf->point.y > m_window.max.y)))
+            {
+                // Outside the region being searched.
+                m_window_excluded = true;
+                continue;
+            }
             if (node.inf->id.isConnectionPin() && 
                     !node.inf->id.isConnCheckpoint())
             {
@@ -1427,62 +1710,56 @@ void AStarPathPrivate::search(ConnRef *lineRef, VertInf *src, VertInf *tar, Vert
 
             bNodeFound = false;
 
-    
-            // Check to see if already on PENDING
-            std::list<ANode *>::const_iterator finish = node.inf->aStarPendingNodes.end();
-            for (std::list<ANode *>::const_iterator currInd = 
-                    node.inf->aStarPendingNodes.begin(); currInd != finish; ++currInd)
+            // Check to see if already on PENDING or in the Done set for 
+            // this vertex.  There is at most one node for each previous 
+            // vertex, in one or the other.
+            for (ANode *curr = vertexNodes(node.inf); curr != NULL; 
+                    curr = curr->nextAtVertex)
             {
-                ati = **currInd;
-                // The (node.prevNode == ati.prevNode) is redundant, but may
-                // save checking the mosre costly prevNode->inf test if the
-                // Nodes are the same.
-                if ((node.inf == ati.inf) && 
-                        ((node.prevNode == ati.prevNode) ||
-                         (node.prevNode->inf == ati.prevNode->inf)))
+                ati = *curr;
+                if (!ati.done)
                 {
-                    // If already on PENDING
-                    if (node.g < ati.g)
-                    {
-                        // Replace the existing node in PENDING
-                        **currInd = node;
-                        make_heap( PENDING.begin(), PENDING.end(), pendingCmp);
-                    }
-                    bNodeFound = true;
-                    break;
-                }
-            }
-            if ( !bNodeFound ) // If Node NOT found on PENDING
-            {
-                // Check to see if it is already in the Done set for this
-                // vertex.
-                for (std::list<ANode *>::const_iterator currInd = 
-                        node.inf->aStarDoneNodes.begin();
-                        currInd != node.inf->aStarDoneNodes.end(); ++currInd)
-                {
-                    ati = **currInd;
-                    // The (node.prevNode == ati.prevNode) is redundant, but may
-                    // save checking the mosre costly prevNode->inf test if the
-                    // Nodes are the same.
-                    if ((node.inf == ati.inf) && ati.prevNode &&
+                    // The (node.prevNode == ati.prevNode) is redundant, but 
+                    // may save checking the more costly prevNode->inf test 
+                    // if the Nodes are the same.
+                    if ((node.inf == ati.inf) && 
                             ((node.prevNode == ati.prevNode) ||
                              (node.prevNode->inf == ati.prevNode->inf)))
                     {
-                        //COLA_ASSERT(node.g >= (ati.g - 10e-10));
-                        // This node is already in the Done set and the 
-                        // current node also has a higher g-value, so we 
-                        // don't need to consider this node.
+                        // If already on PENDING
+                        if (node.g < ati.g)
+                        {
+                            // Replace the existing node in PENDING.  Its
+                            // old heap entry is left in place and skipped
+                            // when popped, since its timeStamp no longer
+                            // matches the node.
+                            curr->setState(node);
+                            PENDING.push_back(PendingEntry(curr));
+                            push_heap( PENDING.begin(), PENDING.end(), 
+                                    pendingCmp);
+                        }
                         bNodeFound = true;
                         break;
                     }
                 }
+                else if ((node.inf == ati.inf) && ati.prevNode &&
+                        ((node.prevNode == ati.prevNode) ||
+                         (node.prevNode->inf == ati.prevNode->inf)))
+                {
+                    //COLA_ASSERT(node.g >= (ati.g - 10e-10));
+                    // This node is already in the Done set and the 
+                    // current node also has a higher g-value, so we 
+                    // don't need to consider this node.
+                    bNodeFound = true;
+                    break;
+                }
             }
 
             if (!bNodeFound ) // If Node NOT in either Pending or Done.
             {
                 // Push NewNode onto PENDING
                 ANode *newNode = newANode(node);
-                PENDING.push_back(newNode);
+                PENDING.push_back(PendingEntry(newNode));
                 // Push NewNode onto heap
                 push_heap( PENDING.begin(), PENDING.end(), pendingCmp);
 
@@ -1492,23 +1769,16 @@ void AStarPathPrivate::search(ConnRef *lineRef, VertInf *src, VertInf *tar, Vert
                 cout << "PENDING:   ";
                 for (unsigned int i = 0; i < PENDING.size(); i++)
                 {
-                    cout << PENDING[i]->g << "," << PENDING[i]->h << ",";
-                    cout << PENDING[i]->inf << "," << PENDING[i]->pp << "  ";
+                    ANode& pending = nodeAt(PENDING[i].index);
+                    cout << pending.g << "," << pending.h << ",";
+                    cout << pending.inf << "," << pending.prevNode << "  ";
                 }
                 cout << endl << endl;
 #endif
             }
         }
     }
-
-    // Cleanup lists used to store Done and Pending sets for each vertex.
-    VertInf *endVert = router->vertices.end();
-    for (VertInf *k = router->vertices.connsBegin(); k != endVert;
-            k = k->lstNext)
-    {
-        k->aStarDoneNodes.clear();
-        k->aStarPendingNodes.clear();
-    }
+    m_expanded_count = exploredCount;
 }
 
 
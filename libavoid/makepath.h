@@ -26,6 +26,7 @@
 #ifndef AVOID_MAKEPATH_H
 #define AVOID_MAKEPATH_H
 
+#include <vector>
 
 namespace Avoid {
 
@@ -41,7 +42,21 @@ class AStarPath
         ~AStarPath();
         void search(ConnRef *lineRef, VertInf *src, VertInf *tar, 
                 VertInf *start);
+        // As above, but rather than setting the pathNext links of the 
+        // vertices on the path, returns the path from tar back to src (or
+        // an empty path if there is none) without modifying the visibility
+        // graph.  Searches using different AStarPath objects can then run 
+        // concurrently.
+        void search(ConnRef *lineRef, VertInf *src, VertInf *tar, 
+                VertInf *start, std::vector<VertInf *>& path);
+        // Sets the pathNext links for a path returned by search(), as 
+        // the first form of search() does.
+        static void setPathNextLinks(VertInf *tar, 
+                const std::vector<VertInf *>& path);
     private:
+        AStarPath(const AStarPath&);
+        AStarPath& operator=(const AStarPath&);
+
         AStarPathPrivate *m_private;        
 };
 
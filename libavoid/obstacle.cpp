@@ -118,6 +118,13 @@ void Obstacle::setNewPoly(const Polygon& poly)
         curr = curr->shNext;
     }
     COLA_ASSERT(curr == m_first_vert);
+
+    if (m_active)
+    {
+        // Reindex with the new routing box.
+        m_router->m_obstacle_index.remove(this);
+        m_router->m_obstacle_index.insert(this);
+    }
         
     // It may be that the polygon for the obstacle has been updated after
     // creating the shape.  These events may have been combined for a single
@@ -149,6 +156,7 @@ void Obstacle::makeActive(void)
         m_router->vertices.addVertex(tmp);
     }
     while (it != m_first_vert);
+    m_router->m_obstacle_index.insert(this);
    
     m_active = true;
 }
@@ -171,6 +179,7 @@ void Obstacle::makeInactive(void)
         m_router->vertices.removeVertex(tmp);
     }
     while (it != m_first_vert);
+    m_router->m_obstacle_index.remove(this);
     
     m_active = false;
     
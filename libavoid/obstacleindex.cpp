@@ -0,0 +1,245 @@
+/*
+ * vim: ts=4 sw=4 et tw=0 wm=0
+ *
+ * libavoid - Fast, Incremental, Object-avoiding Line Router
+ *
+ * Copyright (C) 2014  Monash University
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * See the file LICENSE.LGPL distributed with the library.
+ *
+ * Licensees holding a valid commercial license may use this file in
+ * accordance with the commercial license agreement provided with the
+ * library.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+*/
+
+#include <algorithm>
+#include <cmath>
+
+#include "libavoid/obstacleindex.h"
+#include "libavoid/gridcells.h"
+#include "libavoid/obstacle.h"
+#include "libavoid/vertices.h"
+#include "libavoid/assertions.h"
+
+
+namespace Avoid {
+
+// Boxes covering more cells than this are not stored in the grid, but
+// reported for every query instead.
+static const long long maxCellsPerObstacle = 1024;
+
+
+ObstacleIndex::ObstacleIndex()
+    : m_cell_size(0),
+      m_extent_sum(0)
+{
+}
+
+
+void ObstacleIndex::insert(Obstacle *obstacle)
+{
+    const unsigned int id = obstacle->id();
+    COLA_ASSERT(m_entries.find(id) == m_entries.end());
+
+    Entry entry;
+    entry.obstacle = obstacle;
+    entry.large = false;
+    VertInf *first = obstacle->firstVert();
+    entry.box.min = entry.box.max = first->point;
+    for (VertInf *vert = first->shNext; vert != first; vert = vert->shNext)
+    {
+        entry.box.min.x = std::min(entry.box.min.x, vert->point.x);
+        entry.box.min.y = std::min(entry.box.min.y, vert->point.y);
+        entry.box.max.x = std::max(entry.box.max.x, vert->point.x);
+        entry.box.max.y = std::max(entry.box.max.y, vert->point.y);
+    }
+
+    if (m_entries.empty())
+    {
+        m_extent = entry.box;
+    }
+    else
+    {
+        m_extent.min.x = std::min(m_extent.min.x, entry.box.min.x);
+        m_extent.min.y = std::min(m_extent.min.y, entry.box.min.y);
+        m_extent.max.x = std::max(m_extent.max.x, entry.box.max.x);
+        m_extent.max.y = std::max(m_extent.max.y, entry.box.max.y);
+    }
+    m_extent_sum += std::max(entry.box.width(), entry.box.height());
+    Entry& added = m_entries.insert(std::make_pair(id, entry)).first->second;
+
+    // Choose a new cell size if the obstacles have changed scale.
+    double cellSize = gridCellSize(m_extent_sum / m_entries.size());
+    if (gridCellSizeChanged(m_cell_size, cellSize))
+    {
+        reindex(cellSize);
+    }
+    else
+    {
+        indexEntry(id, added);
+    }
+}
+
+
+void ObstacleIndex::remove(Obstacle *obstacle)
+{
+    EntryMap::iterator it = m_entries.find(obstacle->id());
+    if (it == m_entries.end())
+    {
+        return;
+    }
+    unindexEntry(it->first, it->second);
+    m_extent_sum -= std::max(it->second.box.width(), it->second.box.height());
+    m_entries.erase(it);
+
+    if (m_entries.empty())
+    {
+        m_cells.clear();
+        m_cell_size = 0;
+        m_extent_sum = 0;
+    }
+}
+
+
+void ObstacleIndex::reindex(const double cellSize)
+{
+    m_cell_size = cellSize;
+    m_cells.clear();
+    m_large.clear();
+    for (EntryMap::iterator it = m_entries.begin(); it != m_entries.end();
+            ++it)
+    {
+        indexEntry(it->first, it->second);
+    }
+}
+
+
+void ObstacleIndex::indexEntry(const unsigned int id, Entry& entry)
+{
+    long long x0 = gridCellCoord(entry.box.min.x, m_cell_size);
+    long long x1 = gridCellCoord(entry.box.max.x, m_cell_size);
+    long long y0 = gridCellCoord(entry.box.min.y, m_cell_size);
+    long long y1 = gridCellCoord(entry.box.max.y, m_cell_size);
+    entry.large = ((x1 - x0 + 1) * (y1 - y0 + 1) > maxCellsPerObstacle);
+    if (entry.large)
+    {
+        m_large.push_back(id);
+        return;
+    }
+    for (long long cx = x0; cx <= x1; ++cx)
+    {
+        for (long long cy = y0; cy <= y1; ++cy)
+        {
+            m_cells[gridCellKey(cx, cy)].push_back(id);
+        }
+    }
+}
+
+
+void ObstacleIndex::unindexEntry(const unsigned int id, const Entry& entry)
+{
+    if (entry.large)
+    {
+        m_large.erase(std::find(m_large.begin(), m_large.end(), id));
+        return;
+    }
+    long long x0 = gridCellCoord(entry.box.min.x, m_cell_size);
+    long long x1 = gridCellCoord(entry.box.max.x, m_cell_size);
+    long long y0 = gridCellCoord(entry.box.min.y, m_cell_size);
+    long long y1 = gridCellCoord(entry.box.max.y, m_cell_size);
+    for (long long cx = x0; cx <= x1; ++cx)
+    {
+        for (long long cy = y0; cy <= y1; ++cy)
+        {
+            CellMap::iterator cell = m_cells.find(gridCellKey(cx, cy));
+            COLA_ASSERT(cell != m_cells.end());
+            std::vector<unsigned int>& ids = cell->second;
+            ids.erase(std::find(ids.begin(), ids.end(), id));
+            if (ids.empty())
+            {
+                m_cells.erase(cell);
+            }
+        }
+    }
+}
+
+
+void ObstacleIndex::segmentCandidates(const Point& a, const Point& b,
+        std::vector<Obstacle *>& result) const
+{
+    result.clear();
+    if (m_entries.empty())
+    {
+        return;
+    }
+
+    Box segBox;
+    segBox.min.x = std::min(a.x, b.x);
+    segBox.min.y = std::min(a.y, b.y);
+    segBox.max.x = std::max(a.x, b.x);
+    segBox.max.y = std::max(a.y, b.y);
+    if (!gridBoxesOverlap(segBox, m_extent))
+    {
+        return;
+    }
+
+    // Only visit the cells of each column that the segment passes
+    // through, clipped to the extent of the obstacles.  The range in each
+    // column is widened by a cell to allow for rounding.
+    std::vector<unsigned int> ids(m_large);
+    double minX = std::max(segBox.min.x, m_extent.min.x);
+    double maxX = std::min(segBox.max.x, m_extent.max.x);
+    long long minCy = gridCellCoord(std::max(segBox.min.y, m_extent.min.y),
+            m_cell_size);
+    long long maxCy = gridCellCoord(std::min(segBox.max.y, m_extent.max.y),
+            m_cell_size);
+    long long x0 = gridCellCoord(minX, m_cell_size);
+    long long x1 = gridCellCoord(maxX, m_cell_size);
+    for (long long cx = x0; cx <= x1; ++cx)
+    {
+        long long y0 = minCy;
+        long long y1 = maxCy;
+        if (a.x != b.x)
+        {
+            double colMin = std::max(minX, cx * m_cell_size);
+            double colMax = std::min(maxX, (cx + 1) * m_cell_size);
+            double ya = a.y + (colMin - a.x) * (b.y - a.y) / (b.x - a.x);
+            double yb = a.y + (colMax - a.x) * (b.y - a.y) / (b.x - a.x);
+            y0 = std::max(y0, gridCellCoord(std::min(ya, yb), m_cell_size) - 1);
+            y1 = std::min(y1, gridCellCoord(std::max(ya, yb), m_cell_size) + 1);
+        }
+        for (long long cy = y0; cy <= y1; ++cy)
+        {
+            CellMap::const_iterator cell = m_cells.find(gridCellKey(cx, cy));
+            if (cell != m_cells.end())
+            {
+                ids.insert(ids.end(), cell->second.begin(),
+                        cell->second.end());
+            }
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        const Entry& entry = m_entries.find(ids[i])->second;
+        if (gridBoxesOverlap(entry.box, segBox))
+        {
+            result.push_back(entry.obstacle);
+        }
+    }
+}
+
+
+}
+
@@ -0,0 +1,104 @@
+/*
+ * vim: ts=4 sw=4 et tw=0 wm=0
+ *
+ * libavoid - Fast, Incremental, Object-avoiding Line Router
+ *
+ * Copyright (C) 2014  Monash University
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * See the file LICENSE.LGPL distributed with the library.
+ *
+ * Licensees holding a valid commercial license may use this file in
+ * accordance with the commercial license agreement provided with the
+ * library.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+*/
+
+//! @file    obstacleindex.h
+//! @brief   Contains the interface for the ObstacleIndex class.
+
+
+#ifndef AVOID_OBSTACLEINDEX_H
+#define AVOID_OBSTACLEINDEX_H
+
+#include <vector>
+#include <unordered_map>
+
+#include "libavoid/geomtypes.h"
+#include "libavoid/gridcells.h"
+#include "libavoid/dllexport.h"
+
+
+namespace Avoid {
+
+class Obstacle;
+
+
+//! @brief   A spatial index over the routing boxes of the active obstacles
+//!          in a router, used to find the obstacles that may block a
+//!          polyline visibility edge.
+//!
+//! Boxes are stored in a uniform grid.  A segment is only reported as
+//! possibly blocked by an obstacle if it passes through a cell holding the
+//! obstacle's box and touches that box, so obstacles that are never
+//! reported can not intersect the segment.
+//!
+//! The index is kept up to date as obstacles are made active, made
+//! inactive or given a new polygon, so each update touches only the
+//! cells of that one obstacle.
+//!
+class AVOID_EXPORT ObstacleIndex
+{
+    public:
+        ObstacleIndex();
+
+        //! @brief  Adds an obstacle, using the current positions of its
+        //!         routing vertices.
+        void insert(Obstacle *obstacle);
+
+        //! @brief  Removes an obstacle, if it is in the index.
+        void remove(Obstacle *obstacle);
+
+        //! @brief  Returns, in ascending order of id, the obstacles whose
+        //!         routing boxes may be touched by the segment from a to b.
+        void segmentCandidates(const Point& a, const Point& b,
+                std::vector<Obstacle *>& result) const;
+
+    private:
+        struct Entry
+        {
+            Obstacle *obstacle;
+            Box box;
+            bool large;
+        };
+        typedef std::unordered_map<unsigned int, Entry> EntryMap;
+        typedef std::unordered_map<GridCellKey, std::vector<unsigned int> >
+                CellMap;
+
+        void indexEntry(const unsigned int id, Entry& entry);
+        void unindexEntry(const unsigned int id, const Entry& entry);
+        void reindex(const double cellSize);
+
+        EntryMap m_entries;
+        CellMap m_cells;
+        // Obstacles whose boxes cover too many cells, always reported.
+        std::vector<unsigned int> m_large;
+        double m_cell_size;
+        // Sum of box extents, used to choose m_cell_size.
+        double m_extent_sum;
+        // A box containing every obstacle in the index, so that queries
+        // can be clipped to it.  It is only reset when the index empties.
+        Box m_extent;
+};
+
+
+}
+
+#endif
@@ -27,8 +27,13 @@
 #include <cfloat>
 #include <cmath>
 #include <set>
+#include <map>
 #include <list>
+#include <vector>
 #include <algorithm>
+#include <thread>
+#include <atomic>
+#include <functional>
 
 #include "libavoid/router.h"
 #include "libavoid/geomtypes.h"
@@ -814,6 +819,35 @@ public:
         }
     }
 
+    // Adds a point to breakPoints.  The points are mostly added in order
+    // along the line and the last one is often added again, so these cases
+    // are handled without searching the set.
+    void addBreakPoint(const PosVertInf& point)
+    {
+        if (breakPoints.empty() || (*breakPoints.rbegin() < point))
+        {
+            breakPoints.insert(breakPoints.end(), point);
+        }
+        else if (point < *breakPoints.rbegin())
+        {
+            breakPoints.insert(point);
+        }
+    }
+
+    // Adds the points collected in pendingBreakPoints to breakPoints.  
+    // Sorting them first makes this quicker, and as the sort is stable, 
+    // the same points are kept as if each had been inserted in turn.
+    void commitPendingBreakPoints(void)
+    {
+        std::stable_sort(pendingBreakPoints.begin(), 
+                pendingBreakPoints.end());
+        for (size_t i = 0; i < pendingBreakPoints.size(); ++i)
+        {
+            addBreakPoint(pendingBreakPoints[i]);
+        }
+        pendingBreakPoints.clear();
+    }
+
     // Converts a section of the points list to a set of breakPoints.  
     // Returns the first of the intersection points occurring at finishPos.
     VertSet::iterator addSegmentsUpTo(double finishPos)
@@ -828,7 +862,7 @@ public:
                 break;
             }
             
-            breakPoints.insert(PosVertInf((*vert)->point.x, (*vert),
+            addBreakPoint(PosVertInf((*vert)->point.x, (*vert),
                         getPosVertInfDirections(*vert, XDIM)));
 
             if ((firstIntersectionPt == vertInfs.end()) && 
@@ -992,7 +1026,7 @@ public:
         {
             if ((*v)->point.x == begin)
             {
-                vertLine.breakPoints.insert(PosVertInf(pos, *v, 
+                vertLine.pendingBreakPoints.push_back(PosVertInf(pos, *v,
                         getPosVertInfDirections(*v, YDIM)));
             }
         }
@@ -1017,7 +1051,7 @@ public:
         {
             if ((*v)->point.x == finish)
             {
-                vertLine.breakPoints.insert(PosVertInf(pos, *v,
+                vertLine.pendingBreakPoints.push_back(PosVertInf(pos, *v,
                         getPosVertInfDirections(*v, YDIM)));
             }
         }
@@ -1202,6 +1236,8 @@ public:
     
     VertSet vertInfs;
     BreakpointSet breakPoints;
+    // Points to be added to breakPoints, in the order they were found.
+    std::vector<PosVertInf> pendingBreakPoints;
 private:
     // MSVC wants to generate the assignment operator and the default 
     // constructor, but fails.  Therefore we declare them private and 
@@ -1217,46 +1253,62 @@ class SegmentListWrapper
     public:
         LineSegment *insert(LineSegment segment)
         {
-            SegmentList::iterator found = _list.end();
-            for (SegmentList::iterator curr = _list.begin();
-                    curr != _list.end(); ++curr)
+            // Only segments at the same position can overlap, so just
+            // look at those, in the order they were added to the list.
+            std::pair<PosIndex::iterator, PosIndex::iterator> range = 
+                    _index.equal_range(segment.pos);
+            PosIndex::iterator found = _index.end();
+            for (PosIndex::iterator curr = range.first; 
+                    curr != range.second; ++curr)
             {
-                if (curr->overlaps(segment))
+                if (curr->second->overlaps(segment))
                 {
-                    if (found != _list.end())
+                    if (found != _index.end())
                     {
                         // This is not the first segment that overlaps,
                         // so we need to merge and then delete an existing
                         // segment.
-                        curr->mergeVertInfs(*found);
-                        _list.erase(found);
+                        curr->second->mergeVertInfs(*(found->second));
+                        _list.erase(found->second);
+                        _index.erase(found);
                         found = curr;
                     }
                     else
                     {
                         // This is the first overlapping segment, so just 
                         // merge the new segment with this one.
-                        curr->mergeVertInfs(segment);
+                        curr->second->mergeVertInfs(segment);
                         found = curr;
                     }
                 }
             }
 
-            if (found == _list.end())
+            if (found == _index.end())
             {
                 // Add this line.
                 _list.push_back(segment);
+                _index.insert(std::make_pair(segment.pos, --_list.end()));
                 return &(_list.back());
             }
 
-            return &(*found);
+            return &(*(found->second));
         }
         SegmentList& list(void)
         {
             return _list;
         }
+        void clear(void)
+        {
+            _list.clear();
+            _index.clear();
+        }
     private:
+        // Segments in the list by position, each in the same order as 
+        // in the list.
+        typedef std::multimap<double, SegmentList::iterator> PosIndex;
+
         SegmentList _list;
+        PosIndex _index;
 };
 
 
@@ -1281,9 +1333,10 @@ static void intersectSegments(Router *router, SegmentList& segments,
 
         if (vertLine.pos < horiLine.begin)
         {
-            // We've yet to reach this segment in the sweep, so ignore.
-            ++it;
-            continue;
+            // We've yet to reach this segment in the sweep.  The segments
+            // were sorted by where they begin and only segments already
+            // reached get shortened, so this is true of the rest too.
+            break;
         }
         else if (vertLine.pos == horiLine.begin)
         {
@@ -1336,14 +1389,17 @@ static void intersectSegments(Router *router, SegmentList& segments,
                 for (VertSet::iterator v = intersectionVerts.begin();
                         v != intersectionVerts.end(); ++v)
                 {
-                    vertLine.breakPoints.insert(PosVertInf(horiLine.pos, *v,
-                            getPosVertInfDirections(*v, YDIM)));
+                    vertLine.pendingBreakPoints.push_back(
+                            PosVertInf(horiLine.pos, *v,
+                                getPosVertInfDirections(*v, YDIM)));
                 }
             }
         }
         ++it;
     }
 
+    vertLine.commitPendingBreakPoints();
+
     // Split breakPoints set into visibility segments.
     size_t dimension = YDIM; // y-dimension
     vertLine.generateVisibilityEdgesFromBreakpointSet(router, dimension);
@@ -1907,7 +1963,7 @@ extern void generateStaticOrthogonalVisGraph(Router *router)
             {
                 intersectSegments(router, segments.list(), *curr);
             }
-            vertSegments.list().clear();
+            vertSegments.clear();
 
             if (i == totalEvents)
             {
@@ -2473,6 +2529,346 @@ class PotentialSegmentConstraint
 };
 
 
+// A group of overlapping segments that are nudged together, along with the
+// separation problem for their positions.
+class NudgingRegion
+{
+    public:
+        ~NudgingRegion()
+        {
+            for_each(segments.begin(), segments.end(), delete_object());
+            for_each(vs.begin(), vs.end(), delete_object());
+            for_each(cs.begin(), cs.end(), delete_object());
+        }
+
+        // Describes the separation problem exactly, so that the same
+        // problem can be recognised in a later transaction.
+        void buildProblemKey(const bool justUnifying, const double baseSepDist)
+        {
+            std::map<const Variable *, size_t> varIndexes;
+            problemKey.clear();
+            problemKey.reserve(3 + (3 * vs.size()) + (4 * cs.size()));
+            problemKey.push_back(justUnifying);
+            problemKey.push_back(baseSepDist);
+            problemKey.push_back(vs.size());
+            for (size_t i = 0; i < vs.size(); ++i)
+            {
+                varIndexes[vs[i]] = i;
+                problemKey.push_back(vs[i]->id);
+                problemKey.push_back(vs[i]->desiredPosition);
+                problemKey.push_back(vs[i]->weight);
+            }
+            for (size_t i = 0; i < cs.size(); ++i)
+            {
+                problemKey.push_back(varIndexes[cs[i]->left]);
+                problemKey.push_back(varIndexes[cs[i]->right]);
+                problemKey.push_back(cs[i]->gap);
+                problemKey.push_back(cs[i]->equality);
+            }
+        }
+
+        ShiftSegmentList segments;
+        Variables vs;
+        Constraints cs;
+        std::list<unsigned> freeIndexes;
+        std::vector<double> problemKey;
+        // The final positions of the variables, or empty if the problem
+        // could not be satisfied.
+        std::vector<double> solution;
+};
+
+
+// Solves the separation problem for a group of segments, leaving the
+// solved positions as the finalPosition of each variable.  This only
+// modifies the problem itself, so separate problems may be solved at the
+// same time.  Returns whether the problem could be satisfied.
+static bool solveNudgingProblem(Variables& vs, Constraints& cs,
+        const std::list<unsigned>& freeIndexes, const bool justUnifying,
+        const double baseSepDist)
+{
+    // If we can fit things with the desired separation distance, then
+    // we try 10 times, reducing each time by a 10th of the original amount.
+    double reductionSteps = 10.0;
+    double sepDist = baseSepDist;
+
+    std::list<PotentialSegmentConstraint> potentialConstraints;
+    if (justUnifying)
+    {
+        for (std::list<unsigned>::const_iterator curr = freeIndexes.begin();
+                curr != freeIndexes.end(); ++curr)
+        {
+            for (std::list<unsigned>::const_iterator curr2 = curr;
+                    curr2 != freeIndexes.end(); ++curr2)
+            {
+                if (curr == curr2)
+                {
+                    continue;
+                }
+                potentialConstraints.push_back(
+                        PotentialSegmentConstraint(*curr, *curr2, vs));
+            }
+        }
+    }
+#ifdef NUDGE_DEBUG
+    for (unsigned i = 0;i < vs.size(); ++i)
+    {
+        fprintf(stderr, "-vs[%d]=%f\n", i, vs[i]->desiredPosition);
+    }
+#endif
+    // Repeatedly try solving this.  There are two cases:
+    //  -  When Unifying, we greedily place as many free segments as
+    //     possible at the same positions, that way they have more
+    //     accurate nudging orders determined for them in the Nudging
+    //     stage.
+    //  -  When Nudging, if we can't fit all the segments with the
+    //     default nudging distance we try smaller separation
+    //     distances till we find a solution that is satisfied.
+    bool justAddedConstraint = false;
+    bool satisfied;
+
+    typedef std::pair<size_t, size_t> UnsatisfiedRange;
+    std::list<UnsatisfiedRange> unsatisfiedRanges;
+    do
+    {
+        IncSolver f(vs, cs);
+        f.solve();
+
+        // Determine if the problem was satisfied.
+        satisfied = true;
+        for (size_t i = 0; i < vs.size(); ++i)
+        {
+            // For each variable...
+            if (vs[i]->id >= fixedSegmentID)
+            {
+                // If it is a fixed segment (should stay still)...
+                if (fabs(vs[i]->finalPosition -
+                        vs[i]->desiredPosition) > 0.0001)
+                {
+                    // and it is not at it's desired position, then
+                    // we consider the problem to be unsatisfied.
+                    satisfied = false;
+
+                    // We record ranges of unsatisfied variables based on
+                    // the channel edges.
+                    if (vs[i]->id == channelLeftID)
+                    {
+                        // This is the left-hand-side of a channel.
+                        if (unsatisfiedRanges.empty() ||
+                                (unsatisfiedRanges.back().first !=
+                                unsatisfiedRanges.back().second))
+                        {
+                            // There are no existing unsatisfied ranges,
+                            // or there are but they are a valid range
+                            // (we've encountered the right-hand channel
+                            // edges already).
+                            // So, start a new unsatisfied range.
+                            unsatisfiedRanges.push_back(
+                                    std::make_pair(i, i));
+                        }
+                    }
+                    else if (vs[i]->id == channelRightID)
+                    {
+                        // This is the right-hand-side of a channel.
+                        COLA_ASSERT(unsatisfiedRanges.size() > 0);
+                        // Expand the existing range to include it.
+                        unsatisfiedRanges.back().second = i;
+                    }
+                    else if (vs[i]->id == fixedSegmentID)
+                    {
+                        // Fixed connector segments can also start and
+                        // extend unsatisfied variable ranges.
+                        if (unsatisfiedRanges.empty())
+                        {
+                            // There are no existing unsatisfied ranges,
+                            // so start a new unsatisfied range.
+                            unsatisfiedRanges.push_back(
+                                    std::make_pair(i, i));
+                        }
+                        else
+                        {
+                            // Expand the existing range to include index.
+                            unsatisfiedRanges.back().second = i;
+                        }
+                    }
+                }
+            }
+        }
+
+#ifdef NUDGE_DEBUG
+        if (!satisfied)
+        {
+            fprintf(stderr,"unsatisfied\n");
+        }
+#endif
+
+        if (justUnifying)
+        {
+            // When we're centring, we'd like to greedily place as many
+            // segments as possible at the same positions, that way they
+            // have more accurate nudging orders determined for them.
+            //
+            // We do this by taking pairs of adjoining free segments and
+            // attempting to constrain them to have the same position,
+            // starting from the closest up to the furthest.
+
+            if (justAddedConstraint)
+            {
+                COLA_ASSERT(potentialConstraints.size() > 0);
+                if (!satisfied)
+                {
+                    // We couldn't satisfy the problem with the added
+                    // potential constraint, so we can't position these
+                    // segments together.  Roll back.
+                    potentialConstraints.pop_front();
+                    delete cs.back();
+                    cs.pop_back();
+                }
+                else
+                {
+                    // We could position these two segments together.
+                    PotentialSegmentConstraint& pc =
+                            potentialConstraints.front();
+
+                    // Rewrite the indexes of these two variables to
+                    // one, so we need not worry about redundant
+                    // equality constraints.
+                    for (std::list<PotentialSegmentConstraint>::iterator
+                            it = potentialConstraints.begin();
+                            it != potentialConstraints.end(); ++it)
+                    {
+                        it->rewriteIndex(pc.index1, pc.index2);
+                    }
+                    potentialConstraints.pop_front();
+                }
+            }
+            potentialConstraints.sort();
+            justAddedConstraint = false;
+
+            // Remove now invalid potential segment constraints.
+            // This could have been caused by the variable rewriting.
+            while (!potentialConstraints.empty() &&
+                   !potentialConstraints.front().stillValid())
+            {
+                potentialConstraints.pop_front();
+            }
+
+            if (!potentialConstraints.empty())
+            {
+                // We still have more possibilities to consider.
+                // Create a constraint for this, add it, and mark as
+                // unsatisfied, so the problem gets re-solved.
+                PotentialSegmentConstraint& pc =
+                        potentialConstraints.front();
+                COLA_ASSERT(pc.index1 != pc.index2);
+                cs.push_back(new Constraint(vs[pc.index1], vs[pc.index2],
+                        0, true));
+                satisfied = false;
+                justAddedConstraint = true;
+            }
+        }
+        else
+        {
+            if (!satisfied)
+            {
+                COLA_ASSERT(unsatisfiedRanges.size() > 0);
+                // Reduce the separation distance.
+                sepDist -= (baseSepDist / reductionSteps);
+#ifdef NUDGE_DEBUG
+                for (std::list<UnsatisfiedRange>::iterator it =
+                        unsatisfiedRanges.begin();
+                        it != unsatisfiedRanges.end(); ++it)
+                {
+                    fprintf(stderr, "unsatisfiedVarRange(%ld, %ld)\n",
+                            it->first, it->second);
+                }
+                fprintf(stderr, "unsatisfied, trying %g\n", sepDist);
+#endif
+                // And rewrite all the gap constraints to have the new
+                // reduced separation distance.
+                bool withinUnsatisfiedGroup = false;
+                for (Constraints::iterator cIt = cs.begin();
+                        cIt != cs.end(); ++cIt)
+                {
+                    UnsatisfiedRange& range = unsatisfiedRanges.front();
+                    Constraint *constraint = *cIt;
+
+                    if (constraint->left == vs[range.first])
+                    {
+                        // Entered an unsatisfied range of variables.
+                        withinUnsatisfiedGroup = true;
+                    }
+
+                    if (withinUnsatisfiedGroup && (constraint->gap > 0))
+                    {
+                        // Rewrite constraints in unsatisfied ranges
+                        // that have a non-zero gap.
+                        constraint->gap = sepDist;
+                    }
+
+                    if (constraint->right == vs[range.second])
+                    {
+                        // Left an unsatisfied range of variables.
+                        withinUnsatisfiedGroup = false;
+                        unsatisfiedRanges.pop_front();
+                        if (unsatisfiedRanges.empty())
+                        {
+                            // And there are no more unsatisfied variables.
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    while (!satisfied && (sepDist > 0.0001));
+
+    return satisfied;
+}
+
+
+// Solves the separation problems for the given groups of segments, using
+// the given number of threads.  Each thread repeatedly takes the next
+// problem from the list.
+static void solveNudgingRegionsConcurrently(
+        const std::vector<NudgingRegion *>& regions, const bool justUnifying,
+        const double baseSepDist, unsigned int threads)
+{
+    threads = std::min(threads, (unsigned int) regions.size());
+
+    std::atomic<size_t> next(0);
+    std::function<void (void)> solve = 
+            [&regions, &next, justUnifying, baseSepDist]()
+    {
+        for (size_t i = next++; i < regions.size(); i = next++)
+        {
+            NudgingRegion *region = regions[i];
+            Variables& vs = region->vs;
+            bool satisfied = solveNudgingProblem(vs, region->cs, 
+                    region->freeIndexes, justUnifying, baseSepDist);
+            region->solution.clear();
+            if (satisfied)
+            {
+                for (size_t j = 0; j < vs.size(); ++j)
+                {
+                    region->solution.push_back(vs[j]->finalPosition);
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned int t = 1; t < threads; ++t)
+    {
+        workers.push_back(std::thread(solve));
+    }
+    solve();
+    for (size_t t = 0; t < workers.size(); ++t)
+    {
+        workers[t].join();
+    }
+}
+
+
 class ImproveOrthogonalRoutes
 {
 public:
@@ -2501,6 +2897,8 @@ void ImproveOrthogonalRoutes::execute(void)
 {
     TIMER_START(m_router, tmOrthogNudge);
 
+    m_router->m_nudging_solutions.startTransaction();
+
     m_shared_path_connectors_with_common_endpoints.clear();
 
     // Simplify routes.
@@ -2570,13 +2968,12 @@ void ImproveOrthogonalRoutes::nudgeOrthogonalRoutes(size_t dimension,
             nudgeSharedPathsWithCommonEndPoint);
     double baseSepDist = m_router->routingParameter(idealNudgingDistance);
     COLA_ASSERT(baseSepDist >= 0);
-    // If we can fit things with the desired separation distance, then
-    // we try 10 times, reducing each time by a 10th of the original amount.
-    double reductionSteps = 10.0;
 
     unsigned int totalSegmentsToShift = m_segment_list.size();
     unsigned int numOfSegmentsShifted = 0;
-    // Do the actual nudging.
+    // Divide the segments into groups of overlapping segments, each with
+    // its own separation problem.
+    std::vector<NudgingRegion *> regions;
     ShiftSegmentList currentRegion;
     while (!m_segment_list.empty())
     {
@@ -2638,10 +3035,13 @@ void ImproveOrthogonalRoutes::nudgeOrthogonalRoutes(size_t dimension,
             }
         }
 
-        // Process these segments.
-        std::list<unsigned> freeIndexes;
-        Variables vs;
-        Constraints cs;
+        // Set up the separation problem for these segments.
+        NudgingRegion *region = new NudgingRegion();
+        region->segments = currentRegion;
+        regions.push_back(region);
+        std::list<unsigned>& freeIndexes = region->freeIndexes;
+        Variables& vs = region->vs;
+        Constraints& cs = region->cs;
         Constraints gapcs;
         ShiftSegmentPtrList prevVars;
         double sepDist = baseSepDist;
@@ -2797,244 +3197,57 @@ void ImproveOrthogonalRoutes::nudgeOrthogonalRoutes(size_t dimension,
             prevVars.push_back(&(*currSegment));
         }
 
-        std::list<PotentialSegmentConstraint> potentialConstraints;
-        if (justUnifying)
+    }
+
+    // Reuse the solutions of any problems that were solved in the previous
+    // transaction, and solve the rest.
+    std::vector<NudgingRegion *> unsolvedRegions;
+    for (size_t i = 0; i < regions.size(); ++i)
+    {
+        NudgingRegion *region = regions[i];
+        region->buildProblemKey(justUnifying, baseSepDist);
+        const std::vector<double> *solution = 
+                m_router->m_nudging_solutions.find(region->problemKey);
+        if (solution)
         {
-            for (std::list<unsigned>::iterator curr = freeIndexes.begin();
-                    curr != freeIndexes.end(); ++curr)
-            {
-                for (std::list<unsigned>::iterator curr2 = curr;
-                        curr2 != freeIndexes.end(); ++curr2)
-                {
-                    if (curr == curr2)
-                    {
-                        continue;
-                    }
-                    potentialConstraints.push_back(
-                            PotentialSegmentConstraint(*curr, *curr2, vs));
-                }
-            }
+            region->solution = *solution;
         }
-#ifdef NUDGE_DEBUG
-        for (unsigned i = 0;i < vs.size(); ++i)
+        else
         {
-            fprintf(stderr, "-vs[%d]=%f\n", i, vs[i]->desiredPosition);
+            unsolvedRegions.push_back(region);
         }
-#endif
-        // Repeatedly try solving this.  There are two cases:
-        //  -  When Unifying, we greedily place as many free segments as
-        //     possible at the same positions, that way they have more
-        //     accurate nudging orders determined for them in the Nudging
-        //     stage.
-        //  -  When Nudging, if we can't fit all the segments with the
-        //     default nudging distance we try smaller separation
-        //     distances till we find a solution that is satisfied.
-        bool justAddedConstraint = false;
-        bool satisfied;
-
-        typedef std::pair<size_t, size_t> UnsatisfiedRange;
-        std::list<UnsatisfiedRange> unsatisfiedRanges;
-        do
-        {
-            IncSolver f(vs, cs);
-            f.solve();
-
-            // Determine if the problem was satisfied.
-            satisfied = true;
-            for (size_t i = 0; i < vs.size(); ++i)
-            {
-                // For each variable...
-                if (vs[i]->id >= fixedSegmentID)
-                {
-                    // If it is a fixed segment (should stay still)...
-                    if (fabs(vs[i]->finalPosition -
-                            vs[i]->desiredPosition) > 0.0001)
-                    {
-                        // and it is not at it's desired position, then
-                        // we consider the problem to be unsatisfied.
-                        satisfied = false;
-
-                        // We record ranges of unsatisfied variables based on
-                        // the channel edges.
-                        if (vs[i]->id == channelLeftID)
-                        {
-                            // This is the left-hand-side of a channel.
-                            if (unsatisfiedRanges.empty() ||
-                                    (unsatisfiedRanges.back().first !=
-                                    unsatisfiedRanges.back().second))
-                            {
-                                // There are no existing unsatisfied ranges,
-                                // or there are but they are a valid range
-                                // (we've encountered the right-hand channel
-                                // edges already).
-                                // So, start a new unsatisfied range.
-                                unsatisfiedRanges.push_back(
-                                        std::make_pair(i, i));
-                            }
-                        }
-                        else if (vs[i]->id == channelRightID)
-                        {
-                            // This is the right-hand-side of a channel.
-                            COLA_ASSERT(unsatisfiedRanges.size() > 0);
-                            // Expand the existing range to include it.
-                            unsatisfiedRanges.back().second = i;
-                        }
-                        else if (vs[i]->id == fixedSegmentID)
-                        {
-                            // Fixed connector segments can also start and
-                            // extend unsatisfied variable ranges.
-                            if (unsatisfiedRanges.empty())
-                            {
-                                // There are no existing unsatisfied ranges,
-                                // so start a new unsatisfied range.
-                                unsatisfiedRanges.push_back(
-                                        std::make_pair(i, i));
-                            }
-                            else
-                            {
-                                // Expand the existing range to include index.
-                                unsatisfiedRanges.back().second = i;
-                            }
-                        }
-                    }
-                }
-            }
-
-#ifdef NUDGE_DEBUG
-            if (!satisfied)
-            {
-                fprintf(stderr,"unsatisfied\n");
-            }
-#endif
-
-            if (justUnifying)
-            {
-                // When we're centring, we'd like to greedily place as many
-                // segments as possible at the same positions, that way they
-                // have more accurate nudging orders determined for them.
-                //
-                // We do this by taking pairs of adjoining free segments and
-                // attempting to constrain them to have the same position,
-                // starting from the closest up to the furthest.
+    }
 
-                if (justAddedConstraint)
-                {
-                    COLA_ASSERT(potentialConstraints.size() > 0);
-                    if (!satisfied)
-                    {
-                        // We couldn't satisfy the problem with the added
-                        // potential constraint, so we can't position these
-                        // segments together.  Roll back.
-                        potentialConstraints.pop_front();
-                        delete cs.back();
-                        cs.pop_back();
-                    }
-                    else
-                    {
-                        // We could position these two segments together.
-                        PotentialSegmentConstraint& pc =
-                                potentialConstraints.front();
-
-                        // Rewrite the indexes of these two variables to
-                        // one, so we need not worry about redundant
-                        // equality constraints.
-                        for (std::list<PotentialSegmentConstraint>::iterator
-                                it = potentialConstraints.begin();
-                                it != potentialConstraints.end(); ++it)
-                        {
-                            it->rewriteIndex(pc.index1, pc.index2);
-                        }
-                        potentialConstraints.pop_front();
-                    }
-                }
-                potentialConstraints.sort();
-                justAddedConstraint = false;
+    unsigned int threads = m_router->routingThreadCount();
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    solveNudgingRegionsConcurrently(unsolvedRegions, justUnifying, 
+            baseSepDist, threads);
 
-                // Remove now invalid potential segment constraints.
-                // This could have been caused by the variable rewriting.
-                while (!potentialConstraints.empty() &&
-                       !potentialConstraints.front().stillValid())
-                {
-                    potentialConstraints.pop_front();
-                }
+    for (size_t i = 0; i < unsolvedRegions.size(); ++i)
+    {
+        m_router->m_nudging_solutions.insert(unsolvedRegions[i]->problemKey, 
+                unsolvedRegions[i]->solution);
+    }
 
-                if (!potentialConstraints.empty())
-                {
-                    // We still have more possibilities to consider.
-                    // Create a constraint for this, add it, and mark as
-                    // unsatisfied, so the problem gets re-solved.
-                    PotentialSegmentConstraint& pc =
-                            potentialConstraints.front();
-                    COLA_ASSERT(pc.index1 != pc.index2);
-                    cs.push_back(new Constraint(vs[pc.index1], vs[pc.index2],
-                            0, true));
-                    satisfied = false;
-                    justAddedConstraint = true;
-                }
-            }
-            else
+    // Move the segments to their new positions, in the order the groups
+    // were found.
+    for (size_t i = 0; i < regions.size(); ++i)
+    {
+        NudgingRegion *region = regions[i];
+        Variables& vs = region->vs;
+        if (!region->solution.empty())
+        {
+            COLA_ASSERT(region->solution.size() == vs.size());
+            for (size_t j = 0; j < vs.size(); ++j)
             {
-                if (!satisfied)
-                {
-                    COLA_ASSERT(unsatisfiedRanges.size() > 0);
-                    // Reduce the separation distance.
-                    sepDist -= (baseSepDist / reductionSteps);
-#ifdef NUDGE_DEBUG
-                    for (std::list<UnsatisfiedRange>::iterator it =
-                            unsatisfiedRanges.begin();
-                            it != unsatisfiedRanges.end(); ++it)
-                    {
-                        fprintf(stderr, "unsatisfiedVarRange(%ld, %ld)\n",
-                                it->first, it->second);
-                    }
-                    fprintf(stderr, "unsatisfied, trying %g\n", sepDist);
-#endif
-                    // And rewrite all the gap constraints to have the new
-                    // reduced separation distance.
-                    bool withinUnsatisfiedGroup = false;
-                    for (Constraints::iterator cIt = cs.begin();
-                            cIt != cs.end(); ++cIt)
-                    {
-                        UnsatisfiedRange& range = unsatisfiedRanges.front();
-                        Constraint *constraint = *cIt;
-
-                        if (constraint->left == vs[range.first])
-                        {
-                            // Entered an unsatisfied range of variables.
-                            withinUnsatisfiedGroup = true;
-                        }
-
-                        if (withinUnsatisfiedGroup && (constraint->gap > 0))
-                        {
-                            // Rewrite constraints in unsatisfied ranges
-                            // that have a non-zero gap.
-                            constraint->gap = sepDist;
-                        }
-
-                        if (constraint->right == vs[range.second])
-                        {
-                            // Left an unsatisfied range of variables.
-                            withinUnsatisfiedGroup = false;
-                            unsatisfiedRanges.pop_front();
-                            if (unsatisfiedRanges.empty())
-                            {
-                                // And there are no more unsatisfied variables.
-                                break;
-                            }
-                        }
-                    }
-                }
+                vs[j]->finalPosition = region->solution[j];
             }
-        }
-        while (!satisfied && (sepDist > 0.0001));
-
-        if (satisfied)
-        {
-#ifdef NUDGE_DEBUG
-            fprintf(stderr,"satisfied at nudgeDist = %g\n", sepDist);
-#endif
-            for (ShiftSegmentList::iterator currSegment = currentRegion.begin();
-                    currSegment != currentRegion.end(); ++currSegment)
+            for (ShiftSegmentList::iterator currSegment = 
+                    region->segments.begin(); 
+                    currSegment != region->segments.end(); ++currSegment)
             {
                 NudgingShiftSegment *segment =
                         static_cast<NudgingShiftSegment *> (*currSegment);
@@ -3048,8 +3261,8 @@ void ImproveOrthogonalRoutes::nudgeOrthogonalRoutes(size_t dimension,
         }
 #endif
 #ifdef NUDGE_DEBUG_SVG
-        for (ShiftSegmentList::iterator currSegment = currentRegion.begin();
-                currSegment != currentRegion.end(); ++currSegment)
+        for (ShiftSegmentList::iterator currSegment = region->segments.begin();
+                currSegment != region->segments.end(); ++currSegment)
         {
             NudgingShiftSegment *segment =
                     static_cast<NudgingShiftSegment *> (*currSegment);
@@ -3060,9 +3273,7 @@ void ImproveOrthogonalRoutes::nudgeOrthogonalRoutes(size_t dimension,
                     segment->highPoint()[XDIM], segment->variable->finalPosition);
         }
 #endif
-        for_each(currentRegion.begin(), currentRegion.end(), delete_object());
-        for_each(vs.begin(), vs.end(), delete_object());
-        for_each(cs.begin(), cs.end(), delete_object());
+        delete region;
     }
 }
 
@@ -3194,4 +3405,38 @@ extern void improveOrthogonalRoutes(Router *router)
 }
 
 
+void NudgingSolutionCache::startTransaction(void)
+{
+    m_previous.clear();
+    m_previous.swap(m_current);
+}
+
+
+const std::vector<double> *NudgingSolutionCache::find(
+        const std::vector<double>& problem)
+{
+    SolutionMap::iterator found = m_current.find(problem);
+    if (found != m_current.end())
+    {
+        return &(found->second);
+    }
+
+    found = m_previous.find(problem);
+    if (found != m_previous.end())
+    {
+        // Keep this solution for the next transaction.
+        found = m_current.insert(*found).first;
+        return &(found->second);
+    }
+    return NULL;
+}
+
+
+void NudgingSolutionCache::insert(const std::vector<double>& problem,
+        const std::vector<double>& solution)
+{
+    m_current[problem] = solution;
+}
+
+
 }
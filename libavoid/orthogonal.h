@@ -26,6 +26,9 @@
 #ifndef AVOID_ORTHOGONAL_H
 #define AVOID_ORTHOGONAL_H
 
+#include <map>
+#include <vector>
+
 namespace Avoid {
 
 class Router;
@@ -34,6 +37,35 @@ extern void generateStaticOrthogonalVisGraph(Router *router);
 extern void improveOrthogonalRoutes(Router *router);
 
 
+// The solutions of the separation problems solved while nudging orthogonal
+// routes, kept between transactions.  Most of these problems are unchanged
+// by an edit to the diagram, so their solutions can be reused rather than
+// solved again.  Problems are compared exactly, so a reused solution is
+// the one that solving the problem would produce.
+//
+class NudgingSolutionCache
+{
+    public:
+        // Called at the start of each transaction.  Solutions that were
+        // not used during the previous transaction are discarded.
+        void startTransaction(void);
+
+        // Returns the solution for the given problem, or NULL if it has
+        // not been solved recently.
+        const std::vector<double> *find(const std::vector<double>& problem);
+
+        void insert(const std::vector<double>& problem,
+                const std::vector<double>& solution);
+
+    private:
+        typedef std::map<std::vector<double>, std::vector<double> > 
+                SolutionMap;
+
+        SolutionMap m_current;
+        SolutionMap m_previous;
+};
+
+
 }
 
 #endif
@@ -0,0 +1,318 @@
+/*
+ * vim: ts=4 sw=4 et tw=0 wm=0
+ *
+ * libavoid - Fast, Incremental, Object-avoiding Line Router
+ *
+ * Copyright (C) 2014  Monash University
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * See the file LICENSE.LGPL distributed with the library.
+ *
+ * Licensees holding a valid commercial license may use this file in
+ * accordance with the commercial license agreement provided with the
+ * library.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+*/
+
+#include <algorithm>
+#include <cmath>
+
+#include "libavoid/routeindex.h"
+#include "libavoid/gridcells.h"
+#include "libavoid/assertions.h"
+
+
+namespace Avoid {
+
+// Segments covering more cells than this are not stored in the grid.  This
+// can happen for long diagonal segments of polyline routes.
+static const size_t maxCellsPerRoute = 1024;
+
+static Box segmentBox(const Point& a, const Point& b)
+{
+    Box box;
+    box.min.x = std::min(a.x, b.x);
+    box.min.y = std::min(a.y, b.y);
+    box.max.x = std::max(a.x, b.x);
+    box.max.y = std::max(a.y, b.y);
+    return box;
+}
+
+
+RouteIndex::RouteIndex()
+    : m_cell_size(0),
+      m_extent_sum(0),
+      m_segment_count(0)
+{
+}
+
+
+void RouteIndex::addExtents(const Entry& entry, const double sign)
+{
+    for (size_t i = 1; i < entry.points.size(); ++i)
+    {
+        Box box = segmentBox(entry.points[i - 1], entry.points[i]);
+        m_extent_sum += sign * std::max(box.width(), box.height());
+        m_segment_count += sign;
+    }
+}
+
+
+void RouteIndex::beginUpdate(void)
+{
+    for (EntryMap::iterator it = m_entries.begin(); it != m_entries.end();
+            ++it)
+    {
+        it->second.seen = false;
+    }
+}
+
+
+void RouteIndex::setRoute(const unsigned int id, const Polygon& route)
+{
+    EntryMap::iterator it = m_entries.find(id);
+    if (route.size() < 2)
+    {
+        // Leave it unseen so that endUpdate() removes any previous route.
+        return;
+    }
+
+    if (it != m_entries.end())
+    {
+        Entry& entry = it->second;
+        entry.seen = true;
+
+        bool unchanged = (entry.points.size() == route.size());
+        for (size_t i = 0; unchanged && (i < route.size()); ++i)
+        {
+            unchanged = (entry.points[i].x == route.ps[i].x) &&
+                    (entry.points[i].y == route.ps[i].y);
+        }
+        if (unchanged)
+        {
+            return;
+        }
+
+        if (entry.indexed)
+        {
+            unindexEntry(id, entry);
+        }
+        addExtents(entry, -1);
+    }
+    else
+    {
+        it = m_entries.insert(std::make_pair(id, Entry())).first;
+    }
+
+    Entry& entry = it->second;
+    entry.points = route.ps;
+    entry.bbox = segmentBox(route.ps[0], route.ps[0]);
+    for (size_t i = 1; i < route.size(); ++i)
+    {
+        Box box = segmentBox(route.ps[i - 1], route.ps[i]);
+        entry.bbox.min.x = std::min(entry.bbox.min.x, box.min.x);
+        entry.bbox.min.y = std::min(entry.bbox.min.y, box.min.y);
+        entry.bbox.max.x = std::max(entry.bbox.max.x, box.max.x);
+        entry.bbox.max.y = std::max(entry.bbox.max.y, box.max.y);
+    }
+    entry.large = false;
+    entry.indexed = false;
+    entry.seen = true;
+    addExtents(entry, 1);
+}
+
+
+void RouteIndex::endUpdate(void)
+{
+    // Remove routes that were not set during this update.
+    EntryMap::iterator it = m_entries.begin();
+    while (it != m_entries.end())
+    {
+        if (!it->second.seen)
+        {
+            if (it->second.indexed)
+            {
+                unindexEntry(it->first, it->second);
+            }
+            addExtents(it->second, -1);
+            it = m_entries.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    if (m_entries.empty())
+    {
+        m_cell_size = 0;
+        m_extent_sum = 0;
+        m_segment_count = 0;
+        return;
+    }
+
+    // Choose a new cell size if the routes have changed scale.
+    double meanExtent = (m_segment_count > 0) ?
+            (m_extent_sum / m_segment_count) : 0;
+    double cellSize = gridCellSize(meanExtent);
+    if (gridCellSizeChanged(m_cell_size, cellSize))
+    {
+        m_cell_size = cellSize;
+        m_cells.clear();
+        m_large.clear();
+        for (it = m_entries.begin(); it != m_entries.end(); ++it)
+        {
+            it->second.cells.clear();
+            it->second.indexed = false;
+        }
+    }
+
+    for (it = m_entries.begin(); it != m_entries.end(); ++it)
+    {
+        if (!it->second.indexed)
+        {
+            indexEntry(it->first, it->second);
+        }
+    }
+}
+
+
+void RouteIndex::indexEntry(const unsigned int id, Entry& entry)
+{
+    COLA_ASSERT(!entry.indexed);
+    entry.cells.clear();
+    entry.large = false;
+    for (size_t i = 1; i < entry.points.size(); ++i)
+    {
+        Box box = segmentBox(entry.points[i - 1], entry.points[i]);
+        long long x0 = gridCellCoord(box.min.x, m_cell_size);
+        long long x1 = gridCellCoord(box.max.x, m_cell_size);
+        long long y0 = gridCellCoord(box.min.y, m_cell_size);
+        long long y1 = gridCellCoord(box.max.y, m_cell_size);
+        if ((x1 - x0 + 1) * (y1 - y0 + 1) +
+                (long long) entry.cells.size() > (long long) maxCellsPerRoute)
+        {
+            entry.large = true;
+            entry.cells.clear();
+            break;
+        }
+        for (long long cx = x0; cx <= x1; ++cx)
+        {
+            for (long long cy = y0; cy <= y1; ++cy)
+            {
+                entry.cells.push_back(gridCellKey(cx, cy));
+            }
+        }
+    }
+
+    if (entry.large)
+    {
+        m_large.push_back(id);
+    }
+    else
+    {
+        std::sort(entry.cells.begin(), entry.cells.end());
+        entry.cells.erase(std::unique(entry.cells.begin(), entry.cells.end()),
+                entry.cells.end());
+        for (size_t i = 0; i < entry.cells.size(); ++i)
+        {
+            m_cells[entry.cells[i]].push_back(id);
+        }
+    }
+    entry.indexed = true;
+}
+
+
+void RouteIndex::unindexEntry(const unsigned int id, Entry& entry)
+{
+    COLA_ASSERT(entry.indexed);
+    if (entry.large)
+    {
+        m_large.erase(std::find(m_large.begin(), m_large.end(), id));
+    }
+    for (size_t i = 0; i < entry.cells.size(); ++i)
+    {
+        CellMap::iterator cell = m_cells.find(entry.cells[i]);
+        COLA_ASSERT(cell != m_cells.end());
+        std::vector<unsigned int>& ids = cell->second;
+        ids.erase(std::find(ids.begin(), ids.end(), id));
+        if (ids.empty())
+        {
+            m_cells.erase(cell);
+        }
+    }
+    entry.cells.clear();
+    entry.indexed = false;
+}
+
+
+bool RouteIndex::contains(const unsigned int id) const
+{
+    return m_entries.find(id) != m_entries.end();
+}
+
+
+void RouteIndex::candidates(const unsigned int id,
+        std::vector<unsigned int>& result) const
+{
+    result.clear();
+    EntryMap::const_iterator it = m_entries.find(id);
+    if (it == m_entries.end())
+    {
+        return;
+    }
+    const Entry& entry = it->second;
+    COLA_ASSERT(entry.indexed);
+
+    if (entry.large)
+    {
+        // Check against every other route.
+        for (EntryMap::const_iterator other = m_entries.begin();
+                other != m_entries.end(); ++other)
+        {
+            if ((other->first != id) &&
+                    gridBoxesOverlap(entry.bbox, other->second.bbox))
+            {
+                result.push_back(other->first);
+            }
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < entry.cells.size(); ++i)
+        {
+            CellMap::const_iterator cell = m_cells.find(entry.cells[i]);
+            COLA_ASSERT(cell != m_cells.end());
+            result.insert(result.end(), cell->second.begin(),
+                    cell->second.end());
+        }
+        result.insert(result.end(), m_large.begin(), m_large.end());
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+
+        size_t kept = 0;
+        for (size_t i = 0; i < result.size(); ++i)
+        {
+            unsigned int otherId = result[i];
+            if ((otherId != id) && gridBoxesOverlap(entry.bbox,
+                        m_entries.find(otherId)->second.bbox))
+            {
+                result[kept++] = otherId;
+            }
+        }
+        result.resize(kept);
+        return;
+    }
+    std::sort(result.begin(), result.end());
+}
+
+
+}
+
@@ -0,0 +1,112 @@
+/*
+ * vim: ts=4 sw=4 et tw=0 wm=0
+ *
+ * libavoid - Fast, Incremental, Object-avoiding Line Router
+ *
+ * Copyright (C) 2014  Monash University
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * See the file LICENSE.LGPL distributed with the library.
+ *
+ * Licensees holding a valid commercial license may use this file in
+ * accordance with the commercial license agreement provided with the
+ * library.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+*/
+
+//! @file    routeindex.h
+//! @brief   Contains the interface for the RouteIndex class.
+
+
+#ifndef AVOID_ROUTEINDEX_H
+#define AVOID_ROUTEINDEX_H
+
+#include <vector>
+#include <unordered_map>
+
+#include "libavoid/geomtypes.h"
+#include "libavoid/gridcells.h"
+#include "libavoid/dllexport.h"
+
+
+namespace Avoid {
+
+//! @brief   A spatial index over the segments of a set of routes, used to
+//!          find the pairs of routes that may cross, touch or share paths.
+//!
+//! Segments are stored in a uniform grid by their bounding boxes.  Two
+//! routes are only reported as candidates for each other if they have
+//! segments in a common cell and their bounding boxes overlap, so routes
+//! that are never reported can not have any point in common.
+//!
+//! The index is updated incrementally: between beginUpdate() and
+//! endUpdate() the caller passes the current route of every object, and
+//! only routes that have changed since the last update are reindexed.
+//!
+class AVOID_EXPORT RouteIndex
+{
+    public:
+        RouteIndex();
+
+        //! @brief  Starts an update of the index.  Routes not passed to
+        //!         setRoute() before endUpdate() are removed.
+        void beginUpdate(void);
+
+        //! @brief  Sets the route for the object with the given id.
+        //!
+        //! Routes with fewer than two points are ignored.
+        //!
+        void setRoute(const unsigned int id, const Polygon& route);
+
+        //! @brief  Finishes an update, reindexing any changed routes.
+        void endUpdate(void);
+
+        //! @brief  Returns, in ascending order, the ids of the other
+        //!         routes in the index that may intersect the route for
+        //!         the given id.
+        void candidates(const unsigned int id,
+                std::vector<unsigned int>& result) const;
+
+        //! @brief  Returns whether there is a route for the given id.
+        bool contains(const unsigned int id) const;
+
+    private:
+        struct Entry
+        {
+            std::vector<Point> points;
+            Box bbox;
+            std::vector<GridCellKey> cells;
+            bool large;
+            bool indexed;
+            bool seen;
+        };
+        typedef std::unordered_map<unsigned int, Entry> EntryMap;
+        typedef std::unordered_map<GridCellKey, std::vector<unsigned int> >
+                CellMap;
+
+        void indexEntry(const unsigned int id, Entry& entry);
+        void unindexEntry(const unsigned int id, Entry& entry);
+        void addExtents(const Entry& entry, const double sign);
+
+        EntryMap m_entries;
+        CellMap m_cells;
+        // Routes with segments covering too many cells, checked against
+        // every route instead.
+        std::vector<unsigned int> m_large;
+        double m_cell_size;
+        // Sum and number of segment extents, used to choose m_cell_size.
+        double m_extent_sum;
+        double m_segment_count;
+};
+
+
+}
+
+#endif
@@ -26,6 +26,10 @@
 #include <algorithm>
 #include <cmath>
 #include <cfloat>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
 
 #include "libavoid/shape.h"
 #include "libavoid/router.h"
@@ -38,6 +42,7 @@
 #include "libavoid/orthogonal.h"
 #include "libavoid/assertions.h"
 #include "libavoid/connectionpin.h"
+#include "libavoid/makepath.h"
 
 
 namespace Avoid {
@@ -61,6 +66,7 @@ Router::Router(const unsigned int flags)
       m_largest_assigned_id(0),
       m_consolidate_actions(true),
       m_currently_calling_destructors(false),
+      m_routing_threads(1),
       m_topology_addon(new TopologyAddonInterface()),
       // Mode options:
       m_allows_polyline_routing(false),
@@ -97,6 +103,7 @@ Router::Router(const unsigned int flags)
     m_routing_options[improveHyperedgeRoutesMovingAddingAndDeletingJunctions] =
             false;
     m_routing_options[nudgeSharedPathsWithCommonEndPoint] = true;
+    m_routing_options[searchOrthogonalRoutesInLocalRegion] = false;
 
     m_hyperedge_improver.setRouter(this);
     m_hyperedge_rerouter.setRouter(this);
@@ -416,10 +423,59 @@ void Router::destroyOrthogonalVisGraph(void)
 }
 
 
+// Records the input to generateStaticOrthogonalVisGraph(): the routing 
+// boxes of obstacles and the positions and visibility directions of
+// connection points, in the order that function considers them.
+void Router::staticBuiltGraphInputs(std::vector<double>& inputs)
+{
+    inputs.clear();
+    for (ObstacleList::const_iterator obstacleIt = m_obstacles.begin();
+            obstacleIt != m_obstacles.end(); ++obstacleIt)
+    {
+        JunctionRef *junction = dynamic_cast<JunctionRef *> (*obstacleIt);
+        if (junction && ! junction->positionFixed())
+        {
+            // Junctions that are free to move are not treated as obstacles.
+            continue;
+        }
+        Box bbox = (*obstacleIt)->routingBox();
+        inputs.push_back(bbox.min.x);
+        inputs.push_back(bbox.min.y);
+        inputs.push_back(bbox.max.x);
+        inputs.push_back(bbox.max.y);
+    }
+    // Separates the obstacles from the connection points.
+    inputs.push_back(-DBL_MAX);
+    for (VertInf *curr = vertices.connsBegin(); 
+            curr && (curr != vertices.shapesBegin()); curr = curr->lstNext)
+    {
+        if (curr->visDirections == ConnDirNone)
+        {
+            continue;
+        }
+        inputs.push_back(curr->point.x);
+        inputs.push_back(curr->point.y);
+        inputs.push_back(curr->visDirections);
+    }
+}
+
+
 void Router::regenerateStaticBuiltGraph(void)
 {
     // Here we do talks involved in updating the static-built visibility 
     // graph (if necessary) before we do any routing.
+    if (m_allows_orthogonal_routing && !m_static_orthogonal_graph_invalidated)
+    {
+        // The graph only needs regenerating if obstacles or connection 
+        // points with visibility have been added, removed or moved.  
+        // Edges are only removed from it by removing them from connection
+        // points, which invalidates it.
+        std::vector<double> inputs;
+        staticBuiltGraphInputs(inputs);
+        m_static_orthogonal_graph_invalidated = 
+                (inputs != m_static_orthogonal_graph_inputs);
+    }
+
     if (m_static_orthogonal_graph_invalidated)
     {
         if (m_allows_orthogonal_routing)
@@ -427,13 +483,40 @@ void Router::regenerateStaticBuiltGraph(void)
             destroyOrthogonalVisGraph();
 
             TIMER_START(this, tmOrthogGraph);
+            m_transaction_metrics.startPhase(
+                    TransactionPhaseOrthogonalVisibilityGraphScanX);
             // Regenerate a new visibility graph.
             generateStaticOrthogonalVisGraph(this);
             
+            m_transaction_metrics.startPhase(0);
+            m_transaction_metrics.orthogonalGraphRegenerated = true;
             TIMER_STOP(this);
+
+            // Generating the graph can add visibility to connection 
+            // points, so record the inputs afterwards.
+            staticBuiltGraphInputs(m_static_orthogonal_graph_inputs);
         }
         m_static_orthogonal_graph_invalidated = false;
     }
+    else if (m_allows_orthogonal_routing)
+    {
+        // Keep the graph, but remove the edges to connection pins from 
+        // connector endpoints, as destroyOrthogonalVisGraph() would.  
+        // These are recreated for each connector as it is routed.
+        for (VertInf *curr = vertices.connsBegin(); 
+                curr && (curr != vertices.shapesBegin()); 
+                curr = curr->lstNext)
+        {
+            if (curr->visDirections != ConnDirNone)
+            {
+                continue;
+            }
+            while (!curr->orthogVisList.empty())
+            {
+                delete curr->orthogVisList.front();
+            }
+        }
+    }
 }
 
 
@@ -632,11 +715,18 @@ bool Router::processTransaction(void)
     }
     m_settings_changes = false;
 
+    m_transaction_metrics.start();
+
     processActions();
 
-    m_static_orthogonal_graph_invalidated = true;
     rerouteAndCallbackConnectors();
 
+    m_transaction_metrics.finish();
+    m_transaction_metrics.vertexCount = 
+            vertices.shapesSize() + vertices.connsSize();
+    m_transaction_metrics.edgeCount = 
+            visGraph.size() + visOrthogGraph.size();
+
     return true;
 }
 
@@ -903,6 +993,43 @@ void Router::attachedShapes(IntList &shapes, const unsigned int shapeId,
 }
 
 
+// Searches for routes for the given connectors, which have been prepared
+// with ConnRef::prepareToGeneratePath(), using the given number of threads.
+// Each thread has its own search state and repeatedly takes the next 
+// connector from the list, and the routes are returned in paths.  The 
+// searches only read the visibility graph, which must not change until
+// they are finished.
+static void searchConcurrently(const std::vector<ConnRef *>& conns,
+        std::vector<std::vector<VertInf *> >& paths, unsigned int threads)
+{
+    COLA_ASSERT(conns.size() == paths.size());
+    threads = std::min(threads, (unsigned int) conns.size());
+
+    std::atomic<size_t> next(0);
+    std::function<void (void)> search = [&conns, &paths, &next]()
+    {
+        AStarPath aStar;
+        for (size_t i = next++; i < conns.size(); i = next++)
+        {
+            ConnRef *conn = conns[i];
+            aStar.search(conn, conn->src(), conn->dst(), conn->start(), 
+                    paths[i]);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned int t = 1; t < threads; ++t)
+    {
+        workers.push_back(std::thread(search));
+    }
+    search();
+    for (size_t t = 0; t < workers.size(); ++t)
+    {
+        workers[t].join();
+    }
+}
+
+
     // It's intended this function is called after visibility changes 
     // resulting from shape movement have happened.  It will alert 
     // rerouted connectors (via a callback) that they need to be redrawn.
@@ -927,6 +1054,17 @@ void Router::rerouteAndCallbackConnectors(void)
     ConnRefSet hyperedgeConns =
             m_hyperedge_rerouter.calcHyperedgeConnectors();
 
+    unsigned int threads = m_routing_threads;
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Connectors whose route searches will be run concurrently, once the
+    // other connectors have been routed.
+    std::vector<ConnRef *> concurrentConns;
+    std::vector<std::pair<bool, bool> > concurrentConnsDummyAtEnd;
+
     unsigned int totalConns = connRefs.size();
     unsigned int numOfReroutedConns = 0;
     for (ConnRefList::const_iterator i = connRefs.begin(); i != fin; ++i) 
@@ -949,22 +1087,57 @@ void Router::rerouteAndCallbackConnectors(void)
             continue;
         }
 
+        if ((threads > 1) && connector->canSearchConcurrently())
+        {
+            std::pair<bool, bool> isDummyAtEnd;
+            connector->m_needs_repaint = false;
+            if (connector->prepareToGeneratePath(isDummyAtEnd))
+            {
+                concurrentConns.push_back(connector);
+                concurrentConnsDummyAtEnd.push_back(isDummyAtEnd);
+            }
+            continue;
+        }
+
         TIMER_START(this, tmOrthogRoute);
         connector->m_needs_repaint = false;
         bool rerouted = connector->generatePath();
         if (rerouted)
         {
             reroutedConns.push_back(connector);
+            ++m_transaction_metrics.routedConnectorCount;
+            m_transaction_metrics.expandedNodeCount += 
+                    connector->routeSearchExpandedNodeCount();
         }
         TIMER_STOP(this);
     }
 
+    if (!concurrentConns.empty())
+    {
+        TIMER_START(this, tmOrthogRoute);
+        std::vector<std::vector<VertInf *> > paths(concurrentConns.size());
+        searchConcurrently(concurrentConns, paths, threads);
+        for (size_t i = 0; i < concurrentConns.size(); ++i)
+        {
+            ConnRef *connector = concurrentConns[i];
+            connector->generateSearchedPath(concurrentConnsDummyAtEnd[i], 
+                    paths[i]);
+            reroutedConns.push_back(connector);
+            ++m_transaction_metrics.routedConnectorCount;
+            m_transaction_metrics.expandedNodeCount += 
+                    connector->routeSearchExpandedNodeCount();
+        }
+        TIMER_STOP(this);
+    }
+    m_transaction_metrics.startPhase(0);
+
 
     // Perform any complete hyperedge rerouting that has been requested.
     m_hyperedge_rerouter.performRerouting();
 
     // Find and reroute crossing connectors if crossing penalties are set.
     improveCrossings();
+    m_transaction_metrics.startPhase(0);
 
     bool withMinorImprovements = routingOption(
             improveHyperedgeRoutesMovingJunctions);
@@ -978,6 +1151,7 @@ void Router::rerouteAndCallbackConnectors(void)
 
     // Perform centring and nudging for orthogonal routes.
     improveOrthogonalRoutes(this);
+    m_transaction_metrics.startPhase(0);
 
     // Find a list of all the deleted connectors in hyperedges.
     HyperedgeNewAndDeletedObjectLists changedHyperedgeObjs = 
@@ -1120,6 +1294,8 @@ static double cheapEstimatedCost(ConnRef *lineRef)
 void Router::performContinuationCheck(unsigned int phaseNumber, 
         unsigned int stepNumber, unsigned int totalSteps)
 {
+    m_transaction_metrics.startPhase(phaseNumber);
+
     // Compute the elapsed time in msec since the beginning of the transaction.
     unsigned int elapsedMsec = (unsigned int) 
             ((clock() - m_transaction_start_time) / 
@@ -1169,6 +1345,40 @@ class CmpOrderedConnCostRef
 typedef std::list<ConnCostRef> ConnCostRefList;
 
 
+// Finds the positions, in connVector, of connectors after position i whose
+// routes may intersect that of connector i.  Connectors that are not
+// returned can not cross, touch or share a path with connector i.
+static void laterIntersectionCandidates(const RouteIndex& index,
+        const std::vector<ConnRef *>& connVector,
+        const std::unordered_map<unsigned int, size_t>& positions,
+        const size_t i, std::vector<unsigned int>& ids,
+        std::vector<size_t>& result)
+{
+    index.candidates(connVector[i]->id(), ids);
+    result.clear();
+    for (size_t k = 0; k < ids.size(); ++k)
+    {
+        size_t pos = positions.find(ids[k])->second;
+        if (pos > i)
+        {
+            result.push_back(pos);
+        }
+    }
+    std::sort(result.begin(), result.end());
+}
+
+
+static void connPositions(const std::vector<ConnRef *>& connVector,
+        std::unordered_map<unsigned int, size_t>& positions)
+{
+    positions.clear();
+    for (size_t i = 0; i < connVector.size(); ++i)
+    {
+        positions[connVector[i]->id()] = i;
+    }
+}
+
+
 void Router::improveCrossings(void)
 {
     const double crossing_penalty = routingParameter(crossingPenalty);
@@ -1186,9 +1396,24 @@ void Router::improveCrossings(void)
     m_in_crossing_rerouting_stage = true;
     ConnCostRefSet crossingConns;
     ConnCostRefSetList fixedSharedPathConns;
-    ConnRefList::iterator fin = connRefs.end();
-    for (ConnRefList::iterator i = connRefs.begin(); i != fin; ++i) 
+
+    // Only pairs of connectors whose routes have segments close to each
+    // other are checked, using an index that is updated incrementally.
+    std::vector<ConnRef *> connVector(connRefs.begin(), connRefs.end());
+    m_route_index.beginUpdate();
+    for (size_t i = 0; i < connVector.size(); ++i)
     {
+        m_route_index.setRoute(connVector[i]->id(), connVector[i]->routeRef());
+    }
+    m_route_index.endUpdate();
+    std::unordered_map<unsigned int, size_t> positions;
+    connPositions(connVector, positions);
+    std::vector<unsigned int> candidateIds;
+    std::vector<size_t> candidates;
+    for (size_t iPos = 0; iPos < connVector.size(); ++iPos)
+    {
+        ConnRef *iConn = connVector[iPos];
+
         // Progress reporting and continuation check.
         ++numOfConnsChecked;
         performContinuationCheck(TransactionPhaseCrossingDetection,
@@ -1199,18 +1424,20 @@ void Router::improveCrossings(void)
             return;
         }
     
-        Avoid::Polygon& iRoute = (*i)->routeRef();
+        Avoid::Polygon& iRoute = iConn->routeRef();
         if (iRoute.size() == 0)
         {
             // Rerouted hyperedges will have an empty route.
             // We can't reroute these.
             continue;
         }
-        ConnCostRef iCostRef = std::make_pair(cheapEstimatedCost(*i), *i);
-        ConnRefList::iterator j = i;
-        for (++j; j != fin; ++j) 
+        ConnCostRef iCostRef = std::make_pair(cheapEstimatedCost(iConn), iConn);
+        laterIntersectionCandidates(m_route_index, connVector, positions,
+                iPos, candidateIds, candidates);
+        for (size_t c = 0; c < candidates.size(); ++c)
         {
-            ConnCostRef jCostRef = std::make_pair(cheapEstimatedCost(*j), *j);
+            ConnRef *jConn = connVector[candidates[c]];
+            ConnCostRef jCostRef = std::make_pair(cheapEstimatedCost(jConn), jConn);
             if (connsKnownToCross(fixedSharedPathConns, iCostRef, jCostRef) ||
                     (crossingConns.count(iCostRef) && 
                      crossingConns.count(jCostRef)))
@@ -1219,8 +1446,8 @@ void Router::improveCrossings(void)
                 continue;
             }
             // Determine if this pair cross.
-            Avoid::Polygon& jRoute = (*j)->routeRef();
-            ConnectorCrossings cross(iRoute, true, jRoute, *i, *j);
+            Avoid::Polygon& jRoute = jConn->routeRef();
+            ConnectorCrossings cross(iRoute, true, jRoute, iConn, jConn);
             for (size_t jInd = 1; jInd < jRoute.size(); ++jInd)
             {
                 const bool finalSegment = ((jInd + 1) == jRoute.size());
@@ -1325,6 +1552,9 @@ void Router::improveCrossings(void)
                     
                     // Recompute this path.
                     conn->generatePath();
+                    ++m_transaction_metrics.crossingReroutedConnectorCount;
+                    m_transaction_metrics.expandedNodeCount += 
+                            conn->routeSearchExpandedNodeCount();
                 }
             }
         }
@@ -1362,6 +1592,9 @@ void Router::improveCrossings(void)
                 
                 // Recompute this path.
                 conn->generatePath();
+                ++m_transaction_metrics.crossingReroutedConnectorCount;
+                m_transaction_metrics.expandedNodeCount += 
+                        conn->routeSearchExpandedNodeCount();
             }
         }
     }
@@ -1373,6 +1606,7 @@ void Router::newBlockingShape(const Polygon& poly, int pid)
 {
     // o  Check all visibility edges to see if this one shape
     //    blocks them.
+    const Box polyBox = poly.offsetBoundingBox(0);
     EdgeInf *finish = visGraph.end();
     for (EdgeInf *iter = visGraph.begin(); iter != finish ; )
     {
@@ -1381,12 +1615,20 @@ void Router::newBlockingShape(const Polygon& poly, int pid)
 
         if (tmp->getDist() != 0)
         {
-            std::pair<VertID, VertID> ids(tmp->ids());
-            VertID eID1 = ids.first;
-            VertID eID2 = ids.second;
             std::pair<Point, Point> points(tmp->points());
             Point e1 = points.first;
             Point e2 = points.second;
+            if ((std::max(e1.x, e2.x) < polyBox.min.x) ||
+                    (std::min(e1.x, e2.x) > polyBox.max.x) ||
+                    (std::max(e1.y, e2.y) < polyBox.min.y) ||
+                    (std::min(e1.y, e2.y) > polyBox.max.y))
+            {
+                // The edge can't touch the shape.
+                continue;
+            }
+            std::pair<VertID, VertID> ids(tmp->ids());
+            VertID eID1 = ids.first;
+            VertID eID2 = ids.second;
             bool blocked = false;
 
             bool countBorder = false;
@@ -1879,6 +2121,24 @@ bool Router::routingOption(const RoutingOption option) const
 }
 
 
+void Router::setRoutingThreadCount(const unsigned int threads)
+{
+    m_routing_threads = threads;
+}
+
+
+unsigned int Router::routingThreadCount(void) const
+{
+    return m_routing_threads;
+}
+
+
+const TransactionMetrics& Router::lastTransactionMetrics(void) const
+{
+    return m_transaction_metrics;
+}
+
+
 void Router::setRoutingPenalty(const RoutingParameter penType,
         const double penValue)
 {
@@ -2095,17 +2355,31 @@ bool Router::existsOrthogonalTouchingPaths(void)
 int Router::existsCrossings(const bool optimisedForConnectorType)
 {
     int count = 0;
-    ConnRefList::iterator fin = connRefs.end();
-    for (ConnRefList::iterator i = connRefs.begin(); i != fin; ++i) 
-    {
-        Avoid::Polygon iRoute = (*i)->displayRoute();
-        ConnRefList::iterator j = i;
-        for (++j; j != fin; ++j) 
-        {
+    RouteIndex index;
+    std::vector<ConnRef *> connVector(connRefs.begin(), connRefs.end());
+    index.beginUpdate();
+    for (size_t i = 0; i < connVector.size(); ++i)
+    {
+        index.setRoute(connVector[i]->id(), connVector[i]->displayRoute());
+    }
+    index.endUpdate();
+    std::unordered_map<unsigned int, size_t> positions;
+    connPositions(connVector, positions);
+    std::vector<unsigned int> candidateIds;
+    std::vector<size_t> candidates;
+    for (size_t iPos = 0; iPos < connVector.size(); ++iPos)
+    {
+        ConnRef *i = connVector[iPos];
+        Avoid::Polygon iRoute = i->displayRoute();
+        laterIntersectionCandidates(index, connVector, positions, iPos,
+                candidateIds, candidates);
+        for (size_t c = 0; c < candidates.size(); ++c)
+        {
+            ConnRef *j = connVector[candidates[c]];
             // Determine if this pair overlap
-            Avoid::Polygon jRoute = (*j)->displayRoute();
-            ConnRef *iConn = (optimisedForConnectorType) ? *i : NULL;
-            ConnRef *jConn = (optimisedForConnectorType) ? *j : NULL;
+            Avoid::Polygon jRoute = j->displayRoute();
+            ConnRef *iConn = (optimisedForConnectorType) ? i : NULL;
+            ConnRef *jConn = (optimisedForConnectorType) ? j : NULL;
             ConnectorCrossings cross(iRoute, true, jRoute, iConn, jConn);
             cross.checkForBranchingSegments = true;
             for (size_t jInd = 1; jInd < jRoute.size(); ++jInd)
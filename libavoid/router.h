@@ -31,6 +31,7 @@
 
 #include <ctime>
 #include <list>
+#include <vector>
 #include <utility>
 #include <string>
 
@@ -42,6 +43,10 @@
 #include "libavoid/hyperedge.h"
 #include "libavoid/actioninfo.h"
 #include "libavoid/hyperedgeimprover.h"
+#include "libavoid/routeindex.h"
+#include "libavoid/obstacleindex.h"
+#include "libavoid/makepath.h"
+#include "libavoid/orthogonal.h"
 
 
 namespace Avoid {
@@ -271,6 +276,22 @@ enum RoutingOption
     //!
     nudgeSharedPathsWithCommonEndPoint,
 
+    //! This option causes the route search for each orthogonal connector
+    //! to only consider the part of the visibility graph in a window 
+    //! around its endpoints.  The window is widened, and the search 
+    //! repeated, only if there is no route inside it.
+    //!
+    //! Defaults to false.
+    //!
+    //! This limits the work done for each connector when the penalties 
+    //! make the search explore far from the direct route, such as with 
+    //! crossingPenalty, at the cost of sometimes choosing a more 
+    //! expensive route than the best one outside the window.  The number
+    //! of nodes expanded for each connector can be obtained from 
+    //! ConnRef::routeSearchExpandedNodeCount().
+    //!
+    searchOrthogonalRoutesInLocalRegion,
+
 
     // Used for determining the size of the routing options array.
     // This should always we the last value in the enum.
@@ -307,6 +328,10 @@ enum TransactionPhases
     TransactionPhaseCompleted
 };
 
+// TransactionMetrics has a time for each phase, as well as for other work.
+static_assert(TRANSACTION_PHASES_COUNT == TransactionPhaseCompleted,
+        "TRANSACTION_PHASES_COUNT must match TransactionPhases");
+
 // NOTE: This is an internal helper class that should not be used by the user.
 //
 // This class allows edges in the visibility graph to store a
@@ -635,6 +660,47 @@ class AVOID_EXPORT Router {
         //!
         bool routingOption(const RoutingOption option) const;
 
+        //! @brief  Sets the number of threads used to search for connector
+        //!         routes during a transaction.
+        //!
+        //! With more than one thread, the route searches for orthogonal 
+        //! connectors are run concurrently and the resulting routes are 
+        //! then assigned in the usual connector order.  Connectors with 
+        //! checkpoints or that can attach to exclusive connection pins, and
+        //! all connectors when RubberBandRouting is set, are still routed
+        //! one at a time.  The routes do not depend on the number of 
+        //! threads, though where alternative routes have the same cost a 
+        //! different one may be chosen than when routing with one thread.
+        //!
+        //! The same number of threads is used to solve the independent
+        //! groups of segments when nudging orthogonal routes.  The nudged
+        //! routes do not depend on the number of threads.
+        //!
+        //! Defaults to 1.
+        //!
+        //! @param[in] threads  The number of threads, or zero for one per
+        //!                     hardware thread.
+        //!
+        void setRoutingThreadCount(const unsigned int threads);
+
+        //! @brief  Returns the number of threads used to search for 
+        //!         connector routes.
+        //!
+        //! @return  The number of threads, or zero for one per hardware 
+        //!          thread.
+        //!
+        unsigned int routingThreadCount(void) const;
+
+        //! @brief  Returns the timings and counts for the work done during
+        //!         the last transaction processed by the router.
+        //!
+        //! These are always collected.  They can be written out in JSON 
+        //! format with TransactionMetrics::outputJSON().
+        //!
+        //! @return  A reference to the metrics for the last transaction.
+        //!
+        const TransactionMetrics& lastTransactionMetrics(void) const;
+
         //! @brief  Sets or removes penalty values that are applied during 
         //!         connector routing.
         //!
@@ -764,6 +830,7 @@ class AVOID_EXPORT Router {
         void generateContains(VertInf *pt);
         void printInfo(void);
         void regenerateStaticBuiltGraph(void);
+        void staticBuiltGraphInputs(std::vector<double>& inputs);
         void destroyOrthogonalVisGraph(void);
         void setStaticGraphInvalidated(const bool invalidated);
         ConnType validConnType(const ConnType select = ConnType_None) const;
@@ -809,6 +876,8 @@ class AVOID_EXPORT Router {
         friend struct HyperedgeTreeNode;
         friend class HyperedgeRerouter;
         friend class HyperedgeImprover;
+        friend class ImproveOrthogonalRoutes;
+        friend class EdgeInf;
 
         unsigned int assignId(const unsigned int suggestedId);
         void addShape(ShapeRef *shape);
@@ -837,6 +906,7 @@ class AVOID_EXPORT Router {
         bool m_currently_calling_destructors;
         double m_routing_parameters[lastRoutingParameterMarker];
         bool m_routing_options[lastRoutingOptionMarker];
+        unsigned int m_routing_threads;
         
         ConnRerouteFlagDelegate m_conn_reroute_flags;
         HyperedgeRerouter m_hyperedge_rerouter;
@@ -844,6 +914,7 @@ class AVOID_EXPORT Router {
         // Progress tracking and transaction cancelling.
         clock_t m_transaction_start_time;
         bool m_abort_transaction;
+        TransactionMetrics m_transaction_metrics;
         
         TopologyAddonInterface *m_topology_addon;
 
@@ -852,6 +923,20 @@ class AVOID_EXPORT Router {
         bool m_allows_orthogonal_routing;
         
         bool m_static_orthogonal_graph_invalidated;
+        // The obstacle boxes and connection points the static orthogonal 
+        // visibility graph was last generated from.
+        std::vector<double> m_static_orthogonal_graph_inputs;
+        // Index of connector routes, kept between transactions so that
+        // improveCrossings() only reindexes routes that have changed.
+        RouteIndex m_route_index;
+        // Index of the routing boxes of active obstacles, used to find the
+        // obstacles that may block a polyline visibility edge.
+        ObstacleIndex m_obstacle_index;
+        // Search state for routing connectors one at a time, kept so that
+        // its storage is reused from one search to the next.
+        AStarPath m_astar_path;
+        // Solutions of the nudging problems from the previous transaction.
+        NudgingSolutionCache m_nudging_solutions;
         bool m_in_crossing_rerouting_stage;
 
         bool m_settings_changes;
@@ -26,6 +26,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <climits>
+#include <chrono>
 
 #include "libavoid/timer.h"
 #include "libavoid/debug.h"
@@ -33,6 +34,100 @@
 
 namespace Avoid {
 
+static const char *transactionPhaseNames[TRANSACTION_PHASES_COUNT] = 
+{
+    "other",
+    "orthogonalVisibilityGraphScanX",
+    "orthogonalVisibilityGraphScanY",
+    "routeSearch",
+    "crossingDetection",
+    "rerouteSearch",
+    "orthogonalNudgingX",
+    "orthogonalNudgingY"
+};
+
+
+// Returns a wall-clock time in seconds.
+static double wallTime(void)
+{
+    return std::chrono::duration<double>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+TransactionMetrics::TransactionMetrics()
+    : m_phase(0),
+      m_start_time(0),
+      m_phase_start_time(0)
+{
+    start();
+}
+
+
+void TransactionMetrics::start(void)
+{
+    for (size_t i = 0; i < TRANSACTION_PHASES_COUNT; ++i)
+    {
+        phaseTime[i] = 0;
+    }
+    totalTime = 0;
+    orthogonalGraphRegenerated = false;
+    vertexCount = 0;
+    edgeCount = 0;
+    routedConnectorCount = 0;
+    crossingReroutedConnectorCount = 0;
+    expandedNodeCount = 0;
+
+    m_phase = 0;
+    m_start_time = m_phase_start_time = wallTime();
+}
+
+
+void TransactionMetrics::startPhase(const unsigned int phase)
+{
+    // TransactionPhaseCompleted and any later phases count as other work.
+    const unsigned int newPhase = (phase < TRANSACTION_PHASES_COUNT) ? 
+            phase : 0;
+    if (newPhase == m_phase)
+    {
+        return;
+    }
+    const double now = wallTime();
+    phaseTime[m_phase] += now - m_phase_start_time;
+    m_phase = newPhase;
+    m_phase_start_time = now;
+}
+
+
+void TransactionMetrics::finish(void)
+{
+    startPhase(0);
+    const double now = wallTime();
+    phaseTime[0] += now - m_phase_start_time;
+    m_phase_start_time = now;
+    totalTime = now - m_start_time;
+}
+
+
+void TransactionMetrics::outputJSON(FILE *fp) const
+{
+    fprintf(fp, "{\"totalTime\": %g, \"phaseTime\": {", totalTime);
+    for (size_t i = 0; i < TRANSACTION_PHASES_COUNT; ++i)
+    {
+        fprintf(fp, "%s\"%s\": %g", (i > 0) ? ", " : "", 
+                transactionPhaseNames[i], phaseTime[i]);
+    }
+    fprintf(fp, "}, \"orthogonalGraphRegenerated\": %s, "
+            "\"vertexCount\": %u, \"edgeCount\": %u, "
+            "\"routedConnectorCount\": %u, "
+            "\"crossingReroutedConnectorCount\": %u, "
+            "\"expandedNodeCount\": %llu}\n",
+            (orthogonalGraphRegenerated) ? "true" : "false", vertexCount, 
+            edgeCount, routedConnectorCount, crossingReroutedConnectorCount,
+            expandedNodeCount);
+}
+
+
 #ifdef AVOID_PROFILE
 
 Timer::Timer()
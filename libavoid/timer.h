@@ -27,9 +27,71 @@
 #define AVOID_TIMER_H
 
 #include <ctime>
+#include <cstdio>
+
+#include "libavoid/dllexport.h"
 
 namespace Avoid {
 
+//! @brief  The number of phases timed by TransactionMetrics, which are
+//!         indexed by the values of TransactionPhases, with zero for the 
+//!         work done outside of those phases.  router.h checks at compile
+//!         time that it matches TransactionPhases.
+static const size_t TRANSACTION_PHASES_COUNT = 8;
+
+//! @brief  Timings and counts for the work done by the router during its 
+//!         last transaction.
+//!
+//! Unlike the Timer used when libavoid is built with AVOID_PROFILE, these
+//! are always collected.  They can be obtained from 
+//! Router::lastTransactionMetrics().
+//!
+class AVOID_EXPORT TransactionMetrics
+{
+    public:
+        TransactionMetrics();
+
+        //! @brief  Writes the metrics to the given file as a JSON object.
+        void outputJSON(FILE *fp) const;
+
+        //! @brief  The wall-clock time in seconds spent in each phase of 
+        //!         the transaction, indexed by TransactionPhases.
+        //!
+        //! Index zero holds the time spent outside those phases, such as 
+        //! processing moved shapes, rerouting hyperedges and centring 
+        //! orthogonal segments.
+        double phaseTime[TRANSACTION_PHASES_COUNT];
+        //! @brief  The wall-clock time in seconds for the whole transaction.
+        double totalTime;
+        //! @brief  Whether the orthogonal visibility graph was regenerated.
+        bool orthogonalGraphRegenerated;
+        //! @brief  The number of vertices in the visibility graph at the 
+        //!         end of the transaction.
+        unsigned int vertexCount;
+        //! @brief  The number of polyline and orthogonal visibility edges
+        //!         at the end of the transaction.
+        unsigned int edgeCount;
+        //! @brief  The number of connectors whose routes were searched for.
+        unsigned int routedConnectorCount;
+        //! @brief  The number of connectors rerouted to avoid crossings or
+        //!         shared paths.
+        unsigned int crossingReroutedConnectorCount;
+        //! @brief  The number of nodes expanded by the route searches.
+        unsigned long long expandedNodeCount;
+
+    private:
+        friend class Router;
+
+        void start(void);
+        void startPhase(const unsigned int phase);
+        void finish(void);
+
+        unsigned int m_phase;
+        double m_start_time;
+        double m_phase_start_time;
+};
+
+
 //#define AVOID_PROFILE
 
 #ifndef AVOID_PROFILE
@@ -242,6 +242,13 @@ void VertInf::removeFromGraph(const bool isConnVert)
         delete (*edge);
     }
 
+    if (id.isConnPt() && (visDirections != ConnDirNone) && 
+            !orthogVisList.empty())
+    {
+        // This connection point has edges in the static orthogonal 
+        // visibility graph, which will need regenerating without them.
+        _router->setStaticGraphInvalidated(true);
+    }
     finish = orthogVisList.end();
     while ((edge = orthogVisList.begin()) != finish)
     {
@@ -110,8 +110,6 @@ class VertID
 static const VertID dummyOrthogID(0, 0);
 static const VertID dummyOrthogShapeID(0, 0, VertID::PROP_OrthShapeEdge);
 
-class ANode;
-
 class VertInf
 {
     public:
@@ -164,8 +162,6 @@ class VertInf
         double sptfDist;
 
         ConnDirFlags visDirections;
-        std::list<ANode *> aStarDoneNodes;
-        std::list<ANode *> aStarPendingNodes;
         // Flags for orthogonal visibility properties, i.e., whether the 
         // line points to a shape edge, connection point or an obstacle.
         unsigned int orthogVisPropFlags;
@@ -33,6 +33,7 @@
 
 #include <algorithm>
 #include <cfloat>
+#include <unordered_map>
 
 #include "libavoid/shape.h"
 #include "libavoid/debug.h"
@@ -347,6 +348,30 @@ class isBoundingShape
 };
 
 
+// Collects the existing edges of vert, keyed by their other vertex, in the
+// order EdgeInf::existingEdge() would find them.  Looking up each vertex
+// in the sweep here avoids scanning the edge lists of vert, which hold an
+// edge to almost every other vertex, once per vertex.
+typedef std::unordered_map<VertInf *, EdgeInf *> VertEdgeMap;
+static void collectExistingEdges(VertInf *vert, VertEdgeMap& edges)
+{
+    EdgeInfList *lists[] = 
+            { &vert->visList, &vert->orthogVisList, &vert->invisList };
+    edges.clear();
+    edges.reserve(vert->visListSize + vert->orthogVisListSize + 
+            vert->invisListSize);
+    for (size_t l = 0; l < 3; ++l)
+    {
+        EdgeInfList::const_iterator finish = lists[l]->end();
+        for (EdgeInfList::const_iterator edge = lists[l]->begin(); 
+                edge != finish; ++edge)
+        {
+            edges.insert(std::make_pair((*edge)->otherVert(vert), *edge));
+        }
+    }
+}
+
+
 static bool sweepVisible(SweepEdgeList& T, const PointPair& point, 
         std::set<unsigned int>& onBorderIDs, int *blocker)
 {
@@ -563,6 +588,8 @@ static void vertexSweep(VertInf *vert)
     db_printf("SWEEP: "); centerID.db_print(); db_printf("\n");
 
     isBoundingShape isBounding(ss);
+    VertEdgeMap existingEdges;
+    collectExistingEdges(centerInf, existingEdges);
     for (VertSet::const_iterator t = vbegin; t != vend; ++t)
     {
         VertInf *currInf = (*t).vInf;
@@ -571,7 +598,9 @@ static void vertexSweep(VertInf *vert)
 
         const double& currDist = (*t).distance;
 
-        EdgeInf *edge = EdgeInf::existingEdge(centerInf, currInf);
+        VertEdgeMap::const_iterator existing = existingEdges.find(currInf);
+        EdgeInf *edge = (existing != existingEdges.end()) ? 
+                existing->second : NULL;
         if (edge == NULL)
         {
             edge = new EdgeInf(centerInf, currInf);
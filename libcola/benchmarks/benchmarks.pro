@@ -0,0 +1,15 @@
+# Benchmarks for libcola.  These are not part of the default build:
+#   cd libcola/benchmarks && qmake && make && ../../build/cola_benchmark
+TEMPLATE = app
+TARGET = cola_benchmark
+CONFIG += console
+DEPENDPATH += ../.. ..
+INCLUDEPATH += ../.. \
+    ../../libvpsc
+include(../../common_options.qmake)
+CONFIG -= qt app_bundle
+
+LIBS += -L$$DESTDIR -lcola -lvpsc
+
+# Input
+SOURCES += cola_benchmark.cpp
@@ -0,0 +1,246 @@
+/*
+ * vim: ts=4 sw=4 et tw=0 wm=0
+ *
+ * libcola - A library providing force-directed network layout using the
+ *           stress-majorization method subject to separation constraints.
+ *
+ * Copyright (C) 2014  Monash University
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * See the file LICENSE.LGPL distributed with the library.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+*/
+
+/*
+ * Micro-benchmarks for libcola.  Usage:
+ *   cola_benchmark [all|hessian|threads] [iterations]
+ * Each benchmark prints the mean time per iteration.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+#include <valarray>
+#include <chrono>
+#include <thread>
+
+#include "libvpsc/rectangle.h"
+#include "libcola/cola.h"
+#include "libcola/sparse_matrix.h"
+
+using namespace std;
+
+static double seconds(const chrono::steady_clock::time_point& start) {
+    return chrono::duration<double>(chrono::steady_clock::now()-start).count();
+}
+
+/*
+ * The Hessian assembly used before cola::SparseMap stored rows: every
+ * entry is a std::map node, and the map is copied into Yale form.
+ */
+struct MapHessian {
+    typedef map<pair<unsigned,unsigned>,double> Lookup;
+    MapHessian(unsigned n) : n(n) {}
+    double& operator()(const unsigned i, const unsigned j) {
+        return lookup[make_pair(i,j)];
+    }
+    void clear() {
+        lookup.clear();
+    }
+    /* converts to Yale form and returns row n/2 of H times a vector of 1s */
+    double multiply() const {
+        valarray<double> A(lookup.size());
+        valarray<unsigned> IA(n+1), JA(lookup.size());
+        unsigned cnt=0;
+        int lastrow=-1;
+        for(Lookup::const_iterator i=lookup.begin();i!=lookup.end();++i) {
+            if((int)i->first.first!=lastrow) {
+                for(unsigned r=lastrow+1;r<=i->first.first;r++) {
+                    IA[r]=cnt;
+                }
+                lastrow=i->first.first;
+            }
+            A[cnt]=i->second;
+            JA[cnt]=i->first.second;
+            cnt++;
+        }
+        for(unsigned r=lastrow+1;r<=n;r++) {
+            IA[r]=cnt;
+        }
+        double r=0;
+        for(unsigned j=IA[n/2];j<IA[n/2+1];j++) {
+            r+=A[j];
+        }
+        return r;
+    }
+    unsigned n;
+    Lookup lookup;
+};
+
+static double multiply(const cola::SparseMap& H) {
+    cola::SparseMatrix M(H);
+    valarray<double> x(1.0,H.n), r(H.n);
+    M.rightMultiply(x,r);
+    return r[H.n/2];
+}
+
+/*
+ * Fills H in the pattern of ConstrainedFDLayout::computeForces(): row by
+ * row, with the diagonal entry written last.  columns[u] lists the other
+ * nodes with stress terms involving u.
+ */
+template <typename Hessian>
+static void fillHessian(Hessian& H,
+        const vector<vector<unsigned> >& columns) {
+    for(unsigned u=0;u<columns.size();u++) {
+        double Huu=0;
+        for(unsigned i=0;i<columns[u].size();i++) {
+            unsigned v=columns[u][i];
+            double h=1.0/(1+u+v);
+            H(u,v)+=h;
+            Huu-=h;
+        }
+        H(u,u)+=Huu;
+    }
+}
+
+static double multiply(const MapHessian& H) {
+    return H.multiply();
+}
+
+template <typename Hessian>
+static double timeHessian(Hessian& H,
+        const vector<vector<unsigned> >& columns, const unsigned iterations,
+        double& checksum) {
+    chrono::steady_clock::time_point start=chrono::steady_clock::now();
+    for(unsigned i=0;i<iterations;i++) {
+        H.clear();
+        fillHessian(H,columns);
+        checksum+=multiply(H);
+    }
+    return seconds(start)/iterations;
+}
+
+/*
+ * Hessian assembly and conversion to SparseMatrix, per layout iteration,
+ * for the exact stress model on 1k nodes (every pair has a term) and the
+ * sparse stress model on 10k nodes (tree neighbours plus 50 pivots).
+ */
+static void benchmarkHessian(const unsigned iterations) {
+    printf("Hessian assembly per iteration:\n");
+    for(unsigned k=0;k<2;k++) {
+        const bool dense=(k==0);
+        const unsigned n=dense?1000:10000;
+        vector<vector<unsigned> > columns(n);
+        srand(1);
+        for(unsigned u=0;u<n;u++) {
+            if(dense) {
+                for(unsigned v=0;v<n;v++) {
+                    if(v!=u) columns[u].push_back(v);
+                }
+            } else if(u>0) {
+                unsigned v=rand()%u;
+                columns[u].push_back(v);
+                columns[v].push_back(u);
+            }
+        }
+        if(!dense) {
+            for(unsigned u=0;u<n;u++) {
+                for(unsigned p=0;p<50;p++) {
+                    unsigned v=(p*7919u)%n;
+                    if(v!=u) columns[u].push_back(v);
+                }
+            }
+        }
+        double mapChecksum=0, rowChecksum=0;
+        MapHessian mapH(n);
+        double mapTime=timeHessian(mapH,columns,iterations,mapChecksum);
+        cola::SparseMap rowH(n);
+        double rowTime=timeHessian(rowH,columns,iterations,rowChecksum);
+        printf("  %5u nodes, %s: std::map %.4fs, SparseMap %.4fs%s\n",
+                n,dense?"exact stress":"sparse stress",mapTime,rowTime,
+                mapChecksum==rowChecksum?"":" (results differ!)");
+    }
+}
+
+/*
+ * Runs a layout of a random sparse graph for a fixed number of iterations
+ * and returns the mean time per iteration.  pivots>0 selects the sparse
+ * stress model.
+ */
+static double timeLayout(const unsigned n, const unsigned pivots,
+        const unsigned threads, const unsigned iterations) {
+    vector<cola::Edge> es;
+    vpsc::Rectangles rs;
+    srand(1);
+    for(unsigned i=1;i<n;i++) {
+        es.push_back(cola::Edge(rand()%i,i));
+    }
+    for(unsigned i=0;i<n/4;i++) {
+        unsigned u=rand()%n, v=rand()%n;
+        if(u!=v) es.push_back(cola::Edge(u,v));
+    }
+    for(unsigned i=0;i<n;i++) {
+        double x=rand()%1000, y=rand()%1000;
+        rs.push_back(new vpsc::Rectangle(x,x+10,y,y+10));
+    }
+    cola::TestConvergence done(0,iterations);
+    cola::ConstrainedFDLayout alg(rs,es,40,false,
+            cola::StandardEdgeLengths,&done);
+    alg.setSparseStress(pivots);
+    alg.setThreadCount(threads);
+    alg.computeStress();
+    chrono::steady_clock::time_point start=chrono::steady_clock::now();
+    alg.run();
+    double t=seconds(start)/iterations;
+    for(unsigned i=0;i<n;i++) {
+        delete rs[i];
+    }
+    return t;
+}
+
+/*
+ * ConstrainedFDLayout iterations (forces and stress) with 1, 2, 4 and one
+ * thread per hardware thread, for the exact stress model on 2k nodes and
+ * the sparse stress model on 20k nodes.  Path lengths are computed before
+ * timing starts.
+ */
+static void benchmarkThreads(const unsigned iterations) {
+    const unsigned counts[]={1,2,4,0};
+    printf("Layout iteration, %u hardware threads:\n",
+            thread::hardware_concurrency());
+    for(unsigned k=0;k<2;k++) {
+        const unsigned n=k==0?2000:20000, pivots=k==0?0:50;
+        double single=0;
+        for(unsigned i=0;i<sizeof(counts)/sizeof(counts[0]);i++) {
+            double t=timeLayout(n,pivots,counts[i],iterations);
+            if(counts[i]==1) single=t;
+            printf("  %5u nodes, %s, %s threads: %.4fs (x%.2f)\n",
+                    n,pivots?"sparse stress":"exact stress",
+                    counts[i]?to_string(counts[i]).c_str():"all",
+                    t,single/t);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* which=argc>1?argv[1]:"all";
+    const unsigned iterations=argc>2?atoi(argv[2]):5;
+    bool all=strcmp(which,"all")==0;
+    if(all||strcmp(which,"hessian")==0) {
+        benchmarkHessian(iterations);
+    }
+    if(all||strcmp(which,"threads")==0) {
+        benchmarkThreads(iterations);
+    }
+    return 0;
+}
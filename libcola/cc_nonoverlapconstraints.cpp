@@ -21,6 +21,9 @@
 */
 
 #include <sstream>
+#include <cmath>
+#include <algorithm>
+#include <unordered_map>
 
 #include "libcola/cola.h"
 #include "libcola/compound_constraints.h"
@@ -165,19 +168,154 @@ class ShapePairInfo
 };
 
 
+// Shapes whose expanded bounding boxes cover more than this many cells of
+// the spatial hash are checked against every other shape instead.
+static const size_t maxCellsPerShape = 64;
+
+static long long cellCoord(const double pos, const double cellSize)
+{
+    double c = std::floor(pos / cellSize);
+    c = std::max(c, -2147483648.0);
+    c = std::min(c, 2147483647.0);
+    return (long long) c;
+}
+
+static long long cellKey(const long long cx, const long long cy)
+{
+    return (cx << 32) ^ (cy & 0xffffffffLL);
+}
+
+// Given bounding boxes as (minX, maxX, minY, maxY) quadruples, returns
+// the index pairs (i, j), i < j, of all boxes that overlap or touch, in 
+// ascending order.
+static void findOverlappingBoxes(const std::vector<double>& bounds,
+        std::vector<std::pair<unsigned, unsigned> >& pairs)
+{
+    pairs.clear();
+    const unsigned n = bounds.size() / 4;
+    if (n < 2)
+    {
+        return;
+    }
+    
+    // Use cells a little larger than the average box.
+    double extentSum = 0;
+    for (unsigned i = 0; i < n; ++i)
+    {
+        const double *b = &bounds[4 * i];
+        extentSum += std::max(b[1] - b[0], b[3] - b[2]);
+    }
+    const double cellSize = std::max(extentSum / n, 1.0);
+
+    std::unordered_map<long long, std::vector<unsigned> > cells;
+    std::vector<unsigned> large;
+    for (unsigned i = 0; i < n; ++i)
+    {
+        const double *b = &bounds[4 * i];
+        long long x0 = cellCoord(b[0], cellSize);
+        long long x1 = cellCoord(b[1], cellSize);
+        long long y0 = cellCoord(b[2], cellSize);
+        long long y1 = cellCoord(b[3], cellSize);
+        if ((x1 - x0 + 1) * (y1 - y0 + 1) > (long long) maxCellsPerShape)
+        {
+            large.push_back(i);
+            continue;
+        }
+        for (long long cx = x0; cx <= x1; ++cx)
+        {
+            for (long long cy = y0; cy <= y1; ++cy)
+            {
+                cells[cellKey(cx, cy)].push_back(i);
+            }
+        }
+    }
+
+    for (std::unordered_map<long long, std::vector<unsigned> >::iterator
+            cell = cells.begin(); cell != cells.end(); ++cell)
+    {
+        const std::vector<unsigned>& ids = cell->second;
+        for (size_t i = 0; i < ids.size(); ++i)
+        {
+            const double *a = &bounds[4 * ids[i]];
+            for (size_t j = i + 1; j < ids.size(); ++j)
+            {
+                const double *b = &bounds[4 * ids[j]];
+                if ((a[0] > b[1]) || (b[0] > a[1]) || 
+                        (a[2] > b[3]) || (b[2] > a[3]))
+                {
+                    continue;
+                }
+                // A pair of boxes can share several cells, so only report 
+                // it from the cell containing the corner of their 
+                // intersection.
+                long long key = cellKey(
+                        cellCoord(std::max(a[0], b[0]), cellSize),
+                        cellCoord(std::max(a[2], b[2]), cellSize));
+                if (key == cell->first)
+                {
+                    pairs.push_back(std::make_pair(ids[i], ids[j]));
+                }
+            }
+        }
+    }
+
+    std::vector<bool> isLarge(n, false);
+    for (size_t i = 0; i < large.size(); ++i)
+    {
+        isLarge[large[i]] = true;
+    }
+    for (size_t i = 0; i < large.size(); ++i)
+    {
+        const double *a = &bounds[4 * large[i]];
+        for (unsigned j = 0; j < n; ++j)
+        {
+            if ((j == large[i]) || (isLarge[j] && (j < large[i])))
+            {
+                continue;
+            }
+            const double *b = &bounds[4 * j];
+            if ((a[0] > b[1]) || (b[0] > a[1]) || 
+                    (a[2] > b[3]) || (b[2] > a[3]))
+            {
+                continue;
+            }
+            pairs.push_back(std::make_pair(std::min(large[i], j), 
+                    std::max(large[i], j)));
+        }
+    }
+
+    std::sort(pairs.begin(), pairs.end());
+}
+
+
 NonOverlapConstraints::NonOverlapConstraints(
         NonOverlapConstraintExemptions *exemptions, unsigned int priority)
     : CompoundConstraint(vpsc::HORIZONTAL, priority),
+      pairInfoListStart(0),
       pairInfoListSorted(false),
       initialSortCompleted(false),
+      pairPruningMargin(-1),
       m_exemptions(exemptions)
 {
     // All work is done by repeated addShape() calls.
 }
 
+void NonOverlapConstraints::setPairPruningMargin(const double margin)
+{
+    // The all-pairs list is built as shapes are added.
+    COLA_ASSERT(shapeOffsets.empty());
+    pairPruningMargin = margin;
+}
+
 void NonOverlapConstraints::addShape(unsigned id, double halfW, double halfH,
         unsigned int group)
 {
+    if (pairPruningMargin >= 0)
+    {
+        shapeOffsets[id] = OverlapShapeOffsets(id, halfW, halfH, group);
+        return;
+    }
+
     // Setup pairInfos for all other shapes. 
     for (std::map<unsigned, OverlapShapeOffsets>::iterator curr =
             shapeOffsets.begin(); curr != shapeOffsets.end(); ++curr)
@@ -203,6 +341,12 @@ void NonOverlapConstraints::addShape(unsigned id, double halfW, double halfH,
 void NonOverlapConstraints::addCluster(Cluster *cluster, unsigned int group)
 {
     unsigned id = cluster->clusterVarId;
+    if (pairPruningMargin >= 0)
+    {
+        shapeOffsets[id] = OverlapShapeOffsets(id, cluster, group);
+        return;
+    }
+
     // Setup pairInfos for all other shapes. 
     for (std::map<unsigned, OverlapShapeOffsets>::iterator curr =
             shapeOffsets.begin(); curr != shapeOffsets.end(); ++curr)
@@ -353,12 +497,141 @@ std::string NonOverlapConstraints::toString(void) const
     return stream.str();
 }
 
+void NonOverlapConstraints::compactPairInfoList(void)
+{
+    pairInfoList.erase(pairInfoList.begin(), 
+            pairInfoList.begin() + pairInfoListStart);
+    pairInfoListStart = 0;
+}
+
+void NonOverlapConstraints::setCandidatePairs(
+        const std::vector<double>& bounds)
+{
+    // Keep the processed pairs, since constraints have been chosen for 
+    // these, and replace the rest.
+    compactPairInfoList();
+    std::vector<ShapePairInfo> processedPairs;
+    std::set<ShapePair> processedSet;
+    for (size_t i = 0; i < pairInfoList.size(); ++i)
+    {
+        if (pairInfoList[i].processed)
+        {
+            processedPairs.push_back(pairInfoList[i]);
+            processedSet.insert(ShapePair(pairInfoList[i].varIndex1,
+                    pairInfoList[i].varIndex2));
+        }
+    }
+    pairInfoList.clear();
+
+    std::vector<const OverlapShapeOffsets *> shapes;
+    shapes.reserve(shapeOffsets.size());
+    for (std::map<unsigned, OverlapShapeOffsets>::const_iterator curr =
+            shapeOffsets.begin(); curr != shapeOffsets.end(); ++curr)
+    {
+        shapes.push_back(&curr->second);
+    }
+
+    std::vector<std::pair<unsigned, unsigned> > pairs;
+    findOverlappingBoxes(bounds, pairs);
+    for (size_t i = 0; i < pairs.size(); ++i)
+    {
+        const OverlapShapeOffsets *shape1 = shapes[pairs[i].first];
+        const OverlapShapeOffsets *shape2 = shapes[pairs[i].second];
+        if (shape1->group != shape2->group)
+        {
+            // Apply non-overlap only to objects in the same group (cluster).
+            continue;
+        }
+        // The same exemption test as addShape(), which also applies it 
+        // between shapes and clusters.
+        ShapePair shapePair(shape1->varIndex, shape2->varIndex);
+        if (m_exemptions && m_exemptions->shapePairIsExempt(shapePair))
+        {
+            continue;
+        }
+        if (processedSet.count(shapePair))
+        {
+            continue;
+        }
+        pairInfoList.push_back(
+                ShapePairInfo(shape1->varIndex, shape2->varIndex));
+    }
+    pairInfoList.insert(pairInfoList.end(), processedPairs.begin(),
+            processedPairs.end());
+}
+
+void NonOverlapConstraints::updateCandidatePairs(vpsc::Variables vs[])
+{
+    // Use the same bounds as computeOverlapForShapePairInfo().
+    const double halfMargin = pairPruningMargin / 2;
+    std::vector<double> bounds;
+    bounds.reserve(4 * shapeOffsets.size());
+    for (std::map<unsigned, OverlapShapeOffsets>::const_iterator curr =
+            shapeOffsets.begin(); curr != shapeOffsets.end(); ++curr)
+    {
+        const unsigned id = curr->first;
+        const OverlapShapeOffsets& shape = curr->second;
+        double xPos = vs[XDIM][id]->finalPosition;
+        double yPos = vs[YDIM][id]->finalPosition;
+        double left   = xPos - shape.halfDim[XDIM];
+        double right  = xPos + shape.halfDim[XDIM];
+        double bottom = yPos - shape.halfDim[YDIM];
+        double top    = yPos + shape.halfDim[YDIM];
+        if (shape.cluster)
+        {
+            right = vs[XDIM][id + 1]->finalPosition;
+            top   = vs[YDIM][id + 1]->finalPosition;
+            left -= shape.rectPadding.min(XDIM);
+            bottom -= shape.rectPadding.min(YDIM);
+            right += shape.rectPadding.max(XDIM);
+            top += shape.rectPadding.max(YDIM);
+        }
+        bounds.push_back(left - halfMargin);
+        bounds.push_back(right + halfMargin);
+        bounds.push_back(bottom - halfMargin);
+        bounds.push_back(top + halfMargin);
+    }
+    setCandidatePairs(bounds);
+}
+
+void NonOverlapConstraints::updateCandidatePairs(
+        std::vector<vpsc::Rectangle*>& boundingBoxes)
+{
+    // Use the same bounds as generateSeparationConstraints().
+    const double halfMargin = pairPruningMargin / 2;
+    std::vector<double> bounds;
+    bounds.reserve(4 * shapeOffsets.size());
+    for (std::map<unsigned, OverlapShapeOffsets>::const_iterator curr =
+            shapeOffsets.begin(); curr != shapeOffsets.end(); ++curr)
+    {
+        const OverlapShapeOffsets& shape = curr->second;
+        vpsc::Rectangle rect = (shape.cluster) ?
+                shape.cluster->margin().rectangleByApplyingBox(
+                        shape.cluster->bounds) :
+                *boundingBoxes[curr->first];
+        bounds.push_back(rect.getMinX() - halfMargin);
+        bounds.push_back(rect.getMaxX() + halfMargin);
+        bounds.push_back(rect.getMinY() - halfMargin);
+        bounds.push_back(rect.getMaxY() + halfMargin);
+    }
+    setCandidatePairs(bounds);
+}
+
 void NonOverlapConstraints::computeAndSortOverlap(vpsc::Variables vs[])
 {
-    for (std::list<ShapePairInfo>::iterator curr = pairInfoList.begin();
+    if (pairPruningMargin >= 0)
+    {
+        updateCandidatePairs(vs);
+    }
+    else
+    {
+        compactPairInfoList();
+    }
+
+    for (std::vector<ShapePairInfo>::iterator curr = pairInfoList.begin();
             curr != pairInfoList.end(); ++curr)
     {
-        ShapePairInfo& info = static_cast<ShapePairInfo&> (*curr);
+        ShapePairInfo& info = *curr;
         
         if (info.processed)
         {
@@ -369,14 +642,14 @@ void NonOverlapConstraints::computeAndSortOverlap(vpsc::Variables vs[])
         }
         computeOverlapForShapePairInfo(info, vs);
     }
-    pairInfoList.sort();
+    std::stable_sort(pairInfoList.begin(), pairInfoList.end());
 }
 
 
 void NonOverlapConstraints::markCurrSubConstraintAsActive(const bool satisfiable)
 {
-    ShapePairInfo info = pairInfoList.front();
-    pairInfoList.pop_front();
+    ShapePairInfo info = pairInfoList[pairInfoListStart];
+    ++pairInfoListStart;
 
     info.processed = true;
     info.satisfied = satisfiable;
@@ -400,8 +673,15 @@ NonOverlapConstraints::getCurrSubConstraintAlternatives(vpsc::Variables vs[])
         initialSortCompleted = true;
     }
 
+    if (pairInfoListStart == pairInfoList.size())
+    {
+        // There are no candidate pairs.
+        _currSubConstraintIndex = 0;
+        return alternatives;
+    }
+
     // Take the first in the list.
-    ShapePairInfo& info = pairInfoList.front();
+    ShapePairInfo& info = pairInfoList[pairInfoListStart];
     if (pairInfoListSorted == false)
     {
         // Only need to compute if not sorted.
@@ -414,7 +694,7 @@ NonOverlapConstraints::getCurrSubConstraintAlternatives(vpsc::Variables vs[])
         {
             // Seeing no overlap in the sorted list means we have solved
             // all non-overlap.  Nothing more to do.
-            _currSubConstraintIndex = pairInfoList.size();
+            _currSubConstraintIndex = pairInfoList.size() - pairInfoListStart;
             return alternatives;
         }
         computeAndSortOverlap(vs);
@@ -512,7 +792,6 @@ NonOverlapConstraints::getCurrSubConstraintAlternatives(vpsc::Variables vs[])
     if (umlEdgeLabelStartIndex > 2 && shapeEndIndex < umlEdgeLabelStartIndex
             && varIndexL2 >= umlEdgeLabelStartIndex && varIndexL1 <= shapeEndIndex && (dummyIndex = umlMidLabelDummyNodeMap[varIndexL2]) > 1)
     {
-        std::cout << "Hurrah~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~" << std::endl;
         // label = varIndexL2;
         // shape = varIndexL1;
 
@@ -521,29 +800,22 @@ NonOverlapConstraints::getCurrSubConstraintAlternatives(vpsc::Variables vs[])
         double shapeX = rs[varIndexL1]->getCentreX();
         double shapeY = rs[varIndexL1]->getCentreY();
 
-        std::cout << "Shape Position: " << shapeX << ", " << shapeY << std::endl;
-        std::cout << "dummy Position: " << dummyX << ", " << dummyY << std::endl;
-
         if (shapeX < dummyX)
         {
             shapeOnTheLeftOfDummy = true;
-            std::cout << "5. shape " << varIndexL1 << " on the left of dummy " << dummyIndex <<std::endl;
         }
         else if (dummyX < shapeX)
         {
             shapeOnTheRightOfDummy = true;
-            std::cout << "6. shape " << varIndexL1 << " on the right of dummy " << dummyIndex <<std::endl;
         }
 
         if (shapeY < dummyY)
         {
             shapeAboveDummy = true;
-            std::cout << "7. shape " << varIndexL1 << " on the above of dummy " << dummyIndex <<std::endl;
         }
         else if (dummyY < shapeY)
         {
             shapeBelowDummy = true;
-            std::cout << "8. shape " << varIndexL1 << " on the below of dummy " << dummyIndex <<std::endl;
         }
     }
 
@@ -601,13 +873,19 @@ NonOverlapConstraints::getCurrSubConstraintAlternatives(vpsc::Variables vs[])
 bool NonOverlapConstraints::subConstraintsRemaining(void) const
 {
     //printf(". %3d of %4d\n", _currSubConstraintIndex, pairInfoList.size());
-    return _currSubConstraintIndex < pairInfoList.size();
+    if ((pairPruningMargin >= 0) && !initialSortCompleted)
+    {
+        // The candidate pairs haven't been found yet.
+        return true;
+    }
+    return _currSubConstraintIndex < pairInfoList.size() - pairInfoListStart;
 }
 
 
 void NonOverlapConstraints::markAllSubConstraintsAsInactive(void)
 {
-    for (std::list<ShapePairInfo>::iterator curr = pairInfoList.begin();
+    compactPairInfoList();
+    for (std::vector<ShapePairInfo>::iterator curr = pairInfoList.begin();
             curr != pairInfoList.end(); ++curr)
     {
         ShapePairInfo& info = (*curr);
@@ -623,7 +901,13 @@ void NonOverlapConstraints::generateSeparationConstraints(
         const vpsc::Dim dim, vpsc::Variables& vs, vpsc::Constraints& cs,
         std::vector<vpsc::Rectangle*>& boundingBoxes) 
 {
-    for (std::list<ShapePairInfo>::iterator info = pairInfoList.begin();
+    if (pairPruningMargin >= 0)
+    {
+        updateCandidatePairs(boundingBoxes);
+    }
+
+    for (std::vector<ShapePairInfo>::iterator info = 
+            pairInfoList.begin() + pairInfoListStart;
             info != pairInfoList.end(); ++info)
     {
         assertValidVariableIndex(vs, info->varIndex1);
@@ -71,6 +71,14 @@ class NonOverlapConstraints : public CompoundConstraint {
         void addShape(unsigned id, double halfW, double halfH, 
                 unsigned int group = 1);
         void addCluster(Cluster *cluster, unsigned int group);
+        // Only consider pairs of shapes whose bounding boxes, each expanded
+        // by half of margin, overlap.  These candidate pairs are found
+        // with a spatial hash and recomputed from the current positions
+        // whenever constraints are generated, rather than keeping every
+        // pair.  Shapes more than margin apart may then cross each other
+        // within a single solver pass.  A negative margin (the default)
+        // keeps all pairs.  Must be called before any shapes are added.
+        void setPairPruningMargin(const double margin);
         void computeAndSortOverlap(vpsc::Variables vs[]);
         void markCurrSubConstraintAsActive(const bool satisfiable);
         void markAllSubConstraintsAsInactive(void);
@@ -89,11 +97,20 @@ class NonOverlapConstraints : public CompoundConstraint {
     private:
         void computeOverlapForShapePairInfo(ShapePairInfo& info,
                 vpsc::Variables vs[]);
+        void compactPairInfoList(void);
+        void updateCandidatePairs(vpsc::Variables vs[]);
+        void updateCandidatePairs(
+                std::vector<vpsc::Rectangle*>& boundingBoxes);
+        void setCandidatePairs(const std::vector<double>& bounds);
         
-        std::list<ShapePairInfo> pairInfoList;
+        // Pairs before pairInfoListStart have been moved to the back of
+        // the list by markCurrSubConstraintAsActive() and are ignored.
+        std::vector<ShapePairInfo> pairInfoList;
+        size_t pairInfoListStart;
         std::map<unsigned, OverlapShapeOffsets> shapeOffsets;
         bool pairInfoListSorted;
         bool initialSortCompleted;
+        double pairPruningMargin;
 
         // Cluster variables
         size_t clusterVarStartIndex;
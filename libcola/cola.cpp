@@ -29,6 +29,7 @@
 #include "libcola/straightener.h"
 #include "libcola/shortest_paths.h"
 #include "libcola/cluster.h"
+#include "libcola/stress_kernels.h"
 
 using namespace std;
 using namespace vpsc;
@@ -46,8 +47,6 @@ ConstrainedMajorizationLayout
         TestConvergence *doneTest,
         PreIteration* preIteration)
     : n(rs.size()),
-      lap2(valarray<double>(n*n)), 
-      Dij(valarray<double>(n*n)),
       tol(1e-7),
       done(doneTest),
       using_default_done(false),
@@ -55,6 +54,7 @@ ConstrainedMajorizationLayout
       X(valarray<double>(n)), Y(valarray<double>(n)),
       stickyNodes(false), 
       startX(valarray<double>(n)), startY(valarray<double>(n)),
+      edge_length(idealLength),
       constrainedLayout(false),
       nonOverlappingClusters(false),
       clusterHierarchy(clusterHierarchy),
@@ -67,7 +67,12 @@ ConstrainedMajorizationLayout
       xSkipping(true),
       scaling(true),
       externalSolver(false),
-      majorization(true)
+      majorization(true),
+      m_edges(es),
+      m_edge_lengths(eLengths.data(), eLengths.size()),
+      m_path_lengths_computed(false),
+      m_sparse_pivots(0),
+      m_laplacian(NULL)
 {
     if (done == NULL)
     {
@@ -82,26 +87,49 @@ ConstrainedMajorizationLayout
 
     COLA_ASSERT(!straightenEdges||straightenEdges->size()==es.size());
 
-    double** D=new double*[n];
-    for(unsigned i=0;i<n;i++) {
-        D[i]=new double[n];
-    }
-
-    std::valarray<double> edgeLengths(eLengths.data(), eLengths.size());
     // Correct zero or negative entries in eLengths array.
-    for (size_t i = 0; i < edgeLengths.size(); ++i)
+    for (size_t i = 0; i < m_edge_lengths.size(); ++i)
     {
-        if (edgeLengths[i] <= 0)
+        if (m_edge_lengths[i] <= 0)
         {
             fprintf(stderr, "Warning: ignoring non-positive length at index %d "
                     "in ideal edge length array.\n", (int) i);
-            edgeLengths[i] = 1;
+            m_edge_lengths[i] = 1;
         }
     }
 
-    shortest_paths::johnsons(n,D,es,edgeLengths);
-    //shortest_paths::neighbours(n,D,es,edgeLengths);
-    edge_length = idealLength;
+    for(unsigned i = 0; i<n; i++) {
+        X[i]=rs[i]->getCentreX();
+        Y[i]=rs[i]->getCentreY();
+    }
+}
+void ConstrainedMajorizationLayout::setSparseStress(const unsigned pivots) {
+    if (pivots != m_sparse_pivots) {
+        m_sparse_pivots = pivots;
+        m_path_lengths_computed = false;
+    }
+}
+void ConstrainedMajorizationLayout::computePathLengths() {
+    m_path_lengths_computed = true;
+    lap2.resize(0);
+    Dij.resize(0);
+    m_terms.clear();
+    delete m_laplacian;
+    m_laplacian = NULL;
+    if(m_sparse_pivots > 0) {
+        computeSparsePathLengths();
+        return;
+    }
+    lap2.resize(n*n);
+    Dij.resize(n*n);
+
+    double** D=new double*[n];
+    for(unsigned i=0;i<n;i++) {
+        D[i]=new double[n];
+    }
+
+    shortest_paths::johnsons(n,D,m_edges,m_edge_lengths);
+    //shortest_paths::neighbours(n,D,m_edges,m_edge_lengths);
     if(clusterHierarchy) {
         for(Clusters::const_iterator i=clusterHierarchy->clusters.begin();
                 i!=clusterHierarchy->clusters.end();i++) {
@@ -118,8 +146,6 @@ ConstrainedMajorizationLayout
     // Lij_{i!=j}=1/(Dij^2)
     //
     for(unsigned i = 0; i<n; i++) {
-        X[i]=rs[i]->getCentreX();
-        Y[i]=rs[i]->getCentreY();
         double degree = 0;
         for(unsigned j=0;j<n;j++) {
             double d = edge_length * D[i][j];
@@ -132,11 +158,89 @@ ConstrainedMajorizationLayout
             degree += lap2[i*n + j] = lij;
         }
         lap2[i*n + i]=-degree;
+        if(stickyNodes) {
+            lap2[i*n + i]-=stickyWeight;
+        }
         delete [] D[i];
     }
     //GradientProjection::dumpSquareMatrix(Dij);
     delete [] D;
 }
+/*
+ * Sets up the sparse stress model: a term for each edge, with weight
+ * 1/d^2 as in the full model, and a term between each node and each 
+ * pivot, with the weight multiplied by the number of nodes the pivot
+ * represents.  The laplacian has the same form as lap2 in the full model.
+ */
+void ConstrainedMajorizationLayout::computeSparsePathLengths() {
+    const unsigned k=std::min(m_sparse_pivots,n);
+    vector<unsigned> pivots;
+    vector<double> distances;
+    vector<unsigned> weights;
+    shortest_paths::pivots(n,k,m_edges,m_edge_lengths,edge_length,
+            pivots,distances,weights);
+
+    // The clusters each node is in, to shorten the distances within 
+    // clusters as for the full model.
+    vector<vector<Cluster*> > nodeClusters(n);
+    if(clusterHierarchy) {
+        for(Clusters::const_iterator i=clusterHierarchy->clusters.begin();
+                i!=clusterHierarchy->clusters.end();i++) {
+            for(vector<unsigned>::iterator j=(*i)->nodes.begin();
+                    j!=(*i)->nodes.end();j++) {
+                nodeClusters[*j].push_back(*i);
+            }
+        }
+    }
+
+    for(unsigned i=0;i<m_edges.size();i++) {
+        StressTerm t;
+        t.u=m_edges[i].first;
+        t.v=m_edges[i].second;
+        t.d=edge_length*
+            ((m_edge_lengths.size()>0)?m_edge_lengths[i]:1);
+        t.w=1;
+        if(t.u!=t.v) {
+            m_terms.push_back(t);
+        }
+    }
+    for(unsigned p=0;p<k;p++) {
+        for(unsigned i=0;i<n;i++) {
+            StressTerm t;
+            t.u=i;
+            t.v=pivots[p];
+            t.d=distances[p*n+i];
+            t.w=weights[i*k+p];
+            if(t.w>0) {
+                m_terms.push_back(t);
+            }
+        }
+    }
+
+    m_laplacian_map.resize(n);
+    m_laplacian_map.clearPattern();
+    for(unsigned i=0;i<m_terms.size();i++) {
+        StressTerm& t=m_terms[i];
+        for(unsigned c=0;c<nodeClusters[t.u].size();c++) {
+            Cluster* cluster=nodeClusters[t.u][c];
+            if(find(nodeClusters[t.v].begin(),nodeClusters[t.v].end(),
+                        cluster)!=nodeClusters[t.v].end()) {
+                t.d/=cluster->internalEdgeWeightFactor;
+            }
+        }
+        t.w/=t.d*t.d;
+        m_laplacian_map(t.u,t.v)+=t.w;
+        m_laplacian_map(t.v,t.u)+=t.w;
+        m_laplacian_map(t.u,t.u)-=t.w;
+        m_laplacian_map(t.v,t.v)-=t.w;
+    }
+    if(stickyNodes) {
+        for(unsigned i=0;i<n;i++) {
+            m_laplacian_map(i,i)-=stickyWeight;
+        }
+    }
+    m_laplacian=new SparseMatrix(m_laplacian_map);
+}
 // stickyNodes adds a small force attracting nodes 
 // back to their starting positions
 void ConstrainedMajorizationLayout::setStickyNodes(
@@ -151,6 +255,18 @@ void ConstrainedMajorizationLayout::setStickyNodes(
     this->stickyWeight=stickyWeight;
     this->startX = startX;
     this->startY = startY;
+    if(!m_path_lengths_computed) {
+        // The weight is added to the laplacian when it is computed.
+        return;
+    }
+    if(m_laplacian) {
+        for(unsigned i = 0; i<n; i++) {
+            m_laplacian_map(i,i)-=stickyWeight;
+        }
+        delete m_laplacian;
+        m_laplacian=new SparseMatrix(m_laplacian_map);
+        return;
+    }
     for(unsigned i = 0; i<n; i++) {
         lap2[i*n+i]-=stickyWeight;
     }
@@ -161,6 +277,10 @@ void ConstrainedMajorizationLayout::majorize(
         valarray<double>& coords,
         valarray<double> const & startCoords)
 {
+    if(m_laplacian) {
+        majorizeSparse(gp,coords,startCoords);
+        return;
+    }
     double L_ij,dist_ij,degree;
     /* compute the vector b */
     /* multiply on-the-fly with distance-based laplacian */
@@ -196,12 +316,47 @@ void ConstrainedMajorizationLayout::majorize(
     }
     moveBoundingBoxes();
 }
+/*
+ * As majorize(), but for the sparse stress model.  The terms of b are
+ * w*d/dist*(coords[v]-coords[u]) for each stress term, as for the full 
+ * model where w=1/(d*d).
+ */
+void ConstrainedMajorizationLayout::majorizeSparse(
+        GradientProjection* gp, valarray<double>& coords,
+        valarray<double> const & startCoords)
+{
+    valarray<double> b(n);
+    for (unsigned i = 0; i < m_terms.size(); i++) {
+        const StressTerm& t = m_terms[i];
+        double dist = euclidean_distance(t.u, t.v);
+        /* skip zero distances */
+        if (dist > 1e-30 && t.d > 1e-30 && t.d < 1e10) {
+            double L = t.w * t.d / dist;
+            double delta = L * (coords[t.v] - coords[t.u]);
+            b[t.u] += delta;
+            b[t.v] -= delta;
+        }
+    }
+    for (unsigned i = 0; i < n; i++) {
+        if(stickyNodes) {
+            b[i] -= stickyWeight*startCoords[i];
+        }
+        COLA_ASSERT(!isNaN(b[i]));
+    }
+    if(constrainedLayout) {
+        gp->solve(b,coords);
+    } else {
+        conjugate_gradient(*m_laplacian, coords, b, n, tol, n);
+    }
+    moveBoundingBoxes();
+}
 void ConstrainedMajorizationLayout::newton(
         valarray<double> const & Dij, GradientProjection* gp, 
         valarray<double>& coords,
         valarray<double> const & startCoords)
 {
     COLA_UNUSED(startCoords);
+    COLA_ASSERT(!m_laplacian);
     /* compute the vector b */
     /* multiply on-the-fly with distance-based laplacian */
     valarray<double> b(n);
@@ -280,15 +435,35 @@ void ConstrainedMajorizationLayout::newton(
 }
 inline double ConstrainedMajorizationLayout
 ::compute_stress(valarray<double> const &Dij) {
-    double sum = 0, d, diff;
+    double sum = 0;
+    if(m_laplacian) {
+        // Each term is computed as for majorizationStressTerms(), but
+        // weighted.
+        for (unsigned i = 0; i < m_terms.size(); i++) {
+            const StressTerm& t = m_terms[i];
+            double diff = t.d - euclidean_distance(t.u, t.v);
+            if(t.d > 80 && diff < 0) {
+                continue;
+            }
+            sum += t.w * diff * diff;
+        }
+        if(stickyNodes) {
+            for (unsigned i = 0; i < n; i++) {
+                double l = startX[i]-X[i];
+                sum += stickyWeight*l*l;
+                l = startY[i]-Y[i];
+                sum += stickyWeight*l*l;
+            }
+        }
+        return sum;
+    }
+    // Terms are computed several pairs at a time but summed in order, see
+    // stress_kernels.h.
+    valarray<double> s(n);
     for (unsigned i = 1; i < n; i++) {
+        majorizationStressTerms(i, X[i], Y[i], &X[0], &Y[0], &Dij[i*n], &s[0]);
         for (unsigned j = 0; j < i; j++) {
-            d = Dij[i*n+j];
-            if(!isinf(d)&&d!=numeric_limits<double>::max()) {
-                diff = d - euclidean_distance(i,j);
-                if(d>80&&diff<0) continue;
-                sum += diff*diff / (d*d);
-            }
+            sum += s[j];
         }
         if(stickyNodes) {
             double l = startX[i]-X[i];
@@ -301,20 +476,30 @@ inline double ConstrainedMajorizationLayout
     return sum;
 }
 
+GradientProjection* ConstrainedMajorizationLayout::createSolver(
+        const Dim dim, UnsatisfiableConstraintInfos *unsatisfiable) {
+    vector<vpsc::Rectangle*>* pbb = boundingBoxes.empty()?NULL:&boundingBoxes;
+    SolveWithMosek mosek = Off;
+    if(externalSolver) mosek=Outer;
+    if(m_laplacian) {
+        return new GradientProjection(
+            dim,m_laplacian,tol,100,ccs,unsatisfiable,
+            avoidOverlaps,clusterHierarchy,pbb,scaling,mosek);
+    }
+    return new GradientProjection(
+        dim,&lap2,tol,100,ccs,unsatisfiable,
+        avoidOverlaps,clusterHierarchy,pbb,scaling,mosek);
+}
 void ConstrainedMajorizationLayout::run(bool x, bool y) {
+    if(!m_path_lengths_computed) {
+        computePathLengths();
+    }
     if(constrainedLayout) {
-        vector<vpsc::Rectangle*>* pbb = boundingBoxes.empty()?NULL:&boundingBoxes;
-        SolveWithMosek mosek = Off;
-        if(externalSolver) mosek=Outer;
         // scaling doesn't currently work with straighten edges because sparse
         // matrix used with dummy nodes is not properly scaled at the moment.
         if(straightenEdges) setScaling(false);
-        gpX=new GradientProjection(
-            HORIZONTAL,&lap2,tol,100,ccs,unsatisfiableX,
-            avoidOverlaps,clusterHierarchy,pbb,scaling,mosek);
-        gpY=new GradientProjection(
-            VERTICAL,&lap2,tol,100,ccs,unsatisfiableY,
-            avoidOverlaps,clusterHierarchy,pbb,scaling,mosek);
+        gpX=createSolver(HORIZONTAL,unsatisfiableX);
+        gpY=createSolver(VERTICAL,unsatisfiableY);
     }
     if(n>0) do {
         // to enforce clusters with non-intersecting, convex boundaries we
@@ -377,22 +562,21 @@ void ConstrainedMajorizationLayout::run(bool x, bool y) {
     } while(!(*done)(compute_stress(Dij),X,Y));
 }
 double ConstrainedMajorizationLayout::computeStress() {
+    if(!m_path_lengths_computed) {
+        computePathLengths();
+    }
     return compute_stress(Dij);
 }
 void ConstrainedMajorizationLayout::runOnce(bool x, bool y) {
+    if(!m_path_lengths_computed) {
+        computePathLengths();
+    }
     if(constrainedLayout) {
-        vector<vpsc::Rectangle*>* pbb = boundingBoxes.empty()?NULL:&boundingBoxes;
-        SolveWithMosek mosek = Off;
-        if(externalSolver) mosek=Outer;
         // scaling doesn't currently work with straighten edges because sparse
         // matrix used with dummy nodes is not properly scaled at the moment.
         if(straightenEdges) setScaling(false);
-        gpX=new GradientProjection(
-            HORIZONTAL,&lap2,tol,100,ccs,unsatisfiableX,
-            avoidOverlaps,clusterHierarchy,pbb,scaling,mosek);
-        gpY=new GradientProjection(
-            VERTICAL,&lap2,tol,100,ccs,unsatisfiableY,
-            avoidOverlaps,clusterHierarchy,pbb,scaling,mosek);
+        gpX=createSolver(HORIZONTAL,unsatisfiableX);
+        gpY=createSolver(VERTICAL,unsatisfiableY);
     }
     if(n>0) {
         // to enforce clusters with non-intersecting, convex boundaries we
@@ -26,10 +26,12 @@
 #include <utility>
 #include <iterator>
 #include <vector>
+#include <map>
 #include <valarray>
 #include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <functional>
 
 #include "libcola/gradient_projection.h"
 #include "libcola/cluster.h"
@@ -52,6 +54,7 @@ namespace cola {
 
 class NonOverlapConstraints;
 class NonOverlapConstraintExemptions;
+class ThreadPool;
 
 //! Edges are simply a pair of indices to entries in the Node vector
 typedef std::pair<unsigned, unsigned> Edge;
@@ -330,6 +333,30 @@ public:
     void setScaling(bool scaling) {
         this->scaling=scaling;
     }
+    /**
+     * @brief  Use the sparse stress model, so that the laplacian and the
+     *         ideal distances are stored as sparse matrices.
+     *
+     * By default the layout stores the shortest path distances and the
+     * weighted laplacian for all pairs of nodes, which needs memory
+     * quadratic in the number of nodes, and each iteration of the solver
+     * takes quadratic time.  In the sparse stress model the given number
+     * of pivot nodes are chosen and the stress only has terms for each 
+     * edge and between each node and each pivot, weighted by the number
+     * of nodes the pivot represents (see shortest_paths::pivots()).  The
+     * laplacian then has a number of entries linear in the number of
+     * nodes and edges, and the gradient projection solver works directly
+     * on it.
+     *
+     * Path lengths are computed when first needed, so this should be 
+     * called before run(), runOnce(), computeStress() or setStickyNodes().
+     * Newton iterations are not supported with the sparse model.
+     *
+     * @param[in] pivots  The number of pivot nodes, typically 50 to 200.
+     *                    A value of zero (the default) uses the full 
+     *                    stress model.
+     */
+    void setSparseStress(const unsigned pivots);
     /**
      * Says that the Mosek optimisation library should be used to solve the 
      * quadratic programs rather than the libvpsc solver.
@@ -392,6 +419,7 @@ public:
             delete gpX;
             delete gpY;
         }
+        delete m_laplacian;
     }
     /**
      * @brief  Implements the main layout loop, taking descent steps until
@@ -426,8 +454,13 @@ private:
             (X[i] - X[j]) * (X[i] - X[j]) +
             (Y[i] - Y[j]) * (Y[i] - Y[j]));
     }
+    void computePathLengths();
+    void computeSparsePathLengths();
+    GradientProjection* createSolver(const vpsc::Dim dim,
+            UnsatisfiableConstraintInfos *unsatisfiable);
     double compute_stress(std::valarray<double> const & Dij);
     void majorize(std::valarray<double> const & Dij,GradientProjection* gp, std::valarray<double>& coords, std::valarray<double> const & startCoords);
+    void majorizeSparse(GradientProjection* gp, std::valarray<double>& coords, std::valarray<double> const & startCoords);
     void newton(std::valarray<double> const & Dij,GradientProjection* gp, std::valarray<double>& coords, std::valarray<double> const & startCoords);
     unsigned n; //< number of nodes
     //std::valarray<double> degrees;
@@ -496,6 +529,25 @@ private:
      */
     bool externalSolver;
     bool majorization;
+    /*
+     * The edges are kept so that the path lengths can be computed when
+     * they are first needed, after setSparseStress() may have been called.
+     */
+    std::vector<Edge> m_edges;
+    std::valarray<double> m_edge_lengths;
+    bool m_path_lengths_computed;
+    unsigned m_sparse_pivots;
+    /*
+     * The stress terms and laplacian for the sparse stress model.  Each
+     * term is a pair of nodes, its ideal distance and its weight.
+     */
+    struct StressTerm {
+        unsigned u, v;
+        double d, w;
+    };
+    std::vector<StressTerm> m_terms;
+    SparseMap m_laplacian_map;
+    SparseMatrix *m_laplacian;
 };
 
 vpsc::Rectangle bounds(vpsc::Rectangles& rs);
@@ -687,6 +739,94 @@ public:
     void setDesiredPositions(DesiredPositions *desiredPositions) {
         this->desiredPositions = desiredPositions;
     }
+    /**
+     * @brief  Approximate the stress between distant groups of nodes, to 
+     *         make each iteration of layout near linear in the number of 
+     *         nodes rather than quadratic.
+     *
+     * A quadtree is built over the node positions and, for each node, any
+     * cell of the tree that is small relative to its distance from the 
+     * node is treated as a single node at the cell's centroid (this is the
+     * Barnes-Hut approximation).  Forces between nodes connected by an 
+     * edge are always computed exactly.  The approximation is used both 
+     * for the forces and for the stress reported by computeStress(), and
+     * the resulting descent vectors are projected onto the constraints as
+     * usual.
+     *
+     * Smaller values of theta are more accurate but slower.  With 
+     * theta = 0.5 the approximated stress is typically within 1% of the
+     * exact value, and within 5% for theta = 1.
+     *
+     * @param[in] theta  The ratio of cell size to distance below which a
+     *                   cell is approximated.  A value of zero (the 
+     *                   default) disables the approximation.
+     */
+    void setForceApproximation(const double theta)
+    {
+        m_approx_theta = std::max(0.0, theta);
+    }
+    /**
+     * @brief  Use the sparse stress model, so that only the distances to
+     *         a small number of pivot nodes need to be stored.
+     *
+     * By default the layout computes and stores the shortest path 
+     * distances between all pairs of nodes, which needs memory quadratic
+     * in the number of nodes.  In the sparse stress model the given number
+     * of pivot nodes are chosen, spread evenly through the graph, and only
+     * the shortest paths from these to every node are computed.  The 
+     * stress then consists of terms for each edge plus terms between each
+     * node and each pivot, weighted by the number of nodes the pivot 
+     * represents.  Constraints, clusters and topology addons are applied 
+     * as for the full model, and the force approximation is not used.
+     *
+     * Path lengths are computed when first needed, so this should be 
+     * called before run(), runOnce() or computeStress().
+     *
+     * @param[in] pivots  The number of pivot nodes, typically 50 to 200.
+     *                    A value of zero (the default) uses the full 
+     *                    stress model.
+     */
+    void setSparseStress(const unsigned pivots);
+    /**
+     * @brief  Only generate non-overlap constraints between nearby pairs
+     *         of nodes and clusters.
+     *
+     * By default every pair of nodes in the same cluster is considered
+     * for non-overlap, which needs time and memory quadratic in the 
+     * number of nodes.  With this option the pairs are instead found with
+     * a spatial hash each time constraints are generated, and only pairs
+     * whose bounding boxes are within the given margin of each other are
+     * kept.  Nodes further apart than this may pass through each other
+     * in a single iteration, so the margin should be at least the 
+     * distance nodes move per iteration.
+     *
+     * This must be called before makeFeasible() or run().
+     *
+     * @param[in] margin  The distance within which pairs are considered.
+     *                    A negative value (the default) considers all 
+     *                    pairs.
+     */
+    void setNonOverlapPairPruning(const double margin)
+    {
+        m_nonoverlap_margin = margin;
+    }
+    /**
+     * @brief  Set the number of threads used to compute the forces, the
+     *         stress and the shortest path lengths between nodes.
+     *
+     * The nodes are split into one contiguous range per thread, and the
+     * stress of each range is summed in node order before the ranges are
+     * added up, so the layout is the same on every run with a given 
+     * number of threads.  With one thread the results are exactly those 
+     * of a single sequential pass.  Graphs of fewer than 128 nodes are 
+     * always laid out on the calling thread.
+     *
+     * @param[in] threads  The number of threads, including the calling
+     *                     thread.  A value of one (the default) does all 
+     *                     the work on the calling thread, and a value of
+     *                     zero uses one thread per hardware thread.
+     */
+    void setThreadCount(const unsigned threads);
     /**
      * @brief  Specifies an optional hierarchy for clustering nodes.
      *
@@ -800,8 +940,15 @@ private:
             const double oldStress, 
             double stepsize
             /*,topology::TopologyConstraints *s=NULL*/);
-    void computePathLengths(
-            const std::vector<Edge>& es, std::valarray<double> eLengths);
+    void setupPathLengths(void) const;
+    void freePathLengths(void);
+    void addNeighbours(const unsigned u, const unsigned v, 
+            const double length) const;
+    void uniqueNeighbours(void) const;
+    void computePathLengths(const std::vector<Edge>& es, 
+            const std::valarray<double>& eLengths) const;
+    void computeSparsePathLengths(const std::vector<Edge>& es, 
+            const std::valarray<double>& eLengths) const;
     void generateNonOverlapAndClusterCompoundConstraints(
             vpsc::Variables (&vs)[2]);
     void handleResizes(const Resizes&);
@@ -810,19 +957,42 @@ private:
     bool noForces(double, double, unsigned) const;
     void computeForces(const vpsc::Dim dim, SparseMap &H, 
             std::valarray<double> &g);
+    void computeApproximateForces(const vpsc::Dim dim, SparseMap &H, 
+            std::valarray<double> &g);
+    double computeApproximateStress() const;
+    void computeSparseForces(const vpsc::Dim dim, SparseMap &H, 
+            std::valarray<double> &g);
+    double computeSparseStress() const;
+    void parallelFor(const unsigned count, 
+            const std::function<void(unsigned,unsigned,unsigned)>& f) const;
+    unsigned chunkCount() const;
     void recGenerateClusterVariablesAndConstraints(
             vpsc::Variables (&vars)[2], unsigned int& priority, 
             cola::NonOverlapConstraints *noc, Cluster *cluster, 
             cola::CompoundConstraints& idleConstraints);
 
-    std::vector<std::vector<unsigned> > neighbours;
-    std::vector<std::vector<double> > neighbourLengths;
+    // The path lengths below are set up lazily by setupPathLengths(), 
+    // which may be called from computeStress().
+    mutable std::vector<std::vector<unsigned> > neighbours;
+    mutable std::vector<std::vector<double> > neighbourLengths;
     TestConvergence *done;
     bool using_default_done; // Whether we allocated a default TestConvergence object.
     PreIteration* preIteration;
     cola::CompoundConstraints ccs;
-    double** D;
-    unsigned short** G;
+    mutable double** D;
+    mutable unsigned short** G;
+    // For the sparse stress model: the pivot nodes, the k*n distances 
+    // from each pivot to every node, and the n*k weights of the terms 
+    // between each node and each pivot.
+    mutable std::vector<unsigned> m_pivots;
+    mutable std::vector<double> m_pivot_distances;
+    mutable std::vector<unsigned> m_pivot_weights;
+    // The connected component of each node, for the dense model.
+    mutable std::vector<unsigned> m_components;
+    // Hessian storage, reused between iterations.
+    SparseMap m_hessian;
+    unsigned m_threads;
+    mutable ThreadPool *m_thread_pool;
 
     TopologyAddonInterface *topologyAddon;
     std::vector<UnsatisfiableConstraintInfos*> unsatisfiable;
@@ -833,7 +1003,11 @@ private:
     RootCluster *clusterHierarchy;
     double rectClusterBuffer;
     double m_idealEdgeLength;
+    double m_approx_theta;
+    unsigned m_sparse_pivots;
+    double m_nonoverlap_margin;
     bool m_generateNonOverlapConstraints;
+    const std::vector<Edge> m_edges;
     const std::valarray<double> m_edge_lengths;
 
     NonOverlapConstraintExemptions *m_nonoverlap_exemptions;
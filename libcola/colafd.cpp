@@ -39,6 +39,9 @@
 #include "libcola/straightener.h"
 #include "libcola/cc_clustercontainmentconstraints.h"
 #include "libcola/cc_nonoverlapconstraints.h"
+#include "libcola/quadtree.h"
+#include "libcola/stress_kernels.h"
+#include "libcola/parallel.h"
 
 #ifdef MAKEFEASIBLE_DEBUG
   #include "libcola/output_svg.h"
@@ -94,13 +97,21 @@ ConstrainedFDLayout::ConstrainedFDLayout(const vpsc::Rectangles& rs,
       done(doneTest),
       using_default_done(false),
       preIteration(preIteration),
+      D(NULL),
+      G(NULL),
+      m_threads(1),
+      m_thread_pool(NULL),
       topologyAddon(new TopologyAddonInterface()),
       rungekutta(true),
       desiredPositions(NULL),
       clusterHierarchy(NULL),
       rectClusterBuffer(0),
       m_idealEdgeLength(idealLength),
+      m_approx_theta(0),
+      m_sparse_pivots(0),
+      m_nonoverlap_margin(-1),
       m_generateNonOverlapConstraints(preventOverlaps),
+      m_edges(es),
       m_edge_lengths(eLengths.data(), eLengths.size()),
       m_nonoverlap_exemptions(new NonOverlapConstraintExemptions())
 {
@@ -120,14 +131,6 @@ ConstrainedFDLayout::ConstrainedFDLayout(const vpsc::Rectangles& rs,
         Y[i]=(*ri)->getCentreY();
         FILE_LOG(logDEBUG) << *ri;
     }
-    D=new double*[n];
-    G=new unsigned short*[n];
-    for(unsigned i=0;i<n;i++) {
-        D[i]=new double[n];
-        G[i]=new unsigned short[n];
-    }
-
-    computePathLengths(es,m_edge_lengths);
 }
 
 void dijkstra(const unsigned s, const unsigned n, double* d, 
@@ -136,6 +139,162 @@ void dijkstra(const unsigned s, const unsigned n, double* d,
     shortest_paths::dijkstra(s,n,d,es,eLengths);
 }
 
+void ConstrainedFDLayout::setSparseStress(const unsigned pivots)
+{
+    if (pivots != m_sparse_pivots)
+    {
+        freePathLengths();
+        m_sparse_pivots = pivots;
+    }
+}
+
+void ConstrainedFDLayout::setThreadCount(const unsigned threads)
+{
+    if (threads != m_threads)
+    {
+        delete m_thread_pool;
+        m_thread_pool = NULL;
+        m_threads = threads;
+    }
+}
+
+/*
+ * The forces and stress for each node are computed independently, in
+ * parallel, but only if each thread gets at least this many nodes.
+ */
+static const unsigned minNodesPerThread=64;
+
+/*
+ * Calls f(begin,end,chunk) for contiguous chunks of the nodes [0,count), 
+ * with chunk < chunkCount().  With one thread, or too few nodes to share
+ * between threads, f is called once for all the nodes and no worker 
+ * threads are started.  Otherwise the workers are started the first time
+ * they are needed.
+ */
+void ConstrainedFDLayout::parallelFor(const unsigned count,
+        const std::function<void(unsigned,unsigned,unsigned)>& f) const
+{
+    if (chunkCount() == 1 || count < 2 * minNodesPerThread)
+    {
+        f(0, count, 0);
+        return;
+    }
+    if (m_thread_pool == NULL)
+    {
+        m_thread_pool = new ThreadPool(m_threads);
+    }
+    m_thread_pool->parallelFor(count, f, minNodesPerThread);
+}
+
+unsigned ConstrainedFDLayout::chunkCount() const
+{
+    return threadCount(m_threads);
+}
+
+/*
+ * Path lengths are computed lazily, the first time they are needed, so
+ * that the stress model may be chosen after construction without ever
+ * allocating the dense matrices for the sparse model.
+ */
+void ConstrainedFDLayout::setupPathLengths(void) const
+{
+    if (G || !m_pivots.empty() || (n == 0))
+    {
+        return;
+    }
+
+    // Correct zero or negative entries in eLengths array.
+    valarray<double> eLengths(m_edge_lengths);
+    for (size_t i = 0; i < eLengths.size(); ++i)
+    {
+        if (eLengths[i] <= 0)
+        {
+            fprintf(stderr, "Warning: ignoring non-positive length at index %d "
+                    "in ideal edge length array.\n", (int) i);
+            eLengths[i] = 1;
+        }
+    }
+
+    neighbours.assign(n, vector<unsigned>());
+    neighbourLengths.assign(n, vector<double>());
+    if (m_sparse_pivots > 0)
+    {
+        computeSparsePathLengths(m_edges, eLengths);
+    }
+    else
+    {
+        computePathLengths(m_edges, eLengths);
+    }
+}
+
+void ConstrainedFDLayout::freePathLengths(void)
+{
+    if (G)
+    {
+        for (unsigned i = 0; i < n; ++i)
+        {
+            delete [] G[i];
+            delete [] D[i];
+        }
+        delete [] G;
+        delete [] D;
+        G = NULL;
+        D = NULL;
+    }
+    m_pivots.clear();
+    m_pivot_distances.clear();
+    m_pivot_weights.clear();
+    m_components.clear();
+}
+
+/*
+ * Records the immediate neighbours of each node and the ideal length of
+ * the connecting edge, ignoring self loops.  Repeated edges are removed
+ * by uniqueNeighbours() once all edges have been added.
+ */
+void ConstrainedFDLayout::addNeighbours(const unsigned u, const unsigned v, 
+        const double length) const
+{
+    if(u==v) {
+        return;
+    }
+    neighbours[u].push_back(v);
+    neighbourLengths[u].push_back(length);
+    neighbours[v].push_back(u);
+    neighbourLengths[v].push_back(length);
+}
+
+static bool lessNeighbour(const pair<unsigned,double>& a,
+        const pair<unsigned,double>& b) {
+    return a.first<b.first;
+}
+static bool sameNeighbour(const pair<unsigned,double>& a,
+        const pair<unsigned,double>& b) {
+    return a.first==b.first;
+}
+/*
+ * Sorts the neighbours of each node and removes repeated edges, keeping
+ * the length of the first edge given between each pair.
+ */
+void ConstrainedFDLayout::uniqueNeighbours() const
+{
+    vector<pair<unsigned,double> > ns;
+    for(unsigned u=0;u<n;u++) {
+        ns.clear();
+        for(unsigned i=0;i<neighbours[u].size();i++) {
+            ns.push_back(make_pair(neighbours[u][i],neighbourLengths[u][i]));
+        }
+        stable_sort(ns.begin(),ns.end(),lessNeighbour);
+        ns.erase(unique(ns.begin(),ns.end(),sameNeighbour),ns.end());
+        neighbours[u].resize(ns.size());
+        neighbourLengths[u].resize(ns.size());
+        for(unsigned i=0;i<ns.size();i++) {
+            neighbours[u][i]=ns[i].first;
+            neighbourLengths[u][i]=ns[i].second;
+        }
+    }
+}
+
 /*
  * Sets up the D and G matrices.  D is the required euclidean distances
  * between pairs of nodes based on the shortest paths between them (using
@@ -152,22 +311,19 @@ void dijkstra(const unsigned s, const unsigned n, double* d,
  *     a connected path between them.
  */
 void ConstrainedFDLayout::computePathLengths(
-        const vector<Edge>& es, std::valarray<double> eLengths) 
+        const vector<Edge>& es, const std::valarray<double>& eLengths) const
 {
-    // Correct zero or negative entries in eLengths array.
-    for (size_t i = 0; i < eLengths.size(); ++i)
-    {
-        if (eLengths[i] <= 0)
-        {
-            fprintf(stderr, "Warning: ignoring non-positive length at index %d "
-                    "in ideal edge length array.\n", (int) i);
-            eLengths[i] = 1;
-        }
+    D=new double*[n];
+    G=new unsigned short*[n];
+    for(unsigned i=0;i<n;i++) {
+        D[i]=new double[n];
+        G[i]=new unsigned short[n];
     }
 
-    shortest_paths::johnsons(n,D,es,eLengths);
+    shortest_paths::johnsons(n,D,es,eLengths,m_threads);
     //dumpSquareMatrix<double>(n,D);
     for(unsigned i=0;i<n;i++) {
+        G[i][i]=0;
         for(unsigned j=0;j<n;j++) {
             if(i==j) continue;
             double& d=D[i][j];
@@ -181,14 +337,58 @@ void ConstrainedFDLayout::computePathLengths(
             }
         }
     }
-    for(vector<Edge>::const_iterator e=es.begin();e!=es.end();++e) {
-        unsigned u=e->first, v=e->second; 
+    for(unsigned i=0;i<es.size();++i) {
+        unsigned u=es[i].first, v=es[i].second; 
+        if(u==v) continue;
         G[u][v]=G[v][u]=1;
+        addNeighbours(u,v,D[u][v]);
+    }
+    uniqueNeighbours();
+    // The connected components, for the Barnes-Hut approximation.
+    m_components.assign(n,n);
+    unsigned component=0;
+    for(unsigned s=0;s<n;s++) {
+        if(m_components[s]!=n) continue;
+        vector<unsigned> stack(1,s);
+        m_components[s]=component;
+        while(!stack.empty()) {
+            unsigned u=stack.back();
+            stack.pop_back();
+            for(unsigned i=0;i<neighbours[u].size();i++) {
+                unsigned v=neighbours[u][i];
+                if(m_components[v]==n) {
+                    m_components[v]=component;
+                    stack.push_back(v);
+                }
+            }
+        }
+        component++;
     }
-    topologyAddon->computePathLengths(G);
+    // topologyAddon->computePathLengths(G) is deliberately not called.
+    // The path lengths used to be computed in the constructor, before
+    // setTopology(), so the hook never took effect, and the sparse model
+    // has no G to pass to it.
     //dumpSquareMatrix<short>(n,G);
 }
 
+/*
+ * Sets up the sparse stress model.  Rather than all pairs shortest paths,
+ * only the shortest paths from a set of pivot nodes are computed, see
+ * shortest_paths::pivots().
+ */
+void ConstrainedFDLayout::computeSparsePathLengths(
+        const vector<Edge>& es, const std::valarray<double>& eLengths) const
+{
+    shortest_paths::pivots(n,std::min(m_sparse_pivots,n),es,eLengths,
+            m_idealEdgeLength,m_pivots,m_pivot_distances,m_pivot_weights);
+
+    for(unsigned i=0;i<es.size();++i) {
+        double l=m_idealEdgeLength*((eLengths.size()>0)?eLengths[i]:1);
+        addNeighbours(es[i].first,es[i].second,l);
+    }
+    uniqueNeighbours();
+}
+
 typedef valarray<double> Position;
 void getPosition(Position& X, Position& Y, Position& pos) {
     unsigned n=X.size();
@@ -236,6 +436,7 @@ void ConstrainedFDLayout::computeDescentVectorOnBothAxes(
  */
 void ConstrainedFDLayout::run(const bool xAxis, const bool yAxis) 
 {
+    setupPathLengths();
     if (extraConstraints.empty())
     {
         // This generates constraints for non-overlap inside and outside
@@ -294,6 +495,7 @@ void ConstrainedFDLayout::run(const bool xAxis, const bool yAxis)
  */
 void ConstrainedFDLayout::runOnce(const bool xAxis, const bool yAxis) {
     if(n==0) return;
+    setupPathLengths();
     double stress=DBL_MAX;
     unsigned N=2*n;
     Position x0(N),x1(N);
@@ -453,6 +655,7 @@ void ConstrainedFDLayout::generateNonOverlapAndClusterCompoundConstraints(
             cola::NonOverlapConstraints *noc = 
                     new cola::NonOverlapConstraints(m_nonoverlap_exemptions,
                             priority);
+            noc->setPairPruningMargin(m_nonoverlap_margin);
             recGenerateClusterVariablesAndConstraints(vs, priority, 
                     noc, clusterHierarchy, extraConstraints);
             extraConstraints.push_back(noc);
@@ -464,6 +667,7 @@ void ConstrainedFDLayout::generateNonOverlapAndClusterCompoundConstraints(
         // nodes.
         cola::NonOverlapConstraints *noc = 
                 new cola::NonOverlapConstraints(m_nonoverlap_exemptions);
+        noc->setPairPruningMargin(m_nonoverlap_margin);
         for (unsigned int i = 0; i < boundingBoxes.size(); ++i)
         {
             noc->addShape(i, boundingBoxes[i]->width() / 2,
@@ -777,13 +981,8 @@ ConstrainedFDLayout::~ConstrainedFDLayout()
         delete done;
     }
 
-    for (unsigned i = 0; i < n; ++i)
-    {
-        delete [] G[i];
-        delete [] D[i];
-    }
-    delete [] G;
-    delete [] D;
+    freePathLengths();
+    delete m_thread_pool;
     delete topologyAddon;
     delete m_nonoverlap_exemptions;
 }
@@ -1003,9 +1202,16 @@ double ConstrainedFDLayout::applyForcesAndConstraints(const vpsc::Dim dim, const
         // Add non-overlap constraints, but not variables again.
         setupExtraConstraints(extraConstraints, dim, vs, cs, boundingBoxes);
         // Projection.
-        SparseMap HMap(n);
-        computeForces(dim,HMap,g);
-        SparseMatrix H(HMap);
+        // The sparsity pattern of the Barnes-Hut Hessian depends on the
+        // positions, otherwise it is the same for every iteration.
+        m_hessian.resize(n);
+        if(m_pivots.empty() && m_approx_theta>0) {
+            m_hessian.clearPattern();
+        } else {
+            m_hessian.clear();
+        }
+        computeForces(dim,m_hessian,g);
+        SparseMatrix H(m_hessian);
         valarray<double> oldCoords=coords;
         applyDescentVector(g,oldCoords,coords,oldStress,computeStepSize(H,g,g));
         setVariableDesiredPositions(vs,cs,des,coords);
@@ -1068,6 +1274,141 @@ double ConstrainedFDLayout::applyDescentVector(
     return computeStress();
 }
         
+/*
+ * Computes the stress gradient and Hessian contributions for node u of 
+ * the pair (u,v), where r is the vector from v to u and d the ideal 
+ * distance between them.  These are scaled by weight w, which is the 
+ * number of nodes represented by v when approximating forces.  Returns 
+ * false if the pair exerts no force.
+ */
+static inline bool stressForce(const vpsc::Dim dim, double rx, double ry,
+        const double d, const unsigned short p, const double w,
+        double& gu, double& huv)
+{
+    double l=sqrt(rx*rx+ry*ry);
+    if(l>d && p>1) return false; // attractive forces not required
+    double d2=d*d;
+    /* force apart zero distances */
+    if (l < 1e-30) {
+        l=0.1;
+    }
+    double dx=dim==vpsc::HORIZONTAL?rx:ry;
+    double dy=dim==vpsc::HORIZONTAL?ry:rx;
+    gu+=w*dx*(l-d)/(d2*l);
+    huv=w*(d*dy*dy/(l*l*l)-1)/d2;
+    return true;
+}
+
+/*
+ * The immediate neighbours of node u, whose terms are always computed
+ * exactly, in the order of a QuadTree.  Prefix sums of their positions
+ * allow them to be taken out of the group of a distant cell.
+ */
+struct ExactNeighbours {
+    ExactNeighbours(const unsigned u, const vector<unsigned>& neighbours,
+            unsigned short** G, const QuadTree& tree,
+            const valarray<double>& X, const valarray<double>& Y) 
+        : sx(1,0), sy(1,0) {
+        for(unsigned i=0;i<neighbours.size();i++) {
+            if(G[u][neighbours[i]]==1) {
+                positions.push_back(tree.position(neighbours[i]));
+            }
+        }
+        sort(positions.begin(),positions.end());
+        for(unsigned i=0;i<positions.size();i++) {
+            unsigned v=tree.order()[positions[i]];
+            sx.push_back(sx.back()+X[v]);
+            sy.push_back(sy.back()+Y[v]);
+        }
+    }
+    /*
+     * The number of nodes in cell c other than the neighbours, and their
+     * centroid.
+     */
+    unsigned group(const QuadTree::Cell& c, double& cx, double& cy) const {
+        unsigned lo=lower_bound(positions.begin(),positions.end(),c.begin)
+            -positions.begin();
+        unsigned hi=lower_bound(positions.begin(),positions.end(),c.end)
+            -positions.begin();
+        unsigned w=c.count()-(hi-lo);
+        cx=c.cx;
+        cy=c.cy;
+        if(hi>lo && w>0) {
+            cx=(c.cx*c.count()-(sx[hi]-sx[lo]))/w;
+            cy=(c.cy*c.count()-(sy[hi]-sy[lo]))/w;
+        }
+        return w;
+    }
+    vector<unsigned> positions;
+    vector<double> sx, sy;
+};
+
+/*
+ * Visitor for QuadTree::visit() that accumulates the approximate stress
+ * gradient and Hessian row for node u.  A distant group of nodes is 
+ * treated as copies of its representative node placed at the group's
+ * centroid, with the Hessian entry assigned to the representative.
+ * Immediate neighbours are always handled exactly, so they are skipped
+ * and left out of the groups.  The tree has a separate root for each 
+ * component, so groups only contain nodes of u's component.
+ */
+struct ApproximateForces {
+    ApproximateForces(const vpsc::Dim dim, const unsigned u, 
+            const valarray<double>& X, const valarray<double>& Y,
+            double** D, unsigned short** G, SparseMap& H,
+            const ExactNeighbours& exact)
+        : dim(dim), u(u), X(X), Y(Y), D(D), G(G), H(H), exact(exact), 
+          gu(0), Huu(0) {}
+    void node(const unsigned v) {
+        if(G[u][v]==1) return;
+        add(v,X[v],Y[v],1,false);
+    }
+    void group(const QuadTree::Cell& c) {
+        double cx, cy;
+        unsigned w=exact.group(c,cx,cy);
+        if(w>0) {
+            add(c.rep,cx,cy,w,true);
+        }
+    }
+    void add(const unsigned v, const double vx, const double vy, 
+            const double w, const bool group) {
+        unsigned short p=G[u][v];
+        // no forces between disconnected parts of the graph
+        if(p==0) return;
+        // an edge to the representative doesn't apply to its whole group
+        if(group && p==1) p=2;
+        double huv;
+        if(stressForce(dim,X[u]-vx,Y[u]-vy,D[u][v],p,w,gu,huv)) {
+            H(u,v)+=huv;
+            Huu-=huv;
+        }
+    }
+    const vpsc::Dim dim;
+    const unsigned u;
+    const valarray<double>& X;
+    const valarray<double>& Y;
+    double** D;
+    unsigned short** G;
+    SparseMap& H;
+    const ExactNeighbours& exact;
+    double gu, Huu;
+};
+
+/*
+ * Sums the per-chunk results of parallelFor() in chunk order.  Each chunk
+ * is a fixed range of nodes summed in node order, so the total is the 
+ * same on every run with the same number of threads, and for one chunk 
+ * is exactly the sequential sum.
+ */
+static double sumInOrder(const vector<double>& values)
+{
+    double sum=0;
+    for(unsigned i=0;i<values.size();i++) {
+        sum+=values[i];
+    }
+    return sum;
+}
+
 /*
  * Computes:
  *  - the matrix of second derivatives (the Hessian) H, used in 
@@ -1080,30 +1421,33 @@ void ConstrainedFDLayout::computeForces(
         valarray<double> &g) {
     if(n==1) return;
     g=0;
-    // for each node:
-    for(unsigned u=0;u<n;u++) {
-        // Stress model
-        double Huu=0;
-        for(unsigned v=0;v<n;v++) {
-            if(u==v) continue;
-            unsigned short p = G[u][v];
-            // no forces between disconnected parts of the graph
-            if(p==0) continue;
-            double rx=X[u]-X[v], ry=Y[u]-Y[v];
-            double l=sqrt(rx*rx+ry*ry);
-            double d=D[u][v];
-            if(l>d && p>1) continue; // attractive forces not required
-            double d2=d*d;
-            /* force apart zero distances */
-            if (l < 1e-30) {
-                l=0.1;
+    if(!m_pivots.empty()) {
+        computeSparseForces(dim,H,g);
+    } else if(m_approx_theta>0) {
+        computeApproximateForces(dim,H,g);
+    } else {
+        // The terms for each node are computed several pairs at a time,
+        // see stress_kernels.h, and then accumulated in order.  Pairs 
+        // without forces between them have zero terms.
+        const bool horizontal=dim==vpsc::HORIZONTAL;
+        const double *C=horizontal?&X[0]:&Y[0], *O=horizontal?&Y[0]:&X[0];
+        parallelFor(n,[&](unsigned begin,unsigned end,unsigned) {
+            vector<double> gs(n), hs(n);
+            // for each node:
+            for(unsigned u=begin;u<end;u++) {
+                // Stress model
+                stressForceTerms(n,C[u],O[u],C,O,D[u],G[u],&gs[0],&hs[0]);
+                double Huu=0;
+                for(unsigned v=0;v<n;v++) {
+                    if(u==v) continue;
+                    g[u]+=gs[v];
+                    if(hs[v]!=0) {
+                        Huu-=H(u,v)=hs[v];
+                    }
+                }
+                H(u,u)=Huu;
             }
-            double dx=dim==vpsc::HORIZONTAL?rx:ry;
-            double dy=dim==vpsc::HORIZONTAL?ry:rx;
-            g[u]+=dx*(l-d)/(d2*l);
-            Huu-=H(u,v)=(d*dy*dy/(l*l*l)-1)/d2;
-        }
-        H(u,u)=Huu;
+        });
     }
     if(desiredPositions) {
         for(DesiredPositions::const_iterator p=desiredPositions->begin();
@@ -1117,6 +1461,67 @@ void ConstrainedFDLayout::computeForces(
         }
     }
 }
+/*
+ * Barnes-Hut approximation of the stress model forces.  Pairs of nodes
+ * connected by an edge are always computed exactly, the interactions with
+ * sufficiently distant groups of other nodes are approximated, see
+ * setForceApproximation().
+ */
+void ConstrainedFDLayout::computeApproximateForces(
+        const vpsc::Dim dim,
+        SparseMap &H,
+        valarray<double> &g) {
+    QuadTree tree(X,Y,m_components);
+    parallelFor(n,[&](unsigned begin,unsigned end,unsigned) {
+        for(unsigned u=begin;u<end;u++) {
+            ExactNeighbours exact(u,neighbours[u],G,tree,X,Y);
+            ApproximateForces forces(dim,u,X,Y,D,G,H,exact);
+            tree.visit(u,X[u],Y[u],m_approx_theta,forces);
+            for(vector<unsigned>::const_iterator v=neighbours[u].begin();
+                    v!=neighbours[u].end();++v) {
+                if(G[u][*v]!=1) continue;
+                forces.add(*v,X[*v],Y[*v],1,false);
+            }
+            g[u]=forces.gu;
+            H(u,u)+=forces.Huu;
+        }
+    });
+}
+/*
+ * Forces for the sparse stress model, see setSparseStress().  Each node
+ * has exact terms for its immediate neighbours and weighted terms for 
+ * each of the pivots.  As for non-adjacent pairs in the full model, the
+ * pivot terms are only repulsive.
+ */
+void ConstrainedFDLayout::computeSparseForces(
+        const vpsc::Dim dim,
+        SparseMap &H,
+        valarray<double> &g) {
+    const unsigned k=m_pivots.size();
+    parallelFor(n,[&](unsigned begin,unsigned end,unsigned) {
+        for(unsigned u=begin;u<end;u++) {
+            double Huu=0, huv;
+            for(unsigned i=0;i<neighbours[u].size();++i) {
+                unsigned v=neighbours[u][i];
+                if(stressForce(dim,X[u]-X[v],Y[u]-Y[v],
+                            neighbourLengths[u][i],1,1,g[u],huv)) {
+                    Huu-=H(u,v)=huv;
+                }
+            }
+            for(unsigned p=0;p<k;++p) {
+                unsigned w=m_pivot_weights[u*k+p];
+                if(w==0) continue;
+                unsigned v=m_pivots[p];
+                if(stressForce(dim,X[u]-X[v],Y[u]-Y[v],
+                            m_pivot_distances[p*n+u],2,w,g[u],huv)) {
+                    H(u,v)+=huv;
+                    Huu-=huv;
+                }
+            }
+            H(u,u)+=Huu;
+        }
+    });
+}
 /*
  * Returns the optimal step-size in the direction d, given gradient g and 
  * hessian H.
@@ -1138,6 +1543,58 @@ double ConstrainedFDLayout::computeStepSize(
     if(denominator==0) return 0;
     return numerator/denominator;
 }
+/*
+ * Stress contributed by the pair (u,v), where l is the euclidean distance
+ * between them and d is their ideal distance.
+ */
+static inline double stressTerm(const double l, const double d, 
+        const unsigned short p)
+{
+    if(l>d && p>1) return 0; // no attractive forces required
+    double d2=d*d;
+    double rl=d-l;
+    return rl*rl/d2;
+}
+
+/*
+ * Visitor for QuadTree::visit() that accumulates the approximate stress
+ * for node u, see ApproximateForces.
+ */
+struct ApproximateStress {
+    ApproximateStress(const unsigned u, 
+            const valarray<double>& X, const valarray<double>& Y,
+            double** D, unsigned short** G, const ExactNeighbours& exact)
+        : u(u), X(X), Y(Y), D(D), G(G), exact(exact), stress(0) {}
+    void node(const unsigned v) {
+        if(G[u][v]==1) return;
+        add(v,X[v],Y[v],1,false);
+    }
+    void group(const QuadTree::Cell& c) {
+        double cx, cy;
+        unsigned w=exact.group(c,cx,cy);
+        if(w>0) {
+            add(c.rep,cx,cy,w,true);
+        }
+    }
+    void add(const unsigned v, const double vx, const double vy, 
+            const double w, const bool group) {
+        unsigned short p=G[u][v];
+        // no forces between disconnected parts of the graph
+        if(p==0) return;
+        // an edge to the representative doesn't apply to its whole group
+        if(group && p==1) p=2;
+        double rx=X[u]-vx, ry=Y[u]-vy;
+        stress+=w*stressTerm(sqrt(rx*rx+ry*ry),D[u][v],p);
+    }
+    const unsigned u;
+    const valarray<double>& X;
+    const valarray<double>& Y;
+    double** D;
+    unsigned short** G;
+    const ExactNeighbours& exact;
+    double stress;
+};
+
 /*
  * Just computes the cost (Stress) at the current X,Y position
  * used to test termination.
@@ -1145,22 +1602,34 @@ double ConstrainedFDLayout::computeStepSize(
  */
 double ConstrainedFDLayout::computeStress() const {
     FILE_LOG(logDEBUG)<<"ConstrainedFDLayout::computeStress()";
+    // Path lengths are normally set up by run(), but the stress may be
+    // requested before then.
+    setupPathLengths();
     double stress=0;
-    for(unsigned u=0;(u + 1)<n;u++) {
-        for(unsigned v=u+1;v<n;v++) {
-            unsigned short p=G[u][v];
-            // no forces between disconnected parts of the graph
-            if(p==0) continue;
-            double rx=X[u]-X[v], ry=Y[u]-Y[v];
-            double l=sqrt(rx*rx+ry*ry);
-            double d=D[u][v];
-            if(l>d && p>1) continue; // no attractive forces required
-            double d2=d*d;
-            double rl=d-l;
-            double s=rl*rl/d2;
-            stress+=s;
-            FILE_LOG(logDEBUG2)<<"s("<<u<<","<<v<<")="<<s;
+    if(!m_pivots.empty()) {
+        stress=computeSparseStress();
+    } else if(m_approx_theta>0) {
+        stress=computeApproximateStress();
+    } else {
+        vector<double> chunkStress(chunkCount(),0);
+        parallelFor(n,[&](unsigned begin,unsigned end,unsigned chunk) {
+            vector<double> s(n);
+            double& stress=chunkStress[chunk];
+            for(unsigned u=begin;u<end && (u + 1)<n;u++) {
+                const unsigned v0=u+1;
+                stressTerms(n-v0,X[u],Y[u],&X[v0],&Y[v0],D[u]+v0,G[u]+v0,
+                        &s[0]);
+                for(unsigned v=v0;v<n;v++) {
+                    stress+=s[v-v0];
+                }
+            }
+        });
+        // The log is not thread-safe, so only the chunk sums are logged,
+        // once the threads are done.
+        for(unsigned i=0;i<chunkStress.size();i++) {
+            FILE_LOG(logDEBUG2)<<"chunk "<<i<<" stress="<<chunkStress[i];
         }
+        stress=sumInOrder(chunkStress);
     }
     if(preIteration) {
         if ((*preIteration)()) {
@@ -1183,6 +1652,57 @@ double ConstrainedFDLayout::computeStress() const {
     }
     return stress;
 }
+/*
+ * Barnes-Hut approximation of the stress between all pairs of nodes.
+ * Every pair is seen from both of its ends, so the sum is halved.
+ */
+double ConstrainedFDLayout::computeApproximateStress() const {
+    QuadTree tree(X,Y,m_components);
+    vector<double> chunkStress(chunkCount(),0);
+    parallelFor(n,[&](unsigned begin,unsigned end,unsigned chunk) {
+        for(unsigned u=begin;u<end;u++) {
+            ExactNeighbours exact(u,neighbours[u],G,tree,X,Y);
+            ApproximateStress s(u,X,Y,D,G,exact);
+            tree.visit(u,X[u],Y[u],m_approx_theta,s);
+            for(vector<unsigned>::const_iterator v=neighbours[u].begin();
+                    v!=neighbours[u].end();++v) {
+                if(G[u][*v]!=1) continue;
+                s.add(*v,X[*v],Y[*v],1,false);
+            }
+            chunkStress[chunk]+=s.stress;
+        }
+    });
+    return sumInOrder(chunkStress)/2;
+}
+
+/*
+ * Stress for the sparse stress model, see computeSparseForces().  Edges 
+ * are seen from both of their ends, so their terms are halved.
+ */
+double ConstrainedFDLayout::computeSparseStress() const {
+    const unsigned k=m_pivots.size();
+    vector<double> chunkStress(chunkCount(),0);
+    parallelFor(n,[&](unsigned begin,unsigned end,unsigned chunk) {
+        double& stress=chunkStress[chunk];
+        for(unsigned u=begin;u<end;u++) {
+            for(unsigned i=0;i<neighbours[u].size();++i) {
+                unsigned v=neighbours[u][i];
+                double rx=X[u]-X[v], ry=Y[u]-Y[v];
+                stress+=0.5*stressTerm(sqrt(rx*rx+ry*ry),
+                        neighbourLengths[u][i],1);
+            }
+            for(unsigned p=0;p<k;++p) {
+                unsigned w=m_pivot_weights[u*k+p];
+                if(w==0) continue;
+                unsigned v=m_pivots[p];
+                double rx=X[u]-X[v], ry=Y[u]-Y[v];
+                stress+=w*stressTerm(sqrt(rx*rx+ry*ry),
+                        m_pivot_distances[p*n+u],2);
+            }
+        }
+    });
+    return sumInOrder(chunkStress);
+}
 
 void ConstrainedFDLayout::setUmlEdgeLabelStartIndex(int index)
 {
@@ -1304,15 +1824,10 @@ void ConstrainedFDLayout::outputInstanceToSVG(std::string instanceName)
         fprintf(fp, "    rs.push_back(rect);\n\n");
     }
     
-    for (size_t i = 0; i < n; ++i)
+    for (size_t i = 0; i < m_edges.size(); ++i)
     {
-        for (size_t j =  i + 1; j < n; ++j)
-        {
-            if (G[i][j] == 1)
-            {
-                fprintf(fp, "    es.push_back(std::make_pair(%lu, %lu));\n", i, j);
-            }
-        }
+        fprintf(fp, "    es.push_back(std::make_pair(%u, %u));\n", 
+                m_edges[i].first, m_edges[i].second);
     }
     fprintf(fp, "\n");
 
@@ -1373,20 +1888,15 @@ void ConstrainedFDLayout::outputInstanceToSVG(std::string instanceName)
 
     fprintf(fp, "<g inkscape:groupmode=\"layer\" "
             "inkscape:label=\"Edges\">\n");
-    for (size_t i = 0; i < n; ++i)
+    for (size_t e = 0; e < m_edges.size(); ++e)
     {
-        for (size_t j =  i + 1; j < n; ++j)
-        {
-            if (G[i][j] == 1)
-            {
-                fprintf(fp, "<path d=\"M %g %g L %g %g\" "
-                        "style=\"stroke-width: 1px; stroke: black;\" />\n",
-                        boundingBoxes[i]->getCentreX(),
-                        boundingBoxes[i]->getCentreY(),
-                        boundingBoxes[j]->getCentreX(),
-                        boundingBoxes[j]->getCentreY());
-            }
-        }
+        unsigned i = m_edges[e].first, j = m_edges[e].second;
+        fprintf(fp, "<path d=\"M %g %g L %g %g\" "
+                "style=\"stroke-width: 1px; stroke: black;\" />\n",
+                boundingBoxes[i]->getCentreX(),
+                boundingBoxes[i]->getCentreY(),
+                boundingBoxes[j]->getCentreX(),
+                boundingBoxes[j]->getCentreY());
     }
     fprintf(fp, "</g>\n");
 
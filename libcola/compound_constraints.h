@@ -24,6 +24,7 @@
 #include <vector>
 #include <list>
 #include <set>
+#include <map>
 #include <utility>
 
 #include "libcola/sparse_matrix.h"
@@ -31,6 +31,7 @@
 #include "libvpsc/assertions.h"
 #include "libcola/commondefs.h"
 #include "libcola/conjugate_gradient.h"
+#include "libcola/sparse_matrix.h"
 
 /* lifted wholely from wikipedia.  Well, apart from the bug in the wikipedia version. */
 
@@ -63,6 +64,14 @@ matrix_times_vector(valarray<double> const &matrix, /* m * n */
     }
 }
 
+static void 
+matrix_times_vector(cola::SparseMatrix const &matrix, /* n * n */
+            valarray<double> const &vec,  /* n */
+            valarray<double> &result) /* n */
+{
+    matrix.rightMultiply(vec, result);
+}
+
 /*
 static double Linfty(valarray<double> const &vec) {
     return std::max(vec.max(), -vec.min());
@@ -78,23 +87,20 @@ inner(valarray<double> const &x,
     return total;// (x*y).sum(); <- this is more concise, but ineff
 }
 
-double compute_cost(valarray<double> const &A, 
+template <typename Matrix>
+static double compute_cost(Matrix const &A, 
         valarray<double> const &b,
         valarray<double> const &x,
         const unsigned n) {
     // computes cost = 2 b x - x A x
     double cost = 2. * inner(b,x);
     valarray<double> Ax(n);
-    for (unsigned i=0; i<n; i++) {
-        Ax[i] = 0;
-        for (unsigned j=0; j<n; j++) {
-            Ax[i] += A[i*n+j]*x[j];
-        }
-    }
+    matrix_times_vector(A,x,Ax);
     return cost - inner(x,Ax);
 }
-void 
-conjugate_gradient(valarray<double> const &A, 
+template <typename Matrix>
+static void 
+solve(Matrix const &A, 
            valarray<double> &x, 
            valarray<double> const &b, 
            unsigned const n, double const tol,
@@ -135,3 +141,19 @@ conjugate_gradient(valarray<double> const &A,
     //std::max(-r.min(), r.max()), sqrt(r_r));
     // x is solution
 }
+void 
+conjugate_gradient(valarray<double> const &A, 
+           valarray<double> &x, 
+           valarray<double> const &b, 
+           unsigned const n, double const tol,
+           unsigned const max_iterations) {
+    solve(A,x,b,n,tol,max_iterations);
+}
+void 
+conjugate_gradient(cola::SparseMatrix const &A, 
+           valarray<double> &x, 
+           valarray<double> const &b, 
+           unsigned const n, double const tol,
+           unsigned const max_iterations) {
+    solve(A,x,b,n,tol,max_iterations);
+}
@@ -23,6 +23,10 @@
 
 #include <valarray>
 
+namespace cola {
+class SparseMatrix;
+}
+
 double
 inner(std::valarray<double> const &x, 
       std::valarray<double> const &y);
@@ -33,4 +37,11 @@ conjugate_gradient(std::valarray<double> const &A,
            std::valarray<double> const &b, 
            unsigned const n, double const tol,
            unsigned const max_iterations);
+
+void 
+conjugate_gradient(cola::SparseMatrix const &A, 
+           std::valarray<double> &x, 
+           std::valarray<double> const &b, 
+           unsigned const n, double const tol,
+           unsigned const max_iterations);
 #endif // _CONJUGATE_GRADIENT_H
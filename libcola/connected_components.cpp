@@ -21,11 +21,14 @@
 
 #include <map>
 #include <list>
+#include <atomic>
+#include <algorithm>
 
 #include "libvpsc/rectangle.h"
 #include "libvpsc/assertions.h"
 #include "libcola/commondefs.h"
 #include "libcola/connected_components.h"
+#include "libcola/parallel.h"
 
 using namespace std;
 using namespace vpsc;
@@ -157,4 +160,73 @@ namespace cola {
             delete bbs[i];
         }
     }
+    namespace ccomponents {
+        struct CmpComponentSize {
+            CmpComponentSize(const vector<Component*> &components)
+                : components(components) {}
+            bool operator()(unsigned a, unsigned b) const {
+                return components[a]->rects.size()
+                    > components[b]->rects.size();
+            }
+            const vector<Component*> &components;
+        };
+    }
+    void layoutConnectedComponents(
+            const vector<Rectangle*> &rs,
+            const vector<Edge> &es,
+            const double idealLength,
+            const bool preventOverlaps,
+            const EdgeLengths &eLengths,
+            const unsigned threads) {
+        vector<Component*> components;
+        connectedComponents(rs,es,components);
+        unsigned n=components.size();
+
+        // the edges of each component are in the same order as in es, so
+        // their lengths can be split up in that order too.
+        vector<EdgeLengths> lengths(n);
+        if(!eLengths.empty()) {
+            COLA_ASSERT(eLengths.size()==es.size());
+            vector<unsigned> componentOf(rs.size());
+            for(unsigned i=0;i<n;i++) {
+                for(unsigned j=0;j<components[i]->node_ids.size();j++) {
+                    componentOf[components[i]->node_ids[j]]=i;
+                }
+            }
+            for(unsigned i=0;i<es.size();i++) {
+                lengths[componentOf[es[i].first]].push_back(eLengths[i]);
+            }
+        }
+
+        // start with the largest components, so that a large one isn't
+        // left running on its own at the end.  Each thread takes the next
+        // component when it finishes one.  The rectangles of different
+        // components are distinct, so the layouts don't interfere.
+        vector<unsigned> order(n);
+        for(unsigned i=0;i<n;i++) {
+            order[i]=i;
+        }
+        stable_sort(order.begin(),order.end(),CmpComponentSize(components));
+        unsigned workers=min(threadCount(threads),max(1u,n));
+        atomic<unsigned> next(0);
+        parallelFor(workers,workers,[&](unsigned, unsigned, unsigned) {
+            unsigned k;
+            while((k=next++)<n) {
+                Component* c=components[order[k]];
+                if(c->rects.size()<2) {
+                    continue;
+                }
+                ConstrainedFDLayout alg(c->rects,c->edges,idealLength,
+                        preventOverlaps,lengths[order[k]]);
+                // with a single component, parallelise within it instead.
+                alg.setThreadCount((n==1)?threads:1);
+                alg.run();
+            }
+        });
+
+        separateComponents(components);
+        for(unsigned i=0;i<n;i++) {
+            delete components[i];
+        }
+    }
 }
@@ -49,6 +49,22 @@ void connectedComponents(
 // overlap.
 void separateComponents(const std::vector<Component*> &components);
 
+// lay out each connected component of the graph with its own
+// ConstrainedFDLayout, so that the shortest path matrices are only as
+// large as the components, and then separate the components.  Up to
+// threads components are laid out at once (zero means one per hardware
+// thread, the default is one), and the result does not depend on the
+// number of threads.
+// Compound constraints and clusters are not supported, since they may
+// span components; use a single ConstrainedFDLayout for those.
+void layoutConnectedComponents(
+    const std::vector<vpsc::Rectangle*> &rs,
+    const std::vector<cola::Edge> &es,
+    const double idealLength,
+    const bool preventOverlaps,
+    const EdgeLengths &eLengths = StandardEdgeLengths,
+    const unsigned threads = 1);
+
 } // namespace cola
 
 #endif // CONNECTED_COMPONENTS_H
@@ -56,10 +56,47 @@ GradientProjection::GradientProjection(
     RootCluster* clusterHierarchy,
     vpsc::Rectangles* rs,
     const bool scaling,
+    SolveWithMosek solveWithMosek) 
+        : GradientProjection(k, denseQ, NULL, tol, max_iterations, ccs,
+                unsatisfiableConstraints, nonOverlapConstraints,
+                clusterHierarchy, rs, scaling, solveWithMosek)
+{
+}
+GradientProjection::GradientProjection(
+    const Dim k,
+    cola::SparseMatrix const *laplacian,
+    const double tol,
+    const unsigned max_iterations,
+    CompoundConstraints const *ccs,
+    UnsatisfiableConstraintInfos *unsatisfiableConstraints,
+    NonOverlapConstraintsMode nonOverlapConstraints,
+    RootCluster* clusterHierarchy,
+    vpsc::Rectangles* rs,
+    const bool scaling,
+    SolveWithMosek solveWithMosek) 
+        : GradientProjection(k, NULL, laplacian, tol, max_iterations, ccs,
+                unsatisfiableConstraints, nonOverlapConstraints,
+                clusterHierarchy, rs, scaling, solveWithMosek)
+{
+}
+GradientProjection::GradientProjection(
+    const Dim k,
+    std::valarray<double> *denseQ,
+    cola::SparseMatrix const *laplacian,
+    const double tol,
+    const unsigned max_iterations,
+    CompoundConstraints const *ccs,
+    UnsatisfiableConstraintInfos *unsatisfiableConstraints,
+    NonOverlapConstraintsMode nonOverlapConstraints,
+    RootCluster* clusterHierarchy,
+    vpsc::Rectangles* rs,
+    const bool scaling,
     SolveWithMosek solveWithMosek) 
         : k(k), 
-          denseSize(static_cast<unsigned>((floor(sqrt(static_cast<double>(denseQ->size())))))),
+          denseSize(laplacian ? laplacian->rowSize() :
+              static_cast<unsigned>((floor(sqrt(static_cast<double>(denseQ->size())))))),
           denseQ(denseQ), 
+          laplacian(laplacian),
           rs(rs),
           ccs(ccs),
           unsatisfiableConstraints(unsatisfiableConstraints),
@@ -68,6 +105,9 @@ GradientProjection::GradientProjection(
           tolerance(tol), 
           max_iterations(max_iterations),
           sparseQ(NULL),
+          solver(NULL),
+          solverVars(0),
+          solverConstraints(0),
           solveWithMosek(solveWithMosek),
           scaling(scaling)
 {
@@ -76,9 +116,10 @@ GradientProjection::GradientProjection(
         vars.push_back(new vpsc::Variable(i,1,1));
     }
     if(scaling) {
-        scaledDenseQ.resize(denseSize*denseSize);
         for(unsigned i=0;i<denseSize;i++) {
-            vars[i]->scale=1./sqrt(fabs((*denseQ)[i*denseSize+i]));
+            double qii = laplacian ? laplacian->getIJ(i,i) :
+                (*denseQ)[i*denseSize+i];
+            vars[i]->scale=1./sqrt(fabs(qii));
             // XXX: Scale can sometimes be set to infinity here when 
             //      there are nodes not connected to any other node.
             //      Thus we just set the scale for such a variable to 1.
@@ -87,8 +128,12 @@ GradientProjection::GradientProjection(
                 vars[i]->scale = 1;
             }
         }
+    }
+    if(scaling && !laplacian) {
         // the following computes S'QS for Q=denseQ
-        // and S is diagonal matrix of scale factors
+        // and S is diagonal matrix of scale factors.  The sparse laplacian
+        // is scaled as it is multiplied instead, see multiplyLaplacian().
+        scaledDenseQ.resize(denseSize*denseSize);
         for(unsigned i=0;i<denseSize;i++) {
             for(unsigned j=0;j<denseSize;j++) {
                 scaledDenseQ[i*denseSize+j]=(*denseQ)[i*denseSize+j]*vars[i]->scale
@@ -129,16 +174,37 @@ static inline double dotProd(valarray<double> const & a, valarray<double> const
     }
     return p;
 }
+// r = Qx for the first denseSize entries of x, where Q is the sparse 
+// laplacian scaled by S'QS if scaling is used.  The other entries of r are
+// left unchanged.
+void GradientProjection::multiplyLaplacian(
+        valarray<double> const &x,
+        valarray<double> &r) const {
+    COLA_ASSERT(laplacian);
+    COLA_ASSERT(x.size()>=denseSize && r.size()>=denseSize);
+    valarray<double> y(denseSize), Qy(denseSize);
+    for (unsigned i=0; i<denseSize; i++) {
+        y[i] = scaling ? x[i]*vars[i]->scale : x[i];
+    }
+    laplacian->rightMultiply(y,Qy);
+    for (unsigned i=0; i<denseSize; i++) {
+        r[i] = scaling ? Qy[i]*vars[i]->scale : Qy[i];
+    }
+}
 double GradientProjection::computeCost(
         valarray<double> const &b,
         valarray<double> const &x) const {
     // computes cost = 2 b x - x A x
     double cost = 2. * dotProd(b,x);
     valarray<double> Ax(x.size());
-    for (unsigned i=0; i<denseSize; i++) {
-        Ax[i] = 0;
-        for (unsigned j=0; j<denseSize; j++) {
-            Ax[i] += (*denseQ)[i*denseSize+j]*x[j];
+    if(laplacian) {
+        multiplyLaplacian(x,Ax);
+    } else {
+        for (unsigned i=0; i<denseSize; i++) {
+            Ax[i] = 0;
+            for (unsigned j=0; j<denseSize; j++) {
+                Ax[i] += (*denseQ)[i*denseSize+j]*x[j];
+            }
         }
     }
     if(sparseQ) {
@@ -162,9 +228,15 @@ double GradientProjection::computeSteepestDescentVector(
     //  the optimal stepsize anyway
     COLA_ASSERT(x.size()==b.size() && b.size()==g.size());
     g = b;
-    for (unsigned i=0; i<denseSize; i++) {
-        for (unsigned j=0; j<denseSize; j++) {
-            g[i] -= (*denseQ)[i*denseSize+j]*x[j];
+    if(laplacian) {
+        valarray<double> r(x.size());
+        multiplyLaplacian(x,r);
+        g-=r;
+    } else {
+        for (unsigned i=0; i<denseSize; i++) {
+            for (unsigned j=0; j<denseSize; j++) {
+                g[i] -= (*denseQ)[i*denseSize+j]*x[j];
+            }
         }
     }
     // sparse part:
@@ -186,11 +258,18 @@ double GradientProjection::computeStepSize(
         Ad.resize(g.size());
         sparseQ->rightMultiply(d,Ad);
     }
+    valarray<double> Ld;
+    if(laplacian) {
+        Ld.resize(g.size());
+        multiplyLaplacian(d,Ld);
+    }
     double const numerator = dotProd(g, d);
     double denominator = 0;
     for (unsigned i=0; i<g.size(); i++) {
         double r = sparseQ ? Ad[i] : 0;
-        if(i<denseSize) { for (unsigned j=0; j<denseSize; j++) {
+        if(laplacian) {
+            r += Ld[i];
+        } else if(i<denseSize) { for (unsigned j=0; j<denseSize; j++) {
             r += (*denseQ)[i*denseSize+j] * d[j];
         } }
         denominator += r * d[i];
@@ -375,6 +454,9 @@ unsigned GradientProjection::solve(
 // global constraint list (including alignment constraints,
 // dir-edge constraints, containment constraints, etc).
 IncSolver* GradientProjection::setupVPSC() {
+    // Whether the non-overlap constraints differ from the last call.
+    bool overlapChanged=false;
+    Constraints newOcs;
     if(nonOverlapConstraints!=None) {
         if(clusterHierarchy) {
             //printf("Setup up cluster constraints, dim=%d--------------\n",k);
@@ -390,15 +472,26 @@ IncSolver* GradientProjection::setupVPSC() {
                 Rectangle::setXBorder(0.0001);
                 // use rs->size() rather than n because some of the variables may
                 // be dummy vars with no corresponding rectangle
-                generateXConstraints(*rs,vars,lcs,nonOverlapConstraints==Both?true:false); 
+                overlapChanged=overlapGenerator.generateXConstraints(
+                        *rs,vars,newOcs,nonOverlapConstraints==Both?true:false); 
                 Rectangle::setXBorder(0);
             } else {
-                generateYConstraints(*rs,vars,lcs); 
+                overlapChanged=overlapGenerator.generateYConstraints(
+                        *rs,vars,newOcs); 
             }
         }
     }
+    if(overlapChanged) {
+        // The solver refers to the old constraints, so cannot be kept.
+        resetSolver();
+        for(Constraints::iterator i=ocs.begin();i!=ocs.end();i++) {
+            delete *i;
+        }
+        ocs.swap(newOcs);
+    }
     cs=gcs;
     cs.insert(cs.end(),lcs.begin(),lcs.end());
+    cs.insert(cs.end(),ocs.begin(),ocs.end());
     switch(solveWithMosek) {
         case Off:
             break;
@@ -412,7 +505,8 @@ IncSolver* GradientProjection::setupVPSC() {
             unsigned k=0;
             for(unsigned i=0;i<n;i++) {
                 for(unsigned j=i;j<n;j++) {
-                    lap[k]=(*denseQ)[i*n+j];
+                    lap[k]=laplacian ? laplacian->getIJ(i,j) : 
+                        (*denseQ)[i*n+j];
                     k++;
                 }
             }
@@ -423,9 +517,35 @@ IncSolver* GradientProjection::setupVPSC() {
         default:
             break;
     }
+    if(solver) {
+        // If the constraints are the same as for the last call then keep
+        // the solver, so that it starts from the blocks (the active set) 
+        // of the previous solution and only has to account for the
+        // changes to the desired positions.  This includes the case where
+        // the non-overlap constraints have been regenerated unchanged.
+        if(lcs.empty() && solveWithMosek==Off && 
+                solverVars==vars.size() && solverConstraints==cs.size()) {
+            return solver;
+        }
+        resetSolver();
+    }
+    solverVars=vars.size();
+    solverConstraints=cs.size();
     return new IncSolver(vars,cs);
 }
+// Discards the solver kept between calls to solve(), whenever the 
+// variables or constraints it was built with are changed.
+void GradientProjection::resetSolver() {
+    delete solver;
+    solver=NULL;
+    solverVars=solverConstraints=0;
+}
 void GradientProjection::destroyVPSC(IncSolver *vpsc) {
+    // Transient constraints and variables are deleted below, in which 
+    // case the solver cannot be reused.  The non-overlap constraints are
+    // kept until setupVPSC() finds that they have changed.
+    const bool keepSolver = lcs.empty() && sparseQ==NULL && 
+        solveWithMosek==Off;
     if(ccs) {
         for(CompoundConstraints::const_iterator c=ccs->begin(); 
                 c!=ccs->end();++c) {
@@ -457,7 +577,10 @@ void GradientProjection::destroyVPSC(IncSolver *vpsc) {
         delete *i;
     }
     lcs.clear();
-    delete vpsc;
+    if(!keepSolver) {
+        COLA_ASSERT(vpsc==solver);
+        resetSolver();
+    }
 #ifdef MOSEK_AVAILABLE
     if(solveWithMosek!=Off) mosek_delete(menv);
 #endif
@@ -469,6 +592,9 @@ void GradientProjection::straighten(
 {
     COLA_ASSERT(Q->rowSize()==snodes.size());
     COLA_ASSERT(vars.size()==numStaticVars);
+    // The solver may be kept from the last solve(), but it does not know
+    // about the variables and constraints added here.
+    resetSolver();
     sparseQ = Q;
     for(unsigned i=numStaticVars;i<snodes.size();i++) {
         Variable* v=new vpsc::Variable(i,snodes[i]->pos[k],1);
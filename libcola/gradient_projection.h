@@ -69,6 +69,25 @@ public:
         vpsc::Rectangles* rs = NULL,
         const bool scaling = false,
         SolveWithMosek solveWithMosek = Off);
+    /**
+     * As above, but with the graph laplacian given as a sparse matrix 
+     * (laplacian), so that each iteration takes time linear in its 
+     * number of nonzero entries rather than quadratic in the number of
+     * variables.  The matrix is not copied, even for scaling, and must
+     * remain valid while this object is in use.
+     */
+    GradientProjection(
+        const vpsc::Dim k,
+        cola::SparseMatrix const *laplacian,
+        const double tol,
+        const unsigned max_iterations,
+        CompoundConstraints const *ccs,
+        UnsatisfiableConstraintInfos *unsatisfiableConstraints,
+        NonOverlapConstraintsMode nonOverlapConstraints = None,
+        RootCluster* clusterHierarchy = NULL,
+        vpsc::Rectangles* rs = NULL,
+        const bool scaling = false,
+        SolveWithMosek solveWithMosek = Off);
     static void dumpSquareMatrix(std::valarray<double> const &L) {
         unsigned n=static_cast<unsigned>(floor(sqrt(static_cast<double>(L.size()))));
         printf("Matrix %dX%d\n{",n,n);
@@ -87,11 +106,15 @@ public:
         return numStaticVars;
     }
     ~GradientProjection() {
-        //destroyVPSC(solver);
+        delete solver;
         for(vpsc::Constraints::iterator i(gcs.begin()); i!=gcs.end(); i++) {
             delete *i;
         }
         gcs.clear();
+        for(vpsc::Constraints::iterator i(ocs.begin()); i!=ocs.end(); i++) {
+            delete *i;
+        }
+        ocs.clear();
         for(unsigned i=0;i<vars.size();i++) {
             delete vars[i];
         }
@@ -119,6 +142,21 @@ public:
         return result;
     }
 private:
+    GradientProjection(
+        const vpsc::Dim k,
+        std::valarray<double> *denseQ,
+        cola::SparseMatrix const *laplacian,
+        const double tol,
+        const unsigned max_iterations,
+        CompoundConstraints const *ccs,
+        UnsatisfiableConstraintInfos *unsatisfiableConstraints,
+        NonOverlapConstraintsMode nonOverlapConstraints,
+        RootCluster* clusterHierarchy,
+        vpsc::Rectangles* rs,
+        const bool scaling,
+        SolveWithMosek solveWithMosek);
+    void multiplyLaplacian(std::valarray<double> const &x,
+        std::valarray<double> &r) const;
     vpsc::IncSolver* setupVPSC();
     double computeCost(std::valarray<double> const &b,
         std::valarray<double> const &x) const;
@@ -132,12 +170,15 @@ private:
         std::valarray<double> const & g, std::valarray<double> const & d) const;
     bool runSolver(std::valarray<double> & result);
     void destroyVPSC(vpsc::IncSolver *vpsc);
+    void resetSolver();
     vpsc::Dim k;
     unsigned numStaticVars; // number of variables that persist
                               // throughout iterations
     const unsigned denseSize; // denseQ has denseSize^2 entries
     std::valarray<double> *denseQ; // dense square graph laplacian matrix
     std::valarray<double> scaledDenseQ; // scaled dense square graph laplacian matrix
+    cola::SparseMatrix const * laplacian; // sparse graph laplacian, used
+                                          // instead of denseQ if set
     std::vector<vpsc::Rectangle*>* rs;
     CompoundConstraints const *ccs;
     UnsatisfiableConstraintInfos *unsatisfiableConstraints;
@@ -151,12 +192,18 @@ private:
     vpsc::Constraints gcs; /* global constraints - persist throughout all
                                 iterations */
     vpsc::Constraints lcs; /* local constraints - only for current iteration */
-    vpsc::Constraints cs; /* working list of constraints: gcs +lcs */
+    vpsc::Constraints ocs; /* non-overlap constraints - kept while the
+                              overlap generator reports no change */
+    vpsc::Constraints cs; /* working list of constraints: gcs +lcs +ocs */
+    vpsc::OverlapConstraintGenerator overlapGenerator;
     std::valarray<double> result;
 #ifdef MOSEK_AVAILABLE
     MosekEnv* menv;
 #endif
+    // Kept between calls to solve() while the constraints do not change.
     vpsc::IncSolver* solver;
+    // The numbers of variables and constraints the solver was built with.
+    size_t solverVars, solverConstraints;
     SolveWithMosek solveWithMosek;
     const bool scaling;
     std::vector<OrthogonalEdgeConstraint*> orthogonalEdges;
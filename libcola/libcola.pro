@@ -24,7 +24,10 @@ SOURCES += cola.cpp \
     output_svg.cpp \
     cc_clustercontainmentconstraints.cpp \
     cc_nonoverlapconstraints.cpp \
-    box.cpp
+    box.cpp \
+    quadtree.cpp \
+    stress_kernels.cpp \
+    parallel.cpp
 HEADERS += cola.h \
     cluster.h \
     commondefs.h \
@@ -38,4 +41,7 @@ HEADERS += cola.h \
     cc_nonoverlapconstraints.h \
     unused.h \
     box.h \
+    quadtree.h \
+    stress_kernels.h \
+    parallel.h \
     config.h
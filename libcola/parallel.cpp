@@ -0,0 +1,116 @@
+/*
+ * vim: ts=4 sw=4 et tw=0 wm=0
+ *
+ * libcola - A library providing force-directed network layout using the
+ *           stress-majorization method subject to separation constraints.
+ *
+ * Copyright (C) 2014  Monash University
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * See the file LICENSE.LGPL distributed with the library.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+*/
+
+#include <cstddef>
+
+#include "libcola/parallel.h"
+
+namespace cola {
+
+ThreadPool::ThreadPool(const unsigned threads)
+    : m_task(NULL),
+      m_n(0),
+      m_chunks(0),
+      m_pending(0),
+      m_generation(0),
+      m_stop(false)
+{
+    const unsigned count = threadCount(threads);
+    m_workers.reserve(count - 1);
+    for (unsigned t = 1; t < count; ++t)
+    {
+        m_workers.push_back(std::thread(&ThreadPool::work, this, t));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_start.notify_all();
+    for (unsigned t = 0; t < m_workers.size(); ++t)
+    {
+        m_workers[t].join();
+    }
+}
+
+void ThreadPool::parallelFor(const unsigned n, const Task& f,
+        const unsigned minChunk)
+{
+    const unsigned chunks = std::max(1u,
+            std::min(size(), n / std::max(1u, minChunk)));
+    if (chunks == 1)
+    {
+        f(0u, n, 0u);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = &f;
+        m_n = n;
+        m_chunks = chunks;
+        m_pending = chunks - 1;
+        ++m_generation;
+    }
+    m_start.notify_all();
+    f(0u, (unsigned) ((unsigned long long) n / chunks), 0u);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_pending > 0)
+    {
+        m_finished.wait(lock);
+    }
+    m_task = NULL;
+}
+
+void ThreadPool::work(const unsigned t)
+{
+    unsigned seen = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        while (!m_stop && m_generation == seen)
+        {
+            m_start.wait(lock);
+        }
+        if (m_stop)
+        {
+            return;
+        }
+        seen = m_generation;
+        if (t >= m_chunks)
+        {
+            continue;
+        }
+        const Task& f = *m_task;
+        const unsigned n = m_n, chunks = m_chunks;
+        lock.unlock();
+        f((unsigned) ((unsigned long long) n * t / chunks),
+                (unsigned) ((unsigned long long) n * (t + 1) / chunks), t);
+        lock.lock();
+        if (--m_pending == 0)
+        {
+            m_finished.notify_one();
+        }
+    }
+}
+
+} // namespace cola
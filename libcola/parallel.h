@@ -0,0 +1,131 @@
+/*
+ * vim: ts=4 sw=4 et tw=0 wm=0
+ *
+ * libcola - A library providing force-directed network layout using the
+ *           stress-majorization method subject to separation constraints.
+ *
+ * Copyright (C) 2014  Monash University
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * See the file LICENSE.LGPL distributed with the library.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+*/
+
+#ifndef COLA_PARALLEL_H
+#define COLA_PARALLEL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+
+namespace cola {
+
+/*
+ * Returns the number of threads to use for a requested thread count,
+ * where zero means one per hardware thread.
+ */
+inline unsigned threadCount(const unsigned requested)
+{
+    if (requested > 0)
+    {
+        return requested;
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+/*
+ * Splits the range [0,n) into contiguous chunks, one per thread, and calls
+ * f(begin, end, chunk) for each of them concurrently.  The calling thread
+ * processes the first chunk.  The chunks depend only on n and threads, so
+ * results accumulated per chunk can be combined in chunk order to give
+ * the same answer on every run.
+ *
+ * f must not throw.
+ */
+template <typename Function>
+void parallelFor(const unsigned n, unsigned threads, Function f)
+{
+    threads = std::max(1u, std::min(threadCount(threads), n));
+    if (threads == 1)
+    {
+        f(0u, n, 0u);
+        return;
+    }
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (unsigned t = 1; t < threads; ++t)
+    {
+        unsigned begin = (unsigned) ((unsigned long long) n * t / threads);
+        unsigned end = (unsigned) ((unsigned long long) n * (t + 1) / threads);
+        workers.push_back(std::thread(f, begin, end, t));
+    }
+    f(0u, (unsigned) ((unsigned long long) n / threads), 0u);
+    for (unsigned t = 0; t < workers.size(); ++t)
+    {
+        workers[t].join();
+    }
+}
+
+/*
+ * A fixed set of worker threads for running parallelFor() repeatedly,
+ * e.g., once per layout iteration, without starting new threads each
+ * time.  The chunks are the same as for parallelFor() with the pool's
+ * number of threads, and chunk t is always run by the same thread.
+ *
+ * Only one parallelFor() may run on a pool at a time.
+ */
+class ThreadPool {
+public:
+    typedef std::function<void(unsigned, unsigned, unsigned)> Task;
+
+    /*
+     * Creates threads-1 workers, the calling thread being the other one.
+     * Zero means one thread per hardware thread.
+     */
+    explicit ThreadPool(const unsigned threads);
+    ~ThreadPool();
+
+    unsigned size() const
+    {
+        return m_workers.size() + 1;
+    }
+
+    /*
+     * As for the function parallelFor(), but the range is split into at
+     * most n/minChunk chunks so that small ranges are not split between
+     * threads at all.
+     */
+    void parallelFor(const unsigned n, const Task& f,
+            const unsigned minChunk = 1);
+
+private:
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    void work(const unsigned t);
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_start;
+    std::condition_variable m_finished;
+    const Task *m_task;
+    unsigned m_n;
+    unsigned m_chunks;
+    unsigned m_pending;
+    unsigned m_generation;
+    bool m_stop;
+};
+
+} // namespace cola
+
+#endif // COLA_PARALLEL_H
@@ -0,0 +1,197 @@
+/*
+ * vim: ts=4 sw=4 et tw=0 wm=0
+ *
+ * libcola - A library providing force-directed network layout using the
+ *           stress-majorization method subject to separation constraints.
+ *
+ * Copyright (C) 2014  Monash University
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * See the file LICENSE.LGPL distributed with the library.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+*/
+
+#include <algorithm>
+#include <cfloat>
+
+#include "libvpsc/assertions.h"
+#include "libcola/quadtree.h"
+
+namespace cola {
+
+namespace {
+// Predicate used to partition nodes about a split coordinate.
+struct BelowSplit {
+    BelowSplit(const std::valarray<double>& C, double split)
+        : C(C), split(split) {}
+    bool operator()(unsigned i) const {
+        return C[i] < split;
+    }
+    const std::valarray<double>& C;
+    double split;
+};
+}
+
+QuadTree::QuadTree(const std::valarray<double>& X,
+        const std::valarray<double>& Y,
+        const std::vector<unsigned>& components, const unsigned leafSize)
+    : X(X),
+      Y(Y),
+      m_leaf_size(std::max(1u, leafSize)),
+      m_components(components)
+{
+    COLA_ASSERT(X.size() == Y.size());
+    COLA_ASSERT(components.empty() || components.size() == X.size());
+    const unsigned n = X.size();
+    if (n == 0)
+    {
+        return;
+    }
+
+    // Order the nodes by component, and find where each one starts.
+    unsigned count = 1;
+    for (unsigned i = 0; i < components.size(); ++i)
+    {
+        count = std::max(count, components[i] + 1);
+    }
+    std::vector<unsigned> starts(count + 1, 0);
+    for (unsigned i = 0; i < n; ++i)
+    {
+        starts[(components.empty() ? 0 : components[i]) + 1]++;
+    }
+    for (unsigned c = 0; c < count; ++c)
+    {
+        starts[c + 1] += starts[c];
+    }
+    m_order.resize(n);
+    std::vector<unsigned> next(starts.begin(), starts.end() - 1);
+    for (unsigned i = 0; i < n; ++i)
+    {
+        m_order[next[components.empty() ? 0 : components[i]]++] = i;
+    }
+
+    // A tree with n leaves has fewer than 2n cells, reserve to avoid
+    // reallocation while building.
+    m_cells.reserve(2 * (n / m_leaf_size + count));
+    m_roots.assign(count, -1);
+    for (unsigned c = 0; c < count; ++c)
+    {
+        if (starts[c] == starts[c + 1])
+        {
+            continue;
+        }
+        double minX = DBL_MAX, minY = DBL_MAX;
+        double maxX = -DBL_MAX, maxY = -DBL_MAX;
+        for (unsigned i = starts[c]; i < starts[c + 1]; ++i)
+        {
+            minX = std::min(minX, X[m_order[i]]);
+            maxX = std::max(maxX, X[m_order[i]]);
+            minY = std::min(minY, Y[m_order[i]]);
+            maxY = std::max(maxY, Y[m_order[i]]);
+        }
+        m_roots[c] = build(starts[c], starts[c + 1], minX, minY,
+                std::max(maxX - minX, maxY - minY), 0);
+    }
+
+    m_position.resize(n);
+    for (unsigned i = 0; i < n; ++i)
+    {
+        m_position[m_order[i]] = i;
+    }
+}
+
+int QuadTree::build(unsigned begin, unsigned end, double minX, double minY,
+        double size, unsigned depth)
+{
+    int index = m_cells.size();
+    m_cells.push_back(Cell());
+    Cell cell;
+    cell.minX = minX;
+    cell.minY = minY;
+    cell.size = size;
+    cell.begin = begin;
+    cell.end = end;
+    cell.child[0] = cell.child[1] = cell.child[2] = cell.child[3] = -1;
+
+    double sx = 0, sy = 0;
+    for (unsigned i = begin; i < end; ++i)
+    {
+        sx += X[m_order[i]];
+        sy += Y[m_order[i]];
+    }
+    cell.cx = sx / (end - begin);
+    cell.cy = sy / (end - begin);
+
+    if ((end - begin) > m_leaf_size && depth < maxDepth && size > 0)
+    {
+        // Partition into quadrants: [begin,y0) bottom, [y0,end) top, and
+        // each of these into left and right halves.
+        double half = size / 2;
+        std::vector<unsigned>::iterator b = m_order.begin();
+        unsigned y0 = std::partition(b + begin, b + end,
+                BelowSplit(Y, minY + half)) - b;
+        unsigned x0 = std::partition(b + begin, b + y0,
+                BelowSplit(X, minX + half)) - b;
+        unsigned x1 = std::partition(b + y0, b + end,
+                BelowSplit(X, minX + half)) - b;
+        unsigned bounds[5] = { begin, x0, y0, x1, end };
+        for (unsigned q = 0; q < 4; ++q)
+        {
+            if (bounds[q] < bounds[q + 1])
+            {
+                cell.child[q] = build(bounds[q], bounds[q + 1],
+                        minX + ((q & 1) ? half : 0),
+                        minY + ((q & 2) ? half : 0), half, depth + 1);
+            }
+        }
+    }
+
+    // Choose the node nearest the centroid as the representative of the
+    // cell.  For internal cells the candidates are the children's
+    // representatives.
+    double best = DBL_MAX;
+    cell.rep = m_order[begin];
+    if (cell.isLeaf())
+    {
+        for (unsigned i = begin; i < end; ++i)
+        {
+            unsigned v = m_order[i];
+            double dx = X[v] - cell.cx, dy = Y[v] - cell.cy;
+            double d2 = dx * dx + dy * dy;
+            if (d2 < best)
+            {
+                best = d2;
+                cell.rep = v;
+            }
+        }
+    }
+    else
+    {
+        for (unsigned q = 0; q < 4; ++q)
+        {
+            if (cell.child[q] < 0)
+            {
+                continue;
+            }
+            unsigned v = m_cells[cell.child[q]].rep;
+            double dx = X[v] - cell.cx, dy = Y[v] - cell.cy;
+            double d2 = dx * dx + dy * dy;
+            if (d2 < best)
+            {
+                best = d2;
+                cell.rep = v;
+            }
+        }
+    }
+    m_cells[index] = cell;
+    return index;
+}
+
+} // namespace cola
@@ -0,0 +1,150 @@
+/*
+ * vim: ts=4 sw=4 et tw=0 wm=0
+ *
+ * libcola - A library providing force-directed network layout using the
+ *           stress-majorization method subject to separation constraints.
+ *
+ * Copyright (C) 2014  Monash University
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * See the file LICENSE.LGPL distributed with the library.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+*/
+
+#ifndef COLA_QUADTREE_H
+#define COLA_QUADTREE_H
+
+#include <vector>
+#include <valarray>
+#include <cmath>
+
+namespace cola {
+
+/*
+ * A point-region quadtree over node centres.  It is used by
+ * ConstrainedFDLayout to approximate the interactions between a node and
+ * a distant group of nodes by a single interaction with the centroid of
+ * that group (the Barnes-Hut approximation).
+ *
+ * The tree is rebuilt from scratch for each set of positions.  Cells are
+ * stored contiguously and refer to their children by index; each cell
+ * covers the contiguous range [begin,end) of the node permutation.
+ *
+ * If components are given, each component has a tree of its own, so that
+ * no cell mixes nodes of different components, and a node only visits
+ * the tree of its own component.
+ */
+class QuadTree {
+public:
+    struct Cell {
+        double minX, minY, size; // square bounds of the cell
+        double cx, cy;           // centroid of contained nodes
+        unsigned begin, end;     // range of contained nodes in order()
+        unsigned rep;            // contained node nearest to the centroid
+        int child[4];            // indexes of child cells, or -1
+        bool isLeaf() const {
+            return child[0] < 0 && child[1] < 0 &&
+                   child[2] < 0 && child[3] < 0;
+        }
+        unsigned count() const {
+            return end - begin;
+        }
+    };
+
+    QuadTree(const std::valarray<double>& X, const std::valarray<double>& Y,
+            const std::vector<unsigned>& components = std::vector<unsigned>(),
+            const unsigned leafSize = 8);
+
+    // Cells this deep are never subdivided further, so coincident nodes
+    // cannot cause unbounded recursion.
+    static const unsigned maxDepth = 24;
+
+    const std::vector<Cell>& cells() const {
+        return m_cells;
+    }
+    const std::vector<unsigned>& order() const {
+        return m_order;
+    }
+    // The index of node v in order().
+    unsigned position(const unsigned v) const {
+        return m_position[v];
+    }
+
+    /*
+     * Walks the tree on behalf of node u at position (x,y).  Cells that
+     * are sufficiently far away, i.e., size/distance < theta, are passed
+     * to visitor.group(cell); otherwise the cell is opened.  Nodes in
+     * opened leaf cells are passed individually to visitor.node(v).
+     * Node u itself is never passed to the visitor.
+     */
+    template <typename Visitor>
+    void visit(const unsigned u, const double x, const double y,
+            const double theta, Visitor& visitor) const
+    {
+        if (m_cells.empty())
+        {
+            return;
+        }
+        const double theta2 = theta * theta;
+        // The depth of the tree is bounded, so at most three siblings per
+        // level can be pending at any time.
+        int stack[3 * maxDepth + 4];
+        int top = 0;
+        stack[top++] = m_roots[m_components.empty() ? 0 : m_components[u]];
+        while (top > 0)
+        {
+            const Cell& c = m_cells[stack[--top]];
+            if (c.isLeaf())
+            {
+                for (unsigned i = c.begin; i < c.end; ++i)
+                {
+                    if (m_order[i] != u)
+                    {
+                        visitor.node(m_order[i]);
+                    }
+                }
+                continue;
+            }
+            double dx = x - c.cx, dy = y - c.cy;
+            bool inside = (x >= c.minX) && (x <= c.minX + c.size) &&
+                    (y >= c.minY) && (y <= c.minY + c.size);
+            if (!inside && (c.size * c.size < theta2 * (dx * dx + dy * dy)))
+            {
+                visitor.group(c);
+                continue;
+            }
+            for (unsigned q = 0; q < 4; ++q)
+            {
+                if (c.child[q] >= 0)
+                {
+                    stack[top++] = c.child[q];
+                }
+            }
+        }
+    }
+
+private:
+    int build(unsigned begin, unsigned end, double minX, double minY,
+            double size, unsigned depth);
+
+    const std::valarray<double>& X;
+    const std::valarray<double>& Y;
+    const unsigned m_leaf_size;
+    const std::vector<unsigned> m_components;
+    std::vector<Cell> m_cells;
+    std::vector<unsigned> m_order;
+    std::vector<unsigned> m_position;
+    // The root cell of each component's tree.
+    std::vector<int> m_roots;
+};
+
+} // namespace cola
+
+#endif // COLA_QUADTREE_H
@@ -31,6 +31,7 @@
 #include <limits>
 
 #include "libcola/commondefs.h"
+#include "libcola/parallel.h"
 #include <libvpsc/pairing_heap.h>
 #include <libvpsc/assertions.h>
 
@@ -84,15 +85,19 @@ void floyd_warshall(unsigned const n, T** D, std::vector<Edge> const & es,
         std::valarray<T> const & eweights = std::valarray<T>()); 
 
 /**
- * find all pairs shortest paths, faster, uses dijkstra
+ * find all pairs shortest paths, faster, uses dijkstra, or breadth first
+ * search if all edges have the same weight.  The rows of D are computed 
+ * independently, so are split between threads.
  * @param n total number of nodes
  * @param D n*n matrix of shortest paths
  * @param es edge pairs
  * @param eweights edge weights, if empty then all weights will be taken as 1
+ * @param threads number of threads to use, 0 for one per hardware thread
  */
 template <typename T>
 void johnsons(unsigned const n, T** D, std::vector<Edge> const & es,
-        std::valarray<T> const & eweights = std::valarray<T>());
+        std::valarray<T> const & eweights = std::valarray<T>(),
+        unsigned const threads = 1);
 /**
  * find shortest path lengths from node s to all other nodes
  * @param s starting node
@@ -227,17 +232,250 @@ void dijkstra(
     dijkstra(s,vs,d);
 }
 
+/*
+ * The graph in compressed sparse row form, for breadth first search.  The
+ * neighbours of node u are targets[offsets[u]] to targets[offsets[u+1]-1].
+ */
+struct CSRGraph {
+    CSRGraph(unsigned const n, std::vector<Edge> const & es)
+        : offsets(n+1,0), targets(2*es.size())
+    {
+        for(unsigned i=0;i<es.size();i++) {
+            COLA_ASSERT(es[i].first<n);
+            COLA_ASSERT(es[i].second<n);
+            offsets[es[i].first+1]++;
+            offsets[es[i].second+1]++;
+        }
+        for(unsigned u=0;u<n;u++) {
+            offsets[u+1]+=offsets[u];
+        }
+        std::vector<unsigned> next(offsets.begin(),offsets.end()-1);
+        for(unsigned i=0;i<es.size();i++) {
+            unsigned u=es[i].first, v=es[i].second;
+            targets[next[u]++]=v;
+            targets[next[v]++]=u;
+        }
+    }
+    std::vector<unsigned> offsets;
+    std::vector<unsigned> targets;
+};
+/*
+ * @return true if all edges have the same weight, which is written to w
+ */
+template <typename T>
+bool uniform_weights(std::valarray<T> const & eweights, T& w)
+{
+    w=1;
+    if(eweights.size()==0) {
+        return true;
+    }
+    w=eweights[0];
+    for(unsigned i=1;i<eweights.size();i++) {
+        if(eweights[i]!=w) {
+            return false;
+        }
+    }
+    return true;
+}
+/*
+ * Shortest path lengths from s for a graph where every edge has weight w.
+ * Path lengths are accumulated in the same order as dijkstra would, so 
+ * the results are identical.
+ * @param queue scratch space of at least n entries
+ */
+template <typename T>
+void bfs(
+        unsigned const s,
+        CSRGraph const & g,
+        T const w,
+        T* d,
+        std::vector<unsigned> & queue)
+{
+    const unsigned n=g.offsets.size()-1;
+    COLA_ASSERT(s<n);
+    COLA_ASSERT(queue.size()>=n);
+    for(unsigned i=0;i<n;i++) {
+        d[i]=std::numeric_limits<T>::max();
+    }
+    d[s]=0;
+    unsigned head=0, tail=0;
+    queue[tail++]=s;
+    while(head<tail) {
+        unsigned u=queue[head++];
+        T du=d[u]+w;
+        for(unsigned j=g.offsets[u];j<g.offsets[u+1];j++) {
+            unsigned v=g.targets[j];
+            if(d[v]==std::numeric_limits<T>::max()) {
+                d[v]=du;
+                queue[tail++]=v;
+            }
+        }
+    }
+}
+/*
+ * The nodes closest to s, for a graph where every edge has weight w.  The
+ * breadth first search stops once at least limit nodes have been reached,
+ * but always finishes the level it is on, so every node at a distance no 
+ * greater than the largest returned is included.  This takes time 
+ * proportional to the edges of the reached nodes rather than the graph.
+ * @param reached the nodes found, with their path lengths from s, in 
+ *        order of path length starting with s itself
+ */
+template <typename T>
+void nearest(
+        unsigned const s,
+        CSRGraph const & g,
+        T const w,
+        unsigned const limit,
+        std::vector<std::pair<unsigned,T> > & reached)
+{
+    const unsigned n=g.offsets.size()-1;
+    COLA_ASSERT(s<n);
+    std::vector<bool> seen(n,false);
+    reached.clear();
+    reached.push_back(std::make_pair(s,T(0)));
+    seen[s]=true;
+    size_t levelBegin=0;
+    T d=0;
+    while(levelBegin<reached.size() && reached.size()<limit) {
+        const size_t levelEnd=reached.size();
+        d+=w;
+        for(size_t i=levelBegin;i<levelEnd;i++) {
+            unsigned u=reached[i].first;
+            for(unsigned j=g.offsets[u];j<g.offsets[u+1];j++) {
+                unsigned v=g.targets[j];
+                if(!seen[v]) {
+                    seen[v]=true;
+                    reached.push_back(std::make_pair(v,d));
+                }
+            }
+        }
+        levelBegin=levelEnd;
+    }
+}
 template <typename T>
 void johnsons(
         unsigned const n,
         T** D, 
         std::vector<Edge> const & es,
-        std::valarray<T> const & eweights) 
+        std::valarray<T> const & eweights,
+        unsigned const threads) 
 {
-    std::vector<Node<T> > vs(n);
-    dijkstra_init(vs,es,eweights);
-    for(unsigned k=0;k<n;k++) {
-        dijkstra(k,vs,D[k]);
+    COLA_ASSERT((eweights.size() == 0) || (eweights.size() == es.size()));
+    T w;
+    if(uniform_weights(eweights,w)) {
+        const CSRGraph g(n,es);
+        cola::parallelFor(n,threads,
+            [&](unsigned begin, unsigned end, unsigned) {
+                std::vector<unsigned> queue(n);
+                for(unsigned k=begin;k<end;k++) {
+                    bfs(k,g,w,D[k],queue);
+                }
+            });
+    } else {
+        cola::parallelFor(n,threads,
+            [&](unsigned begin, unsigned end, unsigned) {
+                // dijkstra keeps its state in the nodes, so each thread 
+                // needs its own copy.
+                std::vector<Node<T> > vs(n);
+                dijkstra_init(vs,es,eweights);
+                for(unsigned k=begin;k<end;k++) {
+                    dijkstra(k,vs,D[k]);
+                }
+            });
+    }
+}
+/*
+ * Shortest path lengths from k pivot nodes to all nodes, for the sparse
+ * stress model.  Pivots are chosen by max-min selection, starting from 
+ * node 0, i.e., each new pivot is the node furthest from all previously
+ * chosen pivots, and each node is assigned to the region of its closest
+ * pivot.  The weight for node i and pivot p is the number of nodes in the
+ * region of p that are no further than half the distance from i to p, as
+ * described in Ortmann, Klimenta and Brandes, "A Sparse Stress Model", 
+ * GD 2016.
+ * @param scale factor applied to all path lengths
+ * @param ps the k pivots
+ * @param D k*n path lengths, D[p*n+i] is the length from pivot p to node i
+ * @param W n*k weights, W[i*k+p] is the weight for node i and pivot p,
+ *        zero if i is p or is not connected to p
+ */
+template <typename T>
+void pivots(
+        unsigned const n,
+        unsigned const k,
+        std::vector<Edge> const & es,
+        std::valarray<T> const & eweights,
+        T const scale,
+        std::vector<unsigned> & ps,
+        std::vector<T> & D,
+        std::vector<unsigned> & W)
+{
+    COLA_ASSERT(k<=n);
+    ps.resize(k);
+    D.resize(k*n);
+    W.assign(k*n,0);
+
+    // Use breadth first search if all edges have the same length.
+    T w;
+    const bool uniform=uniform_weights(eweights,w);
+    const CSRGraph g(n,es);
+    std::vector<unsigned> queue(n);
+    std::vector<Node<T> > vs;
+    if(!uniform) {
+        vs.resize(n);
+        dijkstra_init(vs,es,eweights);
+    }
+    // Distance from each node to its closest pivot so far.
+    std::vector<T> closest(n,std::numeric_limits<T>::max());
+    std::vector<unsigned> region(n,k);
+    unsigned pivot=0;
+    for(unsigned p=0;p<k;++p) {
+        ps[p]=pivot;
+        T* d=&D[p*n];
+        if(uniform) {
+            bfs(pivot,g,w,d,queue);
+        } else {
+            dijkstra(pivot,vs,d);
+        }
+        unsigned next=pivot;
+        T furthest=-1;
+        for(unsigned i=0;i<n;++i) {
+            if(d[i]!=std::numeric_limits<T>::max()) {
+                d[i]*=scale;
+            }
+            if(d[i]<closest[i]) {
+                closest[i]=d[i];
+                region[i]=p;
+            }
+            // Nodes not yet reachable from any pivot are furthest away,
+            // so each connected component gets a pivot.
+            if(closest[i]>furthest) {
+                furthest=closest[i];
+                next=i;
+            }
+        }
+        pivot=next;
+    }
+
+    // Sort the distances from each pivot to the nodes in its region, so
+    // the number within a given distance can be found by binary search.
+    std::vector<std::vector<T> > regionDistances(k);
+    for(unsigned i=0;i<n;++i) {
+        if(region[i]<k) {
+            regionDistances[region[i]].push_back(closest[i]);
+        }
+    }
+    for(unsigned p=0;p<k;++p) {
+        std::vector<T>& r=regionDistances[p];
+        std::sort(r.begin(),r.end());
+        const T* d=&D[p*n];
+        for(unsigned i=0;i<n;++i) {
+            if(d[i]==std::numeric_limits<T>::max() || i==ps[p]) {
+                continue;
+            }
+            W[i*k+p]=std::upper_bound(r.begin(),r.end(),d[i]/2)-r.begin();
+        }
     }
 }
 
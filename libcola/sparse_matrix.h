@@ -33,42 +33,103 @@
 #define _SPARSE_MATRIX_H
 
 #include <valarray>
-#include <map>
+#include <vector>
+#include <algorithm>
 #include <cstdio>
 
 #include "libvpsc/assertions.h"
 
 namespace cola {
+/*
+ * Accumulates the entries of a sparse n×n matrix, e.g., the Hessian, before
+ * it is converted to a SparseMatrix.  Entries are stored per row in column
+ * order, so that converting to the Yale format is a sequential copy.
+ *
+ * Each row remembers the position following its most recently accessed
+ * entry.  Rows are typically filled in column order, so most accesses
+ * either append to the row or hit the remembered position without a
+ * search.
+ *
+ * clear() zeroes the entries but keeps the sparsity pattern and the row
+ * storage.  Reusing one SparseMap across iterations whose pattern does not
+ * change therefore does no allocation and almost no searching.  Entries in
+ * the pattern that are not written again remain as explicit zeros, so use
+ * clearPattern() instead when the pattern varies between iterations.
+ */
 struct SparseMap {
-    SparseMap(unsigned n = 0) : n(n) {};
+    SparseMap(unsigned n = 0) : n(n), rows(n) {};
     unsigned n;
     typedef std::pair<unsigned, unsigned> SparseIndex;
-    typedef std::map<SparseIndex,double> SparseLookup;
-    typedef SparseLookup::const_iterator ConstIt;
-    SparseLookup lookup;
+    struct Row {
+        Row() : next(0) {}
+        std::vector<unsigned> cols;
+        std::vector<double> vals;
+        unsigned next;
+    };
+    std::vector<Row> rows;
     double& operator[](const SparseIndex& k) {
-        return lookup[k];
+        return (*this)(k.first,k.second);
     }
     double& operator()(const unsigned i, const unsigned j) {
-        return lookup[std::make_pair(i,j)]; 
+        COLA_ASSERT(i<n);
+        COLA_ASSERT(j<n);
+        Row& r=rows[i];
+        unsigned k=r.next;
+        if(k>=r.cols.size() || r.cols[k]!=j) {
+            if(r.cols.empty() || r.cols.back()<j) {
+                k=r.cols.size();
+                r.cols.push_back(j);
+                r.vals.push_back(0);
+            } else {
+                k=std::lower_bound(r.cols.begin(),r.cols.end(),j)
+                    -r.cols.begin();
+                if(r.cols[k]!=j) {
+                    r.cols.insert(r.cols.begin()+k,j);
+                    r.vals.insert(r.vals.begin()+k,0);
+                }
+            }
+        }
+        r.next=k+1;
+        return r.vals[k];
     }
     double getIJ(const unsigned i, const unsigned j) const {
         COLA_ASSERT(i<n);
         COLA_ASSERT(j<n);
-        ConstIt v=lookup.find(std::make_pair(i,j));
-        if(v!=lookup.end()) {
-            return v->second;
+        const Row& r=rows[i];
+        std::vector<unsigned>::const_iterator v=
+            std::lower_bound(r.cols.begin(),r.cols.end(),j);
+        if(v!=r.cols.end() && *v==j) {
+            return r.vals[v-r.cols.begin()];
         }
         return 0;
     }
     size_t nonZeroCount() const {
-        return lookup.size();
+        size_t nz=0;
+        for(unsigned i=0;i<n;i++) {
+            nz+=rows[i].cols.size();
+        }
+        return nz;
     }
     void resize(unsigned n) {
         this->n = n;
+        rows.resize(n);
     }
     void clear() {
-        lookup.clear();
+        for(unsigned i=0;i<n;i++) {
+            std::fill(rows[i].vals.begin(),rows[i].vals.end(),0);
+            rows[i].next=0;
+        }
+    }
+    /*
+     * Removes all entries, including the sparsity pattern, but keeps the
+     * row storage for reuse.
+     */
+    void clearPattern() {
+        for(unsigned i=0;i<n;i++) {
+            rows[i].cols.clear();
+            rows[i].vals.clear();
+            rows[i].next=0;
+        }
     }
 };
 /*
@@ -87,24 +148,15 @@ public:
             : n(m.n), NZ((unsigned)m.nonZeroCount()), sparseMap(m), 
               A(std::valarray<double>(NZ)), IA(std::valarray<unsigned>(n+1)), JA(std::valarray<unsigned>(NZ)) {
         unsigned cnt=0;
-        int lastrow=-1;
-        for(SparseMap::ConstIt i=m.lookup.begin(); i!=m.lookup.end(); i++) {
-            SparseMap::SparseIndex p = i->first;
-            COLA_ASSERT(p.first<n);
-            COLA_ASSERT(p.second<n);
-            A[cnt]=i->second;
-            if((int)p.first!=lastrow) {
-                for(unsigned r=lastrow+1;r<=p.first;r++) {
-                    IA[r]=cnt;
-                }
-                lastrow=p.first;
+        for(unsigned r=0;r<n;r++) {
+            IA[r]=cnt;
+            const SparseMap::Row& row=m.rows[r];
+            for(unsigned k=0;k<row.cols.size();k++,cnt++) {
+                A[cnt]=row.vals[k];
+                JA[cnt]=row.cols[k];
             }
-            JA[cnt]=p.second;
-            cnt++;
-        }
-        for(unsigned r=lastrow+1;r<=n;r++) {
-            IA[r]=NZ;
         }
+        IA[n]=cnt;
     }
     void rightMultiply(std::valarray<double> const & v, std::valarray<double> & r) const {
         COLA_ASSERT(v.size()>=n);
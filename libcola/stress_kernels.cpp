@@ -0,0 +1,357 @@
+/*
+ * vim: ts=4 sw=4 et tw=0 wm=0
+ *
+ * libcola - A library providing force-directed network layout using the
+ *           stress-majorization method subject to separation constraints.
+ *
+ * Copyright (C) 2014  Monash University
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * See the file LICENSE.LGPL distributed with the library.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+*/
+
+#include <cmath>
+#include <cfloat>
+
+#include "libcola/stress_kernels.h"
+
+// The vectorised kernels use GCC/Clang target attributes so that they can
+// be compiled without raising the minimum instruction set of the library.
+#if (defined(__GNUC__) || defined(__clang__)) && \
+        (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define COLA_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace cola {
+
+// Ideal distances above this have no attractive term in
+// ConstrainedMajorizationLayout.
+static const double majorizationLongDistance = 80;
+
+/*
+ * The scalar kernels, also used for the elements left over by the vector
+ * kernels.  The vector kernels perform the same operations in the same
+ * order, so give identical results.
+ */
+static inline void scalarForceTerm(const double x, const double y,
+        const double X, const double Y, const double d,
+        const unsigned short p, double& g, double& h)
+{
+    double rx=x-X, ry=y-Y;
+    double l=sqrt(rx*rx+ry*ry);
+    if(p==0 || (l>d && p>1)) {
+        g=h=0;
+        return;
+    }
+    if(l<1e-30) {
+        l=0.1;
+    }
+    double d2=d*d;
+    g=rx*(l-d)/(d2*l);
+    h=(d*ry*ry/(l*l*l)-1)/d2;
+}
+
+static inline double scalarStressTerm(const double x, const double y,
+        const double X, const double Y, const double d,
+        const unsigned short p)
+{
+    double rx=x-X, ry=y-Y;
+    double l=sqrt(rx*rx+ry*ry);
+    if(p==0 || (l>d && p>1)) {
+        return 0;
+    }
+    double rl=d-l;
+    return rl*rl/(d*d);
+}
+
+static inline double scalarMajorizationTerm(const double x, const double y,
+        const double X, const double Y, const double d)
+{
+    if(!(d<DBL_MAX)) {
+        return 0;
+    }
+    double rx=x-X, ry=y-Y;
+    double diff=d-sqrt(rx*rx+ry*ry);
+    if(d>majorizationLongDistance && diff<0) {
+        return 0;
+    }
+    return diff*diff/(d*d);
+}
+
+static void scalarForceTerms(const unsigned n, const double x,
+        const double y, const double* X, const double* Y, const double* D,
+        const unsigned short* G, double* g, double* h)
+{
+    for(unsigned v=0;v<n;v++) {
+        scalarForceTerm(x,y,X[v],Y[v],D[v],G[v],g[v],h[v]);
+    }
+}
+
+static void scalarStressTerms(const unsigned n, const double x,
+        const double y, const double* X, const double* Y, const double* D,
+        const unsigned short* G, double* s)
+{
+    for(unsigned v=0;v<n;v++) {
+        s[v]=scalarStressTerm(x,y,X[v],Y[v],D[v],G[v]);
+    }
+}
+
+static void scalarMajorizationTerms(const unsigned n, const double x,
+        const double y, const double* X, const double* Y, const double* D,
+        double* s)
+{
+    for(unsigned v=0;v<n;v++) {
+        s[v]=scalarMajorizationTerm(x,y,X[v],Y[v],D[v]);
+    }
+}
+
+#ifdef COLA_X86_KERNELS
+
+/*
+ * SSE2, two pairs at a time.  Lanes for which there is no term are
+ * computed anyway and then masked to zero.
+ */
+static void sse2ForceTerms(const unsigned n, const double x,
+        const double y, const double* X, const double* Y, const double* D,
+        const unsigned short* G, double* g, double* h)
+{
+    const __m128d vx=_mm_set1_pd(x), vy=_mm_set1_pd(y);
+    const __m128d zero=_mm_setzero_pd(), one=_mm_set1_pd(1);
+    const __m128d tiny=_mm_set1_pd(1e-30), small=_mm_set1_pd(0.1);
+    unsigned v=0;
+    for(;v+2<=n;v+=2) {
+        __m128d rx=_mm_sub_pd(vx,_mm_loadu_pd(X+v));
+        __m128d ry=_mm_sub_pd(vy,_mm_loadu_pd(Y+v));
+        __m128d d=_mm_loadu_pd(D+v);
+        __m128d p=_mm_set_pd(G[v+1],G[v]);
+        __m128d l=_mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(rx,rx),
+                    _mm_mul_pd(ry,ry)));
+        __m128d skip=_mm_or_pd(_mm_cmpeq_pd(p,zero),
+                _mm_and_pd(_mm_cmpgt_pd(l,d),_mm_cmpgt_pd(p,one)));
+        __m128d isTiny=_mm_cmplt_pd(l,tiny);
+        l=_mm_or_pd(_mm_and_pd(isTiny,small),_mm_andnot_pd(isTiny,l));
+        __m128d d2=_mm_mul_pd(d,d);
+        __m128d gv=_mm_div_pd(_mm_mul_pd(rx,_mm_sub_pd(l,d)),
+                _mm_mul_pd(d2,l));
+        __m128d l3=_mm_mul_pd(_mm_mul_pd(l,l),l);
+        __m128d hv=_mm_div_pd(_mm_sub_pd(_mm_div_pd(
+                        _mm_mul_pd(_mm_mul_pd(d,ry),ry),l3),one),d2);
+        _mm_storeu_pd(g+v,_mm_andnot_pd(skip,gv));
+        _mm_storeu_pd(h+v,_mm_andnot_pd(skip,hv));
+    }
+    scalarForceTerms(n-v,x,y,X+v,Y+v,D+v,G+v,g+v,h+v);
+}
+
+static void sse2StressTerms(const unsigned n, const double x,
+        const double y, const double* X, const double* Y, const double* D,
+        const unsigned short* G, double* s)
+{
+    const __m128d vx=_mm_set1_pd(x), vy=_mm_set1_pd(y);
+    const __m128d zero=_mm_setzero_pd(), one=_mm_set1_pd(1);
+    unsigned v=0;
+    for(;v+2<=n;v+=2) {
+        __m128d rx=_mm_sub_pd(vx,_mm_loadu_pd(X+v));
+        __m128d ry=_mm_sub_pd(vy,_mm_loadu_pd(Y+v));
+        __m128d d=_mm_loadu_pd(D+v);
+        __m128d p=_mm_set_pd(G[v+1],G[v]);
+        __m128d l=_mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(rx,rx),
+                    _mm_mul_pd(ry,ry)));
+        __m128d skip=_mm_or_pd(_mm_cmpeq_pd(p,zero),
+                _mm_and_pd(_mm_cmpgt_pd(l,d),_mm_cmpgt_pd(p,one)));
+        __m128d rl=_mm_sub_pd(d,l);
+        __m128d sv=_mm_div_pd(_mm_mul_pd(rl,rl),_mm_mul_pd(d,d));
+        _mm_storeu_pd(s+v,_mm_andnot_pd(skip,sv));
+    }
+    scalarStressTerms(n-v,x,y,X+v,Y+v,D+v,G+v,s+v);
+}
+
+static void sse2MajorizationTerms(const unsigned n, const double x,
+        const double y, const double* X, const double* Y, const double* D,
+        double* s)
+{
+    const __m128d vx=_mm_set1_pd(x), vy=_mm_set1_pd(y);
+    const __m128d zero=_mm_setzero_pd(), maxDistance=_mm_set1_pd(DBL_MAX);
+    const __m128d longDistance=_mm_set1_pd(majorizationLongDistance);
+    unsigned v=0;
+    for(;v+2<=n;v+=2) {
+        __m128d rx=_mm_sub_pd(vx,_mm_loadu_pd(X+v));
+        __m128d ry=_mm_sub_pd(vy,_mm_loadu_pd(Y+v));
+        __m128d d=_mm_loadu_pd(D+v);
+        __m128d diff=_mm_sub_pd(d,_mm_sqrt_pd(_mm_add_pd(
+                        _mm_mul_pd(rx,rx),_mm_mul_pd(ry,ry))));
+        __m128d keep=_mm_andnot_pd(_mm_and_pd(_mm_cmpgt_pd(d,longDistance),
+                    _mm_cmplt_pd(diff,zero)),_mm_cmplt_pd(d,maxDistance));
+        __m128d sv=_mm_div_pd(_mm_mul_pd(diff,diff),_mm_mul_pd(d,d));
+        _mm_storeu_pd(s+v,_mm_and_pd(keep,sv));
+    }
+    scalarMajorizationTerms(n-v,x,y,X+v,Y+v,D+v,s+v);
+}
+
+/*
+ * AVX2, four pairs at a time, otherwise as for SSE2.
+ */
+#define COLA_AVX2 __attribute__((target("avx2")))
+
+static inline COLA_AVX2 __m256d avx2LoadG(const unsigned short* G)
+{
+    return _mm256_cvtepi32_pd(_mm_cvtepu16_epi32(
+                _mm_loadl_epi64((const __m128i*)G)));
+}
+
+static COLA_AVX2 void avx2ForceTerms(const unsigned n, const double x,
+        const double y, const double* X, const double* Y, const double* D,
+        const unsigned short* G, double* g, double* h)
+{
+    const __m256d vx=_mm256_set1_pd(x), vy=_mm256_set1_pd(y);
+    const __m256d zero=_mm256_setzero_pd(), one=_mm256_set1_pd(1);
+    const __m256d tiny=_mm256_set1_pd(1e-30), small=_mm256_set1_pd(0.1);
+    unsigned v=0;
+    for(;v+4<=n;v+=4) {
+        __m256d rx=_mm256_sub_pd(vx,_mm256_loadu_pd(X+v));
+        __m256d ry=_mm256_sub_pd(vy,_mm256_loadu_pd(Y+v));
+        __m256d d=_mm256_loadu_pd(D+v);
+        __m256d p=avx2LoadG(G+v);
+        __m256d l=_mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(rx,rx),
+                    _mm256_mul_pd(ry,ry)));
+        __m256d skip=_mm256_or_pd(_mm256_cmp_pd(p,zero,_CMP_EQ_OQ),
+                _mm256_and_pd(_mm256_cmp_pd(l,d,_CMP_GT_OQ),
+                    _mm256_cmp_pd(p,one,_CMP_GT_OQ)));
+        l=_mm256_blendv_pd(l,small,_mm256_cmp_pd(l,tiny,_CMP_LT_OQ));
+        __m256d d2=_mm256_mul_pd(d,d);
+        __m256d gv=_mm256_div_pd(_mm256_mul_pd(rx,_mm256_sub_pd(l,d)),
+                _mm256_mul_pd(d2,l));
+        __m256d l3=_mm256_mul_pd(_mm256_mul_pd(l,l),l);
+        __m256d hv=_mm256_div_pd(_mm256_sub_pd(_mm256_div_pd(
+                        _mm256_mul_pd(_mm256_mul_pd(d,ry),ry),l3),one),d2);
+        _mm256_storeu_pd(g+v,_mm256_andnot_pd(skip,gv));
+        _mm256_storeu_pd(h+v,_mm256_andnot_pd(skip,hv));
+    }
+    scalarForceTerms(n-v,x,y,X+v,Y+v,D+v,G+v,g+v,h+v);
+}
+
+static COLA_AVX2 void avx2StressTerms(const unsigned n, const double x,
+        const double y, const double* X, const double* Y, const double* D,
+        const unsigned short* G, double* s)
+{
+    const __m256d vx=_mm256_set1_pd(x), vy=_mm256_set1_pd(y);
+    const __m256d zero=_mm256_setzero_pd(), one=_mm256_set1_pd(1);
+    unsigned v=0;
+    for(;v+4<=n;v+=4) {
+        __m256d rx=_mm256_sub_pd(vx,_mm256_loadu_pd(X+v));
+        __m256d ry=_mm256_sub_pd(vy,_mm256_loadu_pd(Y+v));
+        __m256d d=_mm256_loadu_pd(D+v);
+        __m256d p=avx2LoadG(G+v);
+        __m256d l=_mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(rx,rx),
+                    _mm256_mul_pd(ry,ry)));
+        __m256d skip=_mm256_or_pd(_mm256_cmp_pd(p,zero,_CMP_EQ_OQ),
+                _mm256_and_pd(_mm256_cmp_pd(l,d,_CMP_GT_OQ),
+                    _mm256_cmp_pd(p,one,_CMP_GT_OQ)));
+        __m256d rl=_mm256_sub_pd(d,l);
+        __m256d sv=_mm256_div_pd(_mm256_mul_pd(rl,rl),_mm256_mul_pd(d,d));
+        _mm256_storeu_pd(s+v,_mm256_andnot_pd(skip,sv));
+    }
+    scalarStressTerms(n-v,x,y,X+v,Y+v,D+v,G+v,s+v);
+}
+
+static COLA_AVX2 void avx2MajorizationTerms(const unsigned n,
+        const double x, const double y, const double* X, const double* Y,
+        const double* D, double* s)
+{
+    const __m256d vx=_mm256_set1_pd(x), vy=_mm256_set1_pd(y);
+    const __m256d zero=_mm256_setzero_pd(), maxDistance=_mm256_set1_pd(DBL_MAX);
+    const __m256d longDistance=_mm256_set1_pd(majorizationLongDistance);
+    unsigned v=0;
+    for(;v+4<=n;v+=4) {
+        __m256d rx=_mm256_sub_pd(vx,_mm256_loadu_pd(X+v));
+        __m256d ry=_mm256_sub_pd(vy,_mm256_loadu_pd(Y+v));
+        __m256d d=_mm256_loadu_pd(D+v);
+        __m256d diff=_mm256_sub_pd(d,_mm256_sqrt_pd(_mm256_add_pd(
+                        _mm256_mul_pd(rx,rx),_mm256_mul_pd(ry,ry))));
+        __m256d keep=_mm256_andnot_pd(_mm256_and_pd(
+                    _mm256_cmp_pd(d,longDistance,_CMP_GT_OQ),
+                    _mm256_cmp_pd(diff,zero,_CMP_LT_OQ)),
+                _mm256_cmp_pd(d,maxDistance,_CMP_LT_OQ));
+        __m256d sv=_mm256_div_pd(_mm256_mul_pd(diff,diff),
+                _mm256_mul_pd(d,d));
+        _mm256_storeu_pd(s+v,_mm256_and_pd(keep,sv));
+    }
+    scalarMajorizationTerms(n-v,x,y,X+v,Y+v,D+v,s+v);
+}
+
+#endif // COLA_X86_KERNELS
+
+namespace {
+typedef void (*ForceTermsFn)(const unsigned, const double, const double,
+        const double*, const double*, const double*, const unsigned short*,
+        double*, double*);
+typedef void (*StressTermsFn)(const unsigned, const double, const double,
+        const double*, const double*, const double*, const unsigned short*,
+        double*);
+typedef void (*MajorizationTermsFn)(const unsigned, const double,
+        const double, const double*, const double*, const double*, double*);
+
+struct Kernels {
+    Kernels()
+        : forceTerms(scalarForceTerms),
+          stressTerms(scalarStressTerms),
+          majorizationTerms(scalarMajorizationTerms)
+    {
+#ifdef COLA_X86_KERNELS
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            forceTerms = avx2ForceTerms;
+            stressTerms = avx2StressTerms;
+            majorizationTerms = avx2MajorizationTerms;
+        }
+        else
+        {
+            forceTerms = sse2ForceTerms;
+            stressTerms = sse2StressTerms;
+            majorizationTerms = sse2MajorizationTerms;
+        }
+#endif
+    }
+    ForceTermsFn forceTerms;
+    StressTermsFn stressTerms;
+    MajorizationTermsFn majorizationTerms;
+};
+
+const Kernels& kernels()
+{
+    static const Kernels k;
+    return k;
+}
+}
+
+void stressForceTerms(const unsigned n, const double x, const double y,
+        const double* X, const double* Y, const double* D,
+        const unsigned short* G, double* g, double* h)
+{
+    kernels().forceTerms(n,x,y,X,Y,D,G,g,h);
+}
+
+void stressTerms(const unsigned n, const double x, const double y,
+        const double* X, const double* Y, const double* D,
+        const unsigned short* G, double* s)
+{
+    kernels().stressTerms(n,x,y,X,Y,D,G,s);
+}
+
+void majorizationStressTerms(const unsigned n, const double x,
+        const double y, const double* X, const double* Y, const double* D,
+        double* s)
+{
+    kernels().majorizationTerms(n,x,y,X,Y,D,s);
+}
+
+} // namespace cola
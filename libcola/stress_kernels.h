@@ -0,0 +1,70 @@
+/*
+ * vim: ts=4 sw=4 et tw=0 wm=0
+ *
+ * libcola - A library providing force-directed network layout using the
+ *           stress-majorization method subject to separation constraints.
+ *
+ * Copyright (C) 2014  Monash University
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * See the file LICENSE.LGPL distributed with the library.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+*/
+
+#ifndef COLA_STRESS_KERNELS_H
+#define COLA_STRESS_KERNELS_H
+
+namespace cola {
+
+/*
+ * Inner loops of the stress model, computing the terms between one node
+ * at (x,y) and nodes [0,n) with coordinates in the arrays X and Y.  The
+ * terms are written to output arrays rather than summed so that callers
+ * can accumulate them in order: the results are then the same whichever
+ * implementation is used.
+ *
+ * On x86 the implementation is chosen at run time from AVX2, SSE2 and
+ * plain C++, according to what the processor supports.
+ */
+
+/*
+ * Gradient and Hessian terms of the stress model, see
+ * ConstrainedFDLayout::computeForces().  D and G are rows of the ideal
+ * distance and pair type matrices.  X is the coordinate in the dimension
+ * of the forces and Y the other one.  For each v:
+ *   g[v] = (x-X[v])(l-D[v])/(D[v]^2 l)
+ *   h[v] = (D[v](y-Y[v])^2/l^3 - 1)/D[v]^2
+ * where l is the distance between the nodes, or both are zero if there
+ * is no force between them.
+ */
+void stressForceTerms(const unsigned n, const double x, const double y,
+        const double* X, const double* Y, const double* D,
+        const unsigned short* G, double* g, double* h);
+
+/*
+ * Stress between pairs, (D[v]-l)^2/D[v]^2, or zero if there is no stress
+ * term, see ConstrainedFDLayout::computeStress().
+ */
+void stressTerms(const unsigned n, const double x, const double y,
+        const double* X, const double* Y, const double* D,
+        const unsigned short* G, double* s);
+
+/*
+ * Stress between pairs as used by ConstrainedMajorizationLayout, which has
+ * no pair type matrix: pairs with infinite distance are skipped, as are
+ * pairs further apart than a long ideal distance.
+ */
+void majorizationStressTerms(const unsigned n, const double x,
+        const double y, const double* X, const double* Y, const double* D,
+        double* s);
+
+} // namespace cola
+
+#endif // COLA_STRESS_KERNELS_H
@@ -189,6 +189,7 @@ Canvas::Canvas()
       m_canvas_font(NULL),
       m_canvas_font_size(DEFAULT_CANVAS_FONT_SIZE),
       m_animation_group(NULL),
+      m_graph_structure_revision(0),
       m_focal_mode(false)
 {
     m_ideal_connector_length = 100;
@@ -326,6 +327,14 @@ bool Canvas::loadDiagram(const QString& filename)
     }
     else
     {
+        if (views().empty())
+        {
+            qWarning("The document \"%s\" could not be loaded: %s",
+                    qPrintable(fileInfo.fileName()),
+                    qPrintable(errorMessage));
+            return successful;
+        }
+
         // We weren't successful loading, so show an error message.
         QString warning = QString(
                 QObject::tr("<p><b>The document \"%1\" could not be loaded.</b></p>"
@@ -2119,6 +2128,12 @@ void Canvas::processLayoutFinishedEvent(void)
 
         printf("************** Avg Framerate: %g\n", m_convergence_update_count / elapsedSecs);
         printf("************** Time to converge: %g\n", elapsedSecs);
+        printf("************** Layout iterations/sec: %g\n",
+                m_graphlayout->iterationsPerSecond());
+        printf("************** Last frame time (ms): %g\n",
+                m_graphlayout->lastFrameTime());
+        printf("************** Dropped frames: %u\n",
+                m_graphlayout->droppedFrameCount());
         m_convergence_update_count = 0;
         m_convergence_timer_running = false;
     }
@@ -2156,20 +2171,7 @@ void Canvas::processLayoutFinishedEvent(void)
 
     if (m_batch_diagram_layout && !changes)
     {
-        // Reroute connectors.
-        reroute_connectors(this, true, true);
-        // Nudge connectors if requested (-w option)
-        if (m_connector_nudge_distance > 0)
-        {
-            nudgeConnectors(this, m_connector_nudge_distance, true);
-        }
-        // redo the connector interference coloring after nudging
-        if (m_opt_colour_interfering_connectors)
-        {
-            colourInterferingConnectors(this);
-        }
-        // Fit the page size to the entire diagram.
-        //QT getPageSize(NULL, NULL, NULL, NULL, BUT_FITPAGETODIAGRAM);
+        finishBatchDiagramLayout();
         // Save the SVG and exit.
         //QT saveDiagramAsSVG(this, filename());
         exit(EXIT_SUCCESS);
@@ -2177,6 +2179,57 @@ void Canvas::processLayoutFinishedEvent(void)
 }
 
 
+void Canvas::finishBatchDiagramLayout(void)
+{
+    // Reroute connectors.
+    reroute_connectors(this, true, true);
+    // Nudge connectors if requested (-w option)
+    if (m_connector_nudge_distance > 0)
+    {
+        nudgeConnectors(this, m_connector_nudge_distance, true);
+    }
+    // redo the connector interference coloring after nudging
+    if (m_opt_colour_interfering_connectors)
+    {
+        colourInterferingConnectors(this);
+    }
+    // Fit the page size to the entire diagram.
+    //QT getPageSize(NULL, NULL, NULL, NULL, BUT_FITPAGETODIAGRAM);
+}
+
+
+void Canvas::setBatchDiagramLayout(const bool value)
+{
+    m_batch_diagram_layout = value;
+}
+
+
+bool Canvas::processBatchDiagram(const QString& inputFilename,
+        const QString& outputFilename, QString& errorMessage)
+{
+    assert(views().empty());
+
+    // Layout is run below rather than by the layout thread, so changes
+    // made while loading just update its fixed positions.
+    m_batch_diagram_layout = true;
+    m_graphlayout->setThreaded(false);
+
+    PluginFileIOFactory *fileIOFactory = sharedPluginFileIOFactory();
+    if (!fileIOFactory->loadDiagramFromFile(this, QFileInfo(inputFilename),
+            errorMessage))
+    {
+        return false;
+    }
+    postDiagramLoad();
+
+    m_graphlayout->runToCompletion(!m_opt_automatic_graph_layout);
+    finishBatchDiagramLayout();
+
+    return fileIOFactory->saveDiagramToFile(this, QFileInfo(outputFilename),
+            errorMessage);
+}
+
+
 QSvgRenderer *Canvas::svgRenderer(void) const
 {
     return m_svg_renderer;
@@ -2380,8 +2433,19 @@ void Canvas::processUndoResponseTasks(void)
     reroute_connectors(this);
 }
 
+void Canvas::graphStructureChanged(void)
+{
+    m_graph_structure_revision.ref();
+}
+
+int Canvas::graphStructureRevision(void) const
+{
+    return m_graph_structure_revision.load();
+}
+
 void Canvas::fully_restart_graph_layout(void)
 {
+    graphStructureChanged();
     GraphLayout* gl = m_graphlayout;
     gl->setInterruptFromDunnart();
     gl->setRestartFromDunnart();
@@ -3021,6 +3085,14 @@ void Canvas::saveDiagram(const QString& outputFilename)
     }
     else
     {
+        if (views().empty())
+        {
+            qWarning("The document \"%s\" could not be saved: %s",
+                    qPrintable(fileInfo.fileName()),
+                    qPrintable(errorMessage));
+            return;
+        }
+
         // We weren't successful saving, so show an error message.
         QString warning = QString(
                 QObject::tr("<p><b>The document \"%1\" could not be saved.</b></p>"
@@ -40,6 +40,7 @@
 #include <QUndoCommand>
 #include <QColor>
 #include <QElapsedTimer>
+#include <QAtomicInt>
 
 class QToolBar;
 class QStatusBar;
@@ -193,6 +194,10 @@ class Canvas : public QGraphicsScene
         void stop_graph_layout(void);
         void restart_graph_layout(void);
         void fully_restart_graph_layout(void);
+        // Called when something the layout's GraphData is built from (other
+        // than positions) changes, so that it is rebuilt for the next run.
+        void graphStructureChanged(void);
+        int graphStructureRevision(void) const;
 
         CanvasItem *getItemByID(QString ID) const;
         CanvasItem *getItemByInternalId(uint internalId) const;
@@ -246,6 +251,12 @@ class Canvas : public QGraphicsScene
         void endUndoMacro(void);
 
         void saveDiagram(const QString& outputFilename);
+        // Loads a diagram, lays it out and routes it on the calling
+        // thread, then saves it.  For batch processing without a GUI, on a
+        // canvas with no views.
+        bool processBatchDiagram(const QString& inputFilename,
+                const QString& outputFilename, QString& errorMessage);
+        void setBatchDiagramLayout(const bool value);
         const QList<QColor> interferingConnectorColours(void) const;
         double visualPageBuffer(void) const;
         bool useGmlClusters(void) const;
@@ -365,6 +376,7 @@ class Canvas : public QGraphicsScene
         void glueObjectsToIndicators(void);
         bool hasVisibleOverlays(void) const;
         void updateConnectorsForLayout(void);
+        void finishBatchDiagramLayout(void);
 
         double m_visual_page_buffer;
         QString m_filename;
@@ -453,6 +465,8 @@ class Canvas : public QGraphicsScene
         QFont *m_canvas_font;
         unsigned int m_canvas_font_size;
         QParallelAnimationGroup *m_animation_group;
+        // Read by the layout thread, so atomic.
+        QAtomicInt m_graph_structure_revision;
 
 #ifdef FPSTIMER
         QElapsedTimer m_convergence_timer;
@@ -642,6 +642,7 @@ QVariant CanvasItem::itemChange(GraphicsItemChange change,
         {
             // Being removed from the canvas
             routerRemove();
+            canvas()->graphStructureChanged();
         }
     }
     else if (change == QGraphicsItem::ItemSceneHasChanged)
@@ -653,6 +654,7 @@ QVariant CanvasItem::itemChange(GraphicsItemChange change,
             m_internal_id = canvas()->assignInternalId();
             // Being added to canvas
             routerAdd();
+            canvas()->graphStructureChanged();
         }
     }
     return value;
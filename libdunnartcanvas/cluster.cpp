@@ -605,6 +605,7 @@ QAction *Cluster::buildAndExecContextMenu(QGraphicsSceneMouseEvent *event,
     if (action == changeTypeAction)
     {
         rectangular = !rectangular;
+        canvas()->graphStructureChanged();
         canvas()->restart_graph_layout();
     }
 
@@ -823,6 +823,7 @@ void Connector::setObeysDirectedEdgeConstraints(const bool value)
 
     if (canvas())
     {
+        canvas()->graphStructureChanged();
         canvas()->interrupt_graph_layout();
     }
 }
@@ -24,11 +24,13 @@
 */
 #include <QtGlobal>
 #include <vector>
+#include <set>
 #include <algorithm>
 #include <string>
 //#include <tr1/functional>
 #include <functional>
 #include <iostream>
+#include <limits>
 
 #include <ogdf/fileformats/GmlParser.h>
 #include <ogdf/energybased/FMMMLayout.h>
@@ -86,6 +88,58 @@ bool Box::overlaps(const Box o) const {
     return intervalOverlap(x,X,o.x,o.X) && intervalOverlap(y,Y,o.y,o.Y);
 }
 
+NodeGrid::NodeGrid() : valid(false), x(0), y(0), cellSize(1), cols(0), rows(0)
+{ }
+
+void NodeGrid::build(const ogdf::Graph& G, const ogdf::GraphAttributes& GA) {
+    valid=true;
+    starts.clear();
+    nodes.clear();
+    cols=rows=0;
+    const int n=G.numberOfNodes();
+    if(n==0) {
+        return;
+    }
+    ogdf::node v;
+    double X=-DBL_MAX, Y=-DBL_MAX;
+    x=y=DBL_MAX;
+    forall_nodes(v,G) {
+        x=qMin(x,GA.x(v)); y=qMin(y,GA.y(v));
+        X=qMax(X,GA.x(v)); Y=qMax(Y,GA.y(v));
+    }
+    // Cells no smaller than this keep the grid to O(n) cells, even for a
+    // very long thin layout.
+    const double w=X-x, h=Y-y;
+    cellSize=qMax(sqrt(w*h/n),qMax(w,h)/n);
+    if(cellSize<=0) {
+        cellSize=1;
+    }
+    cols=static_cast<int>(w/cellSize)+1;
+    rows=static_cast<int>(h/cellSize)+1;
+    starts.assign(cols*rows+1,0);
+    forall_nodes(v,G) {
+        starts[row(GA.y(v))*cols+col(GA.x(v))+1]++;
+    }
+    for(int c=0;c<cols*rows;c++) {
+        starts[c+1]+=starts[c];
+    }
+    vector<unsigned> next(starts.begin(),starts.end()-1);
+    nodes.resize(n);
+    forall_nodes(v,G) {
+        nodes[next[row(GA.y(v))*cols+col(GA.x(v))]++]=v;
+    }
+}
+
+int NodeGrid::col(double px) const {
+    int c=static_cast<int>(floor((px-x)/cellSize));
+    return qBound(0,c,cols-1);
+}
+
+int NodeGrid::row(double py) const {
+    int r=static_cast<int>(floor((py-y)/cellSize));
+    return qBound(0,r,rows-1);
+}
+
 Page::Page(Canvas *canvas) : canvas(canvas)
 { }
 
@@ -130,6 +184,8 @@ Graph::Graph(Canvas *canvas, string gmlFile, Page page, COff canvasOffset)
       scale(2),
       canvasShapesLimit(30), 
       time(0),
+      focusDistancesCacheLimit(16),
+      adjacency(NULL),
       UML(true),
       UseClusters(canvas->useGmlClusters())
 {
@@ -171,6 +227,15 @@ Graph::Graph(Canvas *canvas, string gmlFile, Page page, COff canvasOffset)
             startNode = v;
         }
         //printf("node %s is in cluster %s\n",GA.labelNode(v).cstr(),GA.clusterNode(v).cstr());
+        string clusterName(GA.clusterNode(v).cstr());
+        if(clusterName.size()>0) {
+            clusterColourIndex[clusterName]=0;
+        }
+    }
+    int clusterIndex=0;
+    for(map<string,int>::iterator i=clusterColourIndex.begin();
+            i!=clusterColourIndex.end();++i,++clusterIndex) {
+        i->second=clusterIndex%clusterColoursN;
     }
     printf("Start node=%s\n",GA.labelNode(startNode).cstr());
     layout();
@@ -190,20 +255,24 @@ Graph::Graph(Canvas *canvas, string gmlFile, Page page, COff canvasOffset)
     // we need rubber band routing to preserve topology in makeFeasible
     canvas->setOptRubberBandRouting(true);
 
-    // setup shortest paths
+    // setup shortest paths, which are found from each focus node as it
+    // is needed, see focusDistances()
     unsigned n = G.numberOfNodes();
-    shortestPathsMatrix = new int*[n];
-    for(unsigned i=0;i<n;i++) {
-        shortestPathsMatrix[i]=new int[n];
+    nodesByIndex.resize(n);
+    forall_nodes(v,G) {
+        nodesByIndex[v->index()]=v;
     }
     vector<cola::Edge> es;
     ogdf::edge e;
     forall_edges(e,G) {
         es.push_back(make_pair(e->source()->index(),e->target()->index()));
     }
-    shortest_paths::johnsons(n,shortestPathsMatrix,es);
+    adjacency = new shortest_paths::CSRGraph(n,es);
     canvas->setIdealConnectorLength(70);
 }
+Graph::~Graph() {
+    delete adjacency;
+}
 Draw::Draw(ogdf::Graph& G, ogdf::GraphAttributes& GA, QPixmap *pixmap,
             const Box& bounds)
     : surface_(pixmap), 
@@ -475,69 +544,50 @@ Cluster *newClusterWrapper(NodeList& memberIdList,
 }
 
 
+QColor Graph::clusterColour(const string& clusterName) const {
+    map<string,int>::const_iterator i=clusterColourIndex.find(clusterName);
+    assert(i!=clusterColourIndex.end());
+    return clusterColours[i->second];
+}
 void Graph::createClusters() {
     if(UseClusters) {
-        int col=0;
         for(map<string,NodeList>::iterator i=canvasClustersMap.begin();
-                i!=canvasClustersMap.end();++i,++col)
+                i!=canvasClustersMap.end();++i)
         {
-            col = col % clusterColoursN;
             Cluster* c=newClusterWrapper(i->second, shapes);
             if (c)
             {
-                c->setFillColour(clusterColours[col]);
+                c->setFillColour(clusterColour(i->first));
                 canvasClusters.push_back(c);
             }
         }
     }
 }
+typedef pair<ogdf::node,int> NodeDistance;
 struct CompareNodes {
-    CompareNodes(int* d, ogdf::NodeArray<int>& timeStamps)
-        : d(d), timeStamps(timeStamps) {}
-    bool operator() (const ogdf::node& u, const ogdf::node& v) {
-        int du=d[u->index()], dv=d[v->index()];
-        if(du==dv) {
-            return timeStamps[u]>timeStamps[v];
+    CompareNodes(ogdf::NodeArray<int>& timeStamps)
+        : timeStamps(timeStamps) {}
+    bool operator() (const NodeDistance& u, const NodeDistance& v) {
+        if(u.second==v.second) {
+            return timeStamps[u.first]>timeStamps[v.first];
         }
-        return du<dv;
+        return u.second<v.second;
     }
-    int* d;
     ogdf::NodeArray<int>& timeStamps;
 };
-struct IsVisible {
-    IsVisible(const ShapeObj* sh, const ogdf::NodeArray<ShapeObj*>& shapes) 
-        : sh(sh), shapes(shapes) {}
-    bool operator()(const ogdf::node& v) {
-        ShapeObj* vsh = shapes[v];
-        if(sh==vsh) {
-            assert(!sh->isInactive()); // because we are searching canvas list
-            return true;
-        }
-        return false;
-    }
-    const ShapeObj* sh;
-    const ogdf::NodeArray<ShapeObj*>& shapes;
-};
 struct NotInNeighbourhood {
-    NotInNeighbourhood(vector<ogdf::node>& vs, ogdf::NodeArray<ShapeObj*>& shapes,
-            int limit, CanvasItemList& toRemove)
-        : vs(vs), shapes(shapes), limit(limit), toRemove(toRemove) {}
+    NotInNeighbourhood(const set<ogdf::node>& neighbourhood,
+            map<ShapeObj*,ogdf::node>& nodes, CanvasItemList& toRemove)
+        : neighbourhood(neighbourhood), nodes(nodes), toRemove(toRemove) {}
     bool operator() (ShapeObj* sh) {
-        bool remove = true;
-        vector<ogdf::node>::iterator first = vs.begin(),
-                                     last = first + limit,
-                                     result = last;
-        result = find_if(first,last,IsVisible(sh,shapes));
-        if(result!=last) {
-            remove = false;
-        } else {
+        bool remove = neighbourhood.find(nodes[sh])==neighbourhood.end();
+        if(remove) {
             toRemove.push_back(sh);
         }
         return remove;
     }
-    vector<ogdf::node>& vs;
-    ogdf::NodeArray<ShapeObj*>& shapes;
-    int limit;
+    const set<ogdf::node>& neighbourhood;
+    map<ShapeObj*,ogdf::node>& nodes;
     CanvasItemList& toRemove;
 };
 struct AddToCanvas {
@@ -558,17 +608,57 @@ struct AddClusterDetails {
  * expand neighbourhood around node closest to position x,y
  */
 void Graph::expandNeighbours(double x, double y) {
-    double minDist = DBL_MAX;
-    ogdf::node v, closest=NULL;
     printf("expanding neighbours around %f,%f\n",x,y);
-    forall_nodes(v,G) {
-        double d=dist(v,x,y);
-        if(d<minDist) {
-            closest = v;
-            minDist = d;
+    expandNeighbours(closestNode(x,y));
+}
+/**
+ * The node closest to position x,y, or the first such node in G if there
+ * are several.  Cells of nodeGrid are searched in rings around x,y until
+ * the closest node found is nearer than any cell not yet searched.
+ */
+ogdf::node Graph::closestNode(double x, double y) {
+    if(!nodeGrid.valid) {
+        nodeGrid.build(G,GA);
+    }
+    const NodeGrid& g=nodeGrid;
+    double minDist = DBL_MAX;
+    ogdf::node closest=NULL;
+    const int cx=g.col(x), cy=g.row(y);
+    for(int r=0;g.cols>0;r++) {
+        const int c0=cx-r, c1=cx+r, r0=cy-r, r1=cy+r;
+        for(int row=qMax(r0,0);row<=qMin(r1,g.rows-1);row++) {
+            // whole rows at the top and bottom of the ring, otherwise
+            // just its left and right cells
+            const bool edge=(row==r0||row==r1);
+            for(int col=qMax(c0,0);col<=qMin(c1,g.cols-1);col++) {
+                if(!edge && col>c0 && col<c1) {
+                    // skip the inside of the ring, already searched
+                    col=c1-1;
+                    continue;
+                }
+                const int c=row*g.cols+col;
+                for(unsigned i=g.starts[c];i<g.starts[c+1];i++) {
+                    ogdf::node v=g.nodes[i];
+                    double d=dist(v,x,y);
+                    if(closest==NULL || d<minDist || (d==minDist &&
+                                v->index()<closest->index())) {
+                        closest = v;
+                        minDist = d;
+                    }
+                }
+            }
+        }
+        // distance to the nearest cell outside the ring
+        double gap=DBL_MAX;
+        if(c0>0) gap=qMin(gap,x-(g.x+c0*g.cellSize));
+        if(c1<g.cols-1) gap=qMin(gap,g.x+(c1+1)*g.cellSize-x);
+        if(r0>0) gap=qMin(gap,y-(g.y+r0*g.cellSize));
+        if(r1<g.rows-1) gap=qMin(gap,g.y+(r1+1)*g.cellSize-y);
+        if(gap==DBL_MAX || (closest!=NULL && minDist<gap)) {
+            break;
         }
     }
-    expandNeighbours(closest);
+    return closest;
 }
 void Graph::expandNeighbours(ogdf::node centre) {
     qDebug("expandNeighbours setting interrupt...");
@@ -576,17 +666,38 @@ void Graph::expandNeighbours(ogdf::node centre) {
     gl->setInterruptFromDunnart();
     gl->unpinAllShapes(NULL);
     // vs is a list of nodes sorted such that nodes with shortest path lengths
-    // from centre and most recent time stamps are at the front
-    vector<ogdf::node> vs;
-    ogdf::node v;
-    forall_nodes(v,G) {
-        vs.push_back(v);
+    // from centre and most recent time stamps are at the front.  Only the
+    // nodes nearest to centre have known path lengths, but these include
+    // every node that can be in the first canvasShapesLimit.  Other nodes
+    // are only needed if there are too few near nodes to fill the canvas.
+    const NodeDistances& nearNodes=focusDistances(centre);
+    vector<NodeDistance> vs;
+    for(NodeDistances::const_iterator i=nearNodes.begin();
+            i!=nearNodes.end();++i) {
+        vs.push_back(make_pair(nodesByIndex[i->first],i->second));
     }
-    int *d=shortestPathsMatrix[centre->index()];
-    sort(vs.begin(),vs.end(),CompareNodes(d,timeStamps));
+    if(vs.size()<canvasShapesLimit) {
+        ogdf::NodeArray<bool> isNear(G,false);
+        for(unsigned i=0;i<vs.size();i++) {
+            isNear[vs[i].first]=true;
+        }
+        ogdf::node v;
+        forall_nodes(v,G) {
+            if(!isNear[v]) {
+                vs.push_back(make_pair(v,numeric_limits<int>::max()));
+            }
+        }
+    }
+    sort(vs.begin(),vs.end(),CompareNodes(timeStamps));
     // the first canvasShapesLimit nodes in vs are the neighbourhood
     // we wish to show in the detailed canvas.  We remove the remaining
     // shapes from the canvas.
+    vector<ogdf::node> neighbourhood;
+    for(unsigned i=0;i<vs.size() && i<canvasShapesLimit;i++) {
+        neighbourhood.push_back(vs[i].first);
+    }
+    const set<ogdf::node> inNeighbourhood(
+            neighbourhood.begin(),neighbourhood.end());
     CanvasItemList toRemove;
     if(UseClusters){
         for(CanvasItemList::iterator i=canvasClusters.begin();
@@ -597,7 +708,7 @@ void Graph::expandNeighbours(ogdf::node centre) {
         }
     }
     canvasShapes.remove_if(NotInNeighbourhood(
-                vs,shapes,canvasShapesLimit,toRemove));
+                inNeighbourhood,nodes,toRemove));
     //QT removeFromCanvas(toRemove);
     // the shapes still on the canvas at this point are the intersection
     // between the previous neighbourhood and the new neighbourhood.
@@ -607,20 +718,57 @@ void Graph::expandNeighbours(ogdf::node centre) {
     // now we add the remaining primary nodes to the canvas with an
     // updated timestamp.
     time++;
+    vector<ogdf::node> toAdd;
+    for(unsigned i=0;i<neighbourhood.size();i++) {
+        ShapeObj* sh=shapes[neighbourhood[i]];
+        if(sh==NULL || sh->isInactive()) {
+            toAdd.push_back(neighbourhood[i]);
+        }
+    }
+    for_each(toAdd.begin(),toAdd.end(),AddToCanvas(*this));
     if(UseClusters) {
+        // only nodes with shapes can be cluster members on the canvas
         canvasClustersMap.clear();
+        for_each(shownNodes.begin(),shownNodes.end(),
+                AddClusterDetails(*this));
     }
-    vector<ogdf::node>::iterator endIt = (vs.size() <= canvasShapesLimit) ?
-            vs.end() : (vs.begin() + canvasShapesLimit);
-    for_each(vs.begin(),endIt,AddToCanvas(*this));
-    for_each(vs.begin(),vs.end(),AddClusterDetails(*this));
-    ogdf::edge e;
-    forall_edges(e,G) {
-        // create connector if both ends are on the canvas
-        createConnector(e);
+    // create connectors for the edges of the added shapes that now have
+    // both ends on the canvas
+    for(unsigned i=0;i<toAdd.size();i++) {
+        ogdf::edge e;
+        forall_adj_edges(e,toAdd[i]) {
+            Connector* conn=connectors[e];
+            if(conn==NULL || conn->isInactive()) {
+                createConnector(e);
+            }
+        }
     }
     restartLayout(centre);
 }
+/**
+ * The path lengths from centre to its nearest nodes, at least 
+ * canvasShapesLimit of them if the graph is large enough.  These are found
+ * by breadth first search when first needed and kept for the most
+ * recently used focus nodes.
+ */
+const Graph::NodeDistances& Graph::focusDistances(ogdf::node centre) {
+    const int index=centre->index();
+    for(list<pair<int,NodeDistances> >::iterator i=
+            focusDistancesCache.begin();i!=focusDistancesCache.end();++i) {
+        if(i->first==index) {
+            focusDistancesCache.splice(focusDistancesCache.begin(),
+                    focusDistancesCache,i);
+            return i->second;
+        }
+    }
+    if(focusDistancesCache.size()>=focusDistancesCacheLimit) {
+        focusDistancesCache.pop_back();
+    }
+    focusDistancesCache.push_front(make_pair(index,NodeDistances()));
+    shortest_paths::nearest(index,*adjacency,1,canvasShapesLimit,
+            focusDistancesCache.front().second);
+    return focusDistancesCache.front().second;
+}
 void Graph::expandNeighbours(ShapeObj* shape) {
     Cluster *cluster = dynamic_cast<Cluster *> (shape);
     if (cluster)
@@ -636,7 +784,6 @@ void Graph::drawOverviewOverlay() {
     // ow->updateCanvasPosOverlay();
 }
 
-// XXX: This is pretty inefficient at the moment.
 QColor Graph::getNodeColor(const ogdf::node v)
 {
     QColor col = QColor(0,0,0,85);
@@ -644,26 +791,10 @@ QColor Graph::getNodeColor(const ogdf::node v)
     {
         return col;
     }
-    bool found = false;
-    int colN = 0;
-    for(map<string,NodeList>::iterator i=canvasClustersMap.begin();
-            i!=canvasClustersMap.end();++i,++colN)
+    string clusterName(GA.clusterNode(v).cstr());
+    if (clusterName.size() > 0)
     {
-        for (NodeList::iterator n = i->second.begin();
-                n != i->second.end(); ++n)
-        {
-            if (*n == v)
-            {
-                colN = colN % clusterColoursN;
-                col = clusterColours[colN];
-                found = true;
-                break;
-            }
-        }
-        if (found)
-        {
-            break;
-        }
+        col = clusterColour(clusterName);
     }
     return col;
 }
@@ -680,9 +811,8 @@ void Graph::drawOverview() {
     
     if(UseClusters)
     {
-        int col = 0;
         for(map<string,NodeList>::iterator i=canvasClustersMap.begin();
-                i!=canvasClustersMap.end();++i,++col)
+                i!=canvasClustersMap.end();++i)
         {
             std::vector<unsigned> hullIndexes;
             int totalPoints = i->second.size() * 4;
@@ -731,8 +861,7 @@ void Graph::drawOverview() {
                 index++;
             }
 
-            col = col % clusterColoursN;
-            draw.colour = clusterColours[col];
+            draw.colour = clusterColour(i->first);
             //printf("%s: %d\n", i->first.c_str(), (int) i->second.size());
             draw.polygon(vx, vy, hullIndexes.size());
             draw.colour = Qt::black;
@@ -859,6 +988,7 @@ void Graph::createShape(ogdf::node v, const Box b) {
         sh->setPosAndSize(QPointF(b.x, b.y), QSizeF(width, height));
         shapes[v] = sh;
         nodes[sh] = v;
+        shownNodes.push_back(v);
         canvasShapes.push_back(sh);
         timeStamps[v]=time;
     } else if(sh->isInactive()) {
@@ -1023,6 +1153,7 @@ void Graph::relayoutOverview() {
     }
     fmm.call(GA);
     printf("Relayout took: %f seconds\n",fmm.getCpuTime());
+    nodeGrid.valid=false;
     drawOverview();
     // Update the ghost connector directions.
 }
@@ -33,11 +33,16 @@
 #include <QObject>
 
 #include <map>
+#include <vector>
 #include <ogdf/basic/Graph.h>
 #include <ogdf/basic/GraphAttributes.h>
 
 #include "libdunnartcanvas/canvasitem.h"
 
+namespace shortest_paths {
+struct CSRGraph;
+}
+
 namespace dunnart {
 
 
@@ -62,6 +67,24 @@ struct Box {
     bool overlaps(const Box) const;
 };
 
+/*
+ * A uniform grid over the overview positions of the nodes, with about one
+ * node per cell, for finding the node closest to a point.
+ */
+struct NodeGrid {
+    NodeGrid();
+    void build(const ogdf::Graph& G, const ogdf::GraphAttributes& GA);
+    int col(double px) const;
+    int row(double py) const;
+    bool valid;
+    double x, y, cellSize;
+    int cols, rows;
+    // the nodes in cell (c,r) are nodes[starts[r*cols+c]] to
+    // nodes[starts[r*cols+c+1]-1], in the order of G
+    std::vector<unsigned> starts;
+    std::vector<ogdf::node> nodes;
+};
+
 struct Page {
     Canvas *canvas;
     Page(Canvas *canvas);
@@ -99,6 +122,7 @@ class Graph : public QObject
     Q_OBJECT
 public:
     Graph(Canvas *canvas, std::string gmlFile, Page page, COff coff);
+    ~Graph();
     void relayoutOverview();
     unsigned getCanvasShapesCount() const;
     void expandNeighbours(ShapeObj* shape);
@@ -113,7 +137,9 @@ public:
     Canvas *canvas(void) const;
 protected:
     QColor getNodeColor(const ogdf::node v);
+    QColor clusterColour(const std::string& clusterName) const;
     void expandNeighbours(ogdf::node centre);
+    ogdf::node closestNode(double x, double y);
     void layout();
     void layoutVisible(Box& view);
     void drawOverview();
@@ -133,12 +159,25 @@ protected:
     Box gbounds;
     double scale;
     std::map<ShapeObj*,ogdf::node> nodes;
+    // nodes that have had shapes created, in order of creation
+    std::vector<ogdf::node> shownNodes;
+    NodeGrid nodeGrid;
     std::map<std::string,NodeList > canvasClustersMap;
+    // the colour of each cluster, by name, fixed when the graph is loaded
+    // so that it doesn't depend on which nodes are on the canvas
+    std::map<std::string,int> clusterColourIndex;
     CanvasItemList canvasClusters;
     std::list<ShapeObj*> canvasShapes;
     const unsigned canvasShapesLimit;
     int time;
-    int **shortestPathsMatrix;
+    // Path lengths from recently used focus nodes to their nearest nodes,
+    // by node index, most recently used first.
+    typedef std::vector<std::pair<unsigned,int> > NodeDistances;
+    const NodeDistances& focusDistances(ogdf::node centre);
+    std::list<std::pair<int,NodeDistances> > focusDistancesCache;
+    const unsigned focusDistancesCacheLimit;
+    shortest_paths::CSRGraph *adjacency;
+    std::vector<ogdf::node> nodesByIndex;
     bool UML;
     bool UseClusters;
 private:
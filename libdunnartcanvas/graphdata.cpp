@@ -115,11 +115,16 @@ GraphData::GraphData(Canvas *canvas, bool ignoreEdges,
         GraphLayout::Mode mode, bool beautify, unsigned topologyNodesCount) 
     : canvas_(canvas),
       topologyNodesCount(topologyNodesCount),
+      m_ignore_edges(ignoreEdges),
+      m_mode(mode),
+      m_structure_revision(canvas->graphStructureRevision()),
+      m_has_templates(false),
       k_undefined(-1)
 {
     Q_UNUSED (beautify)
 
     pageBoundary = QRectF();
+    m_layout_options = layoutOptions();
     // Note that in Dunnart the coordinates of shapes are their top-left corners
     // while in constrained_majorization_layout we use the centres.
 
@@ -828,14 +833,7 @@ GraphData::GraphData(Canvas *canvas, bool ignoreEdges,
         }
     }
 
-    // get the corners of the page
-    pageBoundary = canvas->pageRect();
-    
-    // adjust boundary for page_margin
-    double page_buffer = canvas->visualPageBuffer();
-    QPointF margin(page_buffer, page_buffer);
-    pageBoundary.setTopLeft(pageBoundary.topLeft() + margin);
-    pageBoundary.setBottomRight(pageBoundary.bottomRight() - margin);
+    updatePageBoundary();
 
     generateRectangleConstraints(canvasObjects);
 
@@ -881,10 +879,12 @@ GraphData::GraphData(Canvas *canvas, bool ignoreEdges,
         if (linear)
         {
             linearTemplateToConstraints(linear);
+            m_has_templates = true;
         }
         else if (branched)
         {
             branchedTemplateToConstraints(branched);
+            m_has_templates = true;
         }
     }
 
@@ -1235,7 +1235,194 @@ void GraphData::generateRoutes() {
  */
 GraphData::~GraphData() {
     for_each(ccs.begin(),ccs.end(),delete_object());
+    freeTopology();
+}
+
+void GraphData::freeTopology() {
     for_each(topologyRoutes.begin(),topologyRoutes.end(),delete_object());
+    topologyRoutes.clear();
+    for_each(topologyNodes.begin(),topologyNodes.end(),delete_object());
+    topologyNodes.clear();
+}
+
+
+bool GraphData::updateFromCanvas(bool ignoreEdges, GraphLayout::Mode mode,
+        unsigned topologyNodesCount)
+{
+    // Structural changes are counted by the canvas, but option changes
+    // aren't, so compare the options the constraints were built with.
+    // Templates and page boundary constraints depend on positions in ways
+    // that aren't patched below, so always rebuild for those.
+    int revision = canvas_->graphStructureRevision();
+    if ((revision != m_structure_revision) ||
+            (ignoreEdges != m_ignore_edges) || (mode != m_mode) ||
+            (topologyNodesCount != this->topologyNodesCount) ||
+            (layoutOptions() != m_layout_options) || m_has_templates ||
+            canvas_->optFitWithinPage())
+    {
+        return false;
+    }
+
+    // Check that the same shapes, with the same sizes, are present.  This
+    // is cheap compared to rebuilding and catches resizes, which are not
+    // counted as structural changes.
+    QList<CanvasItem *> canvasObjects = canvas_->items();
+    double buffer = canvas_->optShapeNonoverlapPadding();
+    std::vector<QRectF> rects(rs.size());
+    size_t shapeCount = 0;
+    size_t connCount = 0;
+    double xMin = DBL_MAX, xMax = -DBL_MAX;
+    double yMin = DBL_MAX, yMax = -DBL_MAX;
+    for (int i = 0; i < canvasObjects.size(); ++i)
+    {
+        if (ShapeObj *shape = isShapeForLayout(canvasObjects.at(i)))
+        {
+            std::map<ShapeObj*, unsigned>::const_iterator found =
+                    snMap.find(shape);
+            if (found == snMap.end())
+            {
+                return false;
+            }
+            unsigned nodeID = found->second;
+            QRectF rect = shape->shapeRect(buffer);
+            if ((rect.width() != rs[nodeID]->width()) ||
+                    (rect.height() != rs[nodeID]->height()))
+            {
+                return false;
+            }
+            rects[nodeID] = rect;
+            ++shapeCount;
+
+            xMax = qMax(xMax, rect.center().x());
+            xMin = qMin(xMin, rect.center().x());
+            yMax = qMax(yMax, rect.center().y());
+            yMin = qMin(yMin, rect.center().y());
+        }
+        else if (dynamic_cast<Connector *> (canvasObjects.at(i)))
+        {
+            ++connCount;
+        }
+    }
+    if (shapeCount != shape_vec.size())
+    {
+        return false;
+    }
+
+    if (!ignoreEdges)
+    {
+        // Clumped nodes are jiggled apart by the constructor.
+        if ((xMax == xMin) || (yMax == yMin))
+        {
+            return false;
+        }
+
+        // Check connector endpoints and ideal lengths.  Dangling
+        // connectors are in conn_vec but have no edge.
+        if (connCount != conn_vec.size())
+        {
+            return false;
+        }
+        size_t edgeIndex = 0;
+        for (size_t i = 0; i < conn_vec.size(); ++i)
+        {
+            Connector *conn = conn_vec[i];
+            if (conn->canvas() != canvas_)
+            {
+                return false;
+            }
+            QPair<CPoint, CPoint> connpts = conn->get_connpts();
+            if (!connpts.first.shape || !connpts.second.shape)
+            {
+                continue;
+            }
+            std::map<ShapeObj*, unsigned>::const_iterator first =
+                    snMap.find(connpts.first.shape);
+            std::map<ShapeObj*, unsigned>::const_iterator second =
+                    snMap.find(connpts.second.shape);
+            if ((edgeIndex >= edges.size()) || (first == snMap.end()) ||
+                    (second == snMap.end()) ||
+                    (edges[edgeIndex] != std::make_pair(first->second,
+                            second->second)) ||
+                    (edgeLengths[edgeIndex] != conn->idealLength()))
+            {
+                return false;
+            }
+            ++edgeIndex;
+        }
+        if (edgeIndex != edges.size())
+        {
+            return false;
+        }
+    }
+
+    // Nothing but positions has changed, so patch them in.
+    for (size_t i = 0; i < rs.size(); ++i)
+    {
+        rs[i]->reset(0, rects[i].left(), rects[i].right());
+        rs[i]->reset(1, rects[i].top(), rects[i].bottom());
+    }
+    for (std::map<Indicator*, cola::CompoundConstraint*>::iterator i =
+            ccMap.begin(); i != ccMap.end(); ++i)
+    {
+        if (Guideline *guide = dynamic_cast<Guideline *> (i->first))
+        {
+            // Leave it unfixed at the guideline's position, as when built.
+            cola::AlignmentConstraint *ac =
+                    (cola::AlignmentConstraint *) i->second;
+            ac->fixPos(guide->position());
+            ac->unfixPos();
+        }
+        else if (Distribution *distro = dynamic_cast<Distribution *> (i->first))
+        {
+            cola::DistributionConstraint *dc =
+                    (cola::DistributionConstraint *) i->second;
+            dc->setSeparation(distro->getSeparation());
+        }
+        else if (Separation *sep = dynamic_cast<Separation *> (i->first))
+        {
+            cola::MultiSeparationConstraint *msc =
+                    (cola::MultiSeparationConstraint *) i->second;
+            msc->setSeparation(sep->gap);
+        }
+    }
+    updatePageBoundary();
+
+    // The topology is rebuilt by makeFeasible() in the next run that needs
+    // it, so free the old one rather than leaking it there.
+    freeTopology();
+
+    return true;
+}
+
+
+void GraphData::updatePageBoundary()
+{
+    // get the corners of the page
+    pageBoundary = canvas_->pageRect();
+    
+    // adjust boundary for page_margin
+    double page_buffer = canvas_->visualPageBuffer();
+    QPointF margin(page_buffer, page_buffer);
+    pageBoundary.setTopLeft(pageBoundary.topLeft() + margin);
+    pageBoundary.setBottomRight(pageBoundary.bottomRight() - margin);
+}
+
+
+/**
+ * Returns the canvas options read when building constraints.
+ */
+std::vector<double> GraphData::layoutOptions() const
+{
+    std::vector<double> options;
+    options.push_back(canvas_->optShapeNonoverlapPadding());
+    options.push_back(canvas_->optIdealEdgeLengthModifier());
+    options.push_back(canvas_->m_ideal_connector_length);
+    options.push_back(canvas_->m_flow_separation_modifier);
+    options.push_back(canvas_->optFlowDirection());
+    options.push_back(canvas_->optLayeredAlignmentPosition());
+    options.push_back(canvas_->m_rectangle_constraint_test);
+    options.push_back(canvas_->optFitWithinPage());
+    return options;
 }
 
 /**
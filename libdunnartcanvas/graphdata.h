@@ -60,7 +60,18 @@ public:
     GraphData(Canvas *canvas, bool ignoreEdges, GraphLayout::Mode mode, 
             bool beautify, unsigned topologyNodesCount);
     void generateRoutes();
+    /** frees topologyNodes and topologyRoutes, which refer to each other,
+     * before they are replaced.
+     */
+    void freeTopology();
     ~GraphData(); 
+    /** brings the positions of nodes and constraints up to date with the
+     * canvas so this GraphData can be reused for another layout run.
+     * Returns false, leaving it unchanged, if anything else it was built
+     * from has changed, in which case it needs to be rebuilt.
+     */
+    bool updateFromCanvas(bool ignoreEdges, GraphLayout::Mode mode,
+            unsigned topologyNodesCount);
     /** once edges are loaded the following detects multi-edges and sets up the
      * connector so that they are rendered with offsets.
      */
@@ -149,6 +160,8 @@ private:
         return id;
     }
     void setUpRootCluster();
+    void updatePageBoundary();
+    std::vector<double> layoutOptions() const;
     unsigned getConnectionPoint(const CPoint& connPointInfo);
     void strongConnect(uint v);
     QVector<int> stronglyConnectedComponentIndexes(void);
@@ -166,6 +179,12 @@ private:
     std::vector<Connector*> conn_vec1;
     std::vector<cola::Edge> edges1;
     unsigned orthogonalEdgeCountX, orthogonalEdgeCountY;
+    // What this GraphData was built from, checked by updateFromCanvas().
+    bool m_ignore_edges;
+    GraphLayout::Mode m_mode;
+    int m_structure_revision;
+    std::vector<double> m_layout_options;
+    bool m_has_templates;
 #ifndef NOGRAPHVIZ
     std::auto_ptr<GraphvizLayout> graphvizLayout;
 #endif
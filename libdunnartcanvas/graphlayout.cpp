@@ -31,6 +31,7 @@
 #include "libdunnartcanvas/graphdata.h"
 
 #include "libcola/cola.h"
+#include "libcola/connected_components.h"
 #include "libdunnartcanvas/oldcanvas.h"
 #include "libdunnartcanvas/shape.h"
 #include "libdunnartcanvas/connector.h"
@@ -57,6 +58,10 @@ namespace dunnart {
 
 static const int ANIMATION_DURATION = 100;
 
+// Flag set in GraphLayout::m_middle_frame while the GUI has not yet taken
+// the frame the layout thread last published.
+static const int FreshFrame = 4;
+
 // The order that we process returned PosInfos in.  Order matters because the
 // guideline length with depend on the positions of the aligned shapes, etc.
 enum PosInfoProcessOrder 
@@ -97,13 +102,24 @@ GraphLayout::GraphLayout(Canvas *canvas)
       m_canvas(canvas),
       m_graph(NULL),
       m_is_running(false),
-      retPositionsHandled(true),
+      m_middle_frame(1),
+      m_back_frame(0),
+      m_front_frame(2),
+      m_layout_epoch(0),
+      m_published_frames(0),
+      m_timed_iterations(0),
+      m_measured_iterations_per_second(0),
+      m_last_frame_iteration(0),
+      m_iterations_per_second(0),
+      m_last_frame_nsecs(0),
+      m_dropped_frames(0),
       outputDebugFiles(false),
       positionChangesFromDunnart(false),
       interruptFromDunnart(true),
       freeShiftFromDunnart(false),
       restartFromDunnart(false),
       askedToFinish(false),
+      m_threaded(true),
       m_layout_thread(NULL)
 {
     m_layout_thread = new LayoutThread(this);
@@ -130,6 +146,27 @@ GraphData *GraphLayout::getGraphData(void)
 }
 
 
+LayoutFrame::LayoutFrame()
+    : epoch(0),
+      iteration(0),
+      iterationsPerSecond(0)
+{
+}
+
+LayoutFrame::~LayoutFrame()
+{
+    clear();
+}
+
+void LayoutFrame::clear(void)
+{
+    shapes.clear();
+    centres.clear();
+    for_each(positions.begin(), positions.end(), delete_object());
+    positions.clear();
+}
+
+
 // The following structure hierarchy is used for interthread communication
 
 PosInfo::PosInfo()
@@ -238,17 +275,6 @@ struct ShapePosInfo : PosInfo {
     QRectF shapeRect;
     bool locked;
     bool resized;
-    ShapePosInfo(ShapeObj *p, double x, double y):
-        shapePtr(p),
-        locked(false),
-        resized(false) 
-    {
-        double buffer = shapePtr->canvas()->optShapeNonoverlapPadding();
-        shapeRect = shapePtr->shapeRect(buffer);
-        shapeRect.moveCenter(QPointF(x, y));
-        processOrder = PosInfoProcessOrderShape;
-    }
-
     /**
      * This shape is locked at xPos, yPos and graphlayout can't change it.
      */
@@ -587,11 +613,11 @@ void GraphLayout::setInterruptFromDunnart(void)
     positionChangesFromDunnart = false;
     m_layout_signal_mutex.unlock();
 
-    // Clear any return PosInfos since they may now refer to
-    // invalid CanvasItems.
+    // Frames already built may refer to CanvasItems that are about to be
+    // deleted.  Once the layout thread has seen the interrupt it builds no
+    // more, and processReturnPositions() discards those from older epochs.
     m_return_positions_mutex.lock();
-    clearReturnPosInfos();
-    retPositionsHandled = true;
+    ++m_layout_epoch;
     m_canvas->m_animation_group->clear();
     m_return_positions_mutex.unlock();
 }
@@ -714,7 +740,8 @@ public:
           gl(gl) { }
     /**
      * Called by cola::ConstrainedMajorizationLayout after each layout iteration.
-     * Returns new layout by populating the list gl.retPositions list with PosInfo objects.
+     * Returns new layout by filling the layout thread's back frame and
+     * publishing it to the GUI.
      * @param new_stress stress level after last iteration
      * @param X node coordinates after last move
      * @param Y node coordinates after last move
@@ -723,31 +750,26 @@ public:
     bool operator()(const double new_stress,
                 valarray<double> & X, valarray<double> & Y)
     {
-        bool ready = false;
-        
-        while (!ready)
-        {
-            gl.m_return_positions_mutex.lock();
-            ready = gl.retPositionsHandled;
-            gl.m_return_positions_mutex.unlock();
-
-            gl.m_layout_signal_mutex.lock();
-            bool finish = gl.askedToFinish;
-            gl.m_layout_signal_mutex.unlock();
-            if (finish)
-            {
-                return true;
-            }
-        }
+        gl.countIteration();
 
+        // Checking for an interrupt while holding the return positions
+        // mutex means the GUI can't delete anything we are about to read.
+        gl.m_return_positions_mutex.lock();
         gl.m_layout_signal_mutex.lock();
+        bool finish = gl.askedToFinish;
         bool interrupt = gl.interruptFromDunnart | gl.freeShiftFromDunnart;
         gl.m_layout_signal_mutex.unlock();
+        if (finish)
+        {
+            gl.m_return_positions_mutex.unlock();
+            return true;
+        }
         if(interrupt||gl.restartFromDunnart) {
             reset();
         }
         if (interrupt)
         {
+            gl.m_return_positions_mutex.unlock();
             qDebug("User interrupt detected in PostIteration!");
             gl.m_layout_signal_mutex.lock();
             gl.interruptFromDunnart = true;
@@ -759,15 +781,18 @@ public:
             return true;
         }
 
-        gl.m_return_positions_mutex.lock();
-        gl.clearReturnPosInfos();
+        // Reuse the back frame, deleting anything left from a frame the
+        // GUI never took.
+        LayoutFrame& frame = gl.m_frames[gl.m_back_frame];
+        frame.clear();
+        frame.epoch = gl.m_layout_epoch;
         for (unsigned i = 0; i < n; i++) {
             ShapeObj* shape = gl.m_graph->getShape(i);
             if (shape && (gl.fixedShapeLookup.find(shape) == 
                           gl.fixedShapeLookup.end())) 
             {
-                gl.retPositions.push_back(
-                        new ShapePosInfo(shape, X[i], Y[i]));
+                frame.shapes.push_back(shape);
+                frame.centres.push_back(QPointF(X[i], Y[i]));
             }
         }
 
@@ -788,19 +813,19 @@ public:
                 pbY = pc->getActualRightMargin(vpsc::VERTICAL);
             }
             if(PosInfo* pi = returnPosInfoFactory(c)) {
-                gl.retPositions.push_back(pi);
+                frame.positions.push_back(pi);
             }
         }
         bool unsatisfiedConstraintsExist=false;
         for(cola::UnsatisfiableConstraintInfos::iterator i=gl.unsatisfiableX.begin();
                 i!=gl.unsatisfiableX.end();i++) {
-            gl.showUnsatisfiable(*i);
+            gl.showUnsatisfiable(frame, *i);
             unsatisfiedConstraintsExist=true;
             delete *i;
         }
         for(cola::UnsatisfiableConstraintInfos::iterator i=gl.unsatisfiableY.begin();
                 i!=gl.unsatisfiableY.end();i++) {
-            gl.showUnsatisfiable(*i);
+            gl.showUnsatisfiable(frame, *i);
             unsatisfiedConstraintsExist=true;
             delete *i;
         }
@@ -813,7 +838,7 @@ public:
         gl.unsatisfiableY.clear();
 
         if(pageBoundChange) {
-            gl.retPositions.push_back(
+            frame.positions.push_back(
                     new PageBoundsPosInfo(pbx,pbX,pby,pbY));
         }
 
@@ -827,16 +852,16 @@ public:
                 assert(e->lastSegment->end->node->id
                         <gl.m_graph->topologyNodesCount);
                 if(!e->cycle()) {
-                    gl.retPositions.push_back( new
+                    frame.positions.push_back( new
                             ConnPosInfo(gl.m_graph,
                                 (Connector*)gl.m_graph->conn_vec[e->id], e));
                 } else {
                     Cluster* c=gl.m_graph->dunnartClusters[e->id];
-                    gl.retPositions.push_back( new ClusterPosInfo(gl, c, e) );
+                    frame.positions.push_back( new ClusterPosInfo(gl, c, e) );
                 }
                 //for(unsigned j=0;j<gl.graph->topologyRoutes[i]->debugLines.size();j++) {
                     //straightener::DebugLine &l=gl.graph->topologyRoutes[i]->debugLines[j];
-                    //gl.retPositions.push_back(
+                    //frame.positions.push_back(
                             //new TraceLinePosInfo(l.x0,l.y0,l.x1,l.y1,l.colour));
                 //}
                 //gl.graph->topologyRoutes[i]->debugLines.clear();
@@ -846,7 +871,7 @@ public:
                 Cluster* c = gl.m_graph->dunnartClusters[i];
                 if (c && c->rectangular)
                 {
-                    gl.retPositions.push_back( new ClusterPosInfo(c) );
+                    frame.positions.push_back( new ClusterPosInfo(c) );
                 }
             }
             if (gl.m_canvas->optPreserveTopology())
@@ -856,7 +881,7 @@ public:
                     unsigned u=e.first, v=e.second;
                     if(u>=gl.m_graph->topologyNodesCount
                        ||v>=gl.m_graph->topologyNodesCount) {
-                        gl.retPositions.push_back( new
+                        frame.positions.push_back( new
                             ConnPosInfo(gl.m_graph,
                                 (Connector*)gl.m_graph->conn_vec[i], e,
                                 X[u],Y[u],X[v],Y[v]));
@@ -864,9 +889,15 @@ public:
                 }
             }
         } 
+        // Only notify the GUI if it has taken the previous frame, since
+        // otherwise an event is already pending and will pick this one up.
+        bool notify = gl.publishFrame();
         gl.m_return_positions_mutex.unlock();
-        QCoreApplication::postEvent(gl.m_canvas, new LayoutUpdateEvent(),
-                Qt::LowEventPriority);
+        if (notify && gl.m_threaded)
+        {
+            QCoreApplication::postEvent(gl.m_canvas, new LayoutUpdateEvent(),
+                    Qt::LowEventPriority);
+        }
 
         if(unsatisfiedConstraintsExist) return true;
         //printf("Stress=%f\n",new_stress);
@@ -925,6 +956,15 @@ int GraphLayout::initThread()
             m_layout_signal_mutex.unlock();
             break;
         }
+        if (!m_threaded)
+        {
+            // Layout is run by runToCompletion() instead, so go back to
+            // waiting, without reporting a finished layout.
+            m_layout_signal_mutex.unlock();
+            firstRun = true;
+            changes = false;
+            continue;
+        }
         positionChangesFromDunnart = false;
         bool currInterrupt = interruptFromDunnart;
         if (!freeShiftFromDunnart)
@@ -990,16 +1030,31 @@ struct CmpPosInfoPtrs
  */
 int GraphLayout::processReturnPositions()
 {
-    PosInfos returnPositions;
+    if (!takeFrame())
+    {
+        return 0;
+    }
+    QElapsedTimer frameTimer;
+    frameTimer.start();
 
-    m_return_positions_mutex.lock();
-    returnPositions = retPositions;
-    retPositions.clear();
-    retPositionsHandled = true;
-    m_return_positions_mutex.unlock();
+    LayoutFrame& frame = m_frames[m_front_frame];
+    if (frame.iteration > m_last_frame_iteration + 1)
+    {
+        m_dropped_frames += frame.iteration - m_last_frame_iteration - 1;
+    }
+    m_last_frame_iteration = frame.iteration;
+    m_iterations_per_second = frame.iterationsPerSecond;
+
+    if (frame.epoch != m_layout_epoch)
+    {
+        // Built before an interrupt, so may refer to deleted objects.
+        frame.clear();
+        return 0;
+    }
 
-    int movesCount = returnPositions.size();
-    //qDebug() << "processReturnPositions: retPositions.size() = " <<
+    PosInfos& returnPositions = frame.positions;
+    int movesCount = frame.shapes.size() + returnPositions.size();
+    //qDebug() << "processReturnPositions: returnPositions.size() = " <<
     //        returnPositions.size();
     returnPositions.sort(CmpPosInfoPtrs());
 
@@ -1010,6 +1065,14 @@ int GraphLayout::processReturnPositions()
     m_canvas->m_animation_group->clear();
 
     m_canvas->m_processing_layout_updates = true;
+    // Shapes are moved first, see PosInfoProcessOrder.
+    ConstraintDebug("**  SHAPES\n");
+    for (size_t i = 0; i < frame.shapes.size(); ++i)
+    {
+        frame.shapes[i]->CanvasItem::setPos(frame.centres[i]);
+    }
+    frame.shapes.clear();
+    frame.centres.clear();
     while (!returnPositions.empty())
     {
         PosInfo* info = returnPositions.front();
@@ -1046,9 +1109,73 @@ int GraphLayout::processReturnPositions()
     bool computePositions = true;
     m_canvas->repositionAndShowSelectionResizeHandles(computePositions);
 
+    m_last_frame_nsecs = frameTimer.nsecsElapsed();
     return movesCount;
 }
 
+double GraphLayout::iterationsPerSecond(void) const
+{
+    return m_iterations_per_second;
+}
+
+double GraphLayout::lastFrameTime(void) const
+{
+    return m_last_frame_nsecs / 1e6;
+}
+
+unsigned GraphLayout::droppedFrameCount(void) const
+{
+    return m_dropped_frames;
+}
+
+/**
+ * called by the layout thread once per iteration to measure the iteration
+ * rate over periods of about half a second
+ */
+void GraphLayout::countIteration(void)
+{
+    ++m_timed_iterations;
+    qint64 elapsed = m_iteration_timer.elapsed();
+    if (elapsed >= 500)
+    {
+        m_measured_iterations_per_second = m_timed_iterations * 1000.0 /
+                elapsed;
+        m_timed_iterations = 0;
+        m_iteration_timer.restart();
+    }
+}
+
+/**
+ * called by the layout thread to swap the filled back frame with the middle
+ * one.  Returns false if the GUI had not yet taken the previous frame.
+ */
+bool GraphLayout::publishFrame(void)
+{
+    LayoutFrame& frame = m_frames[m_back_frame];
+    frame.iteration = ++m_published_frames;
+    frame.iterationsPerSecond = m_measured_iterations_per_second;
+
+    int previous = m_middle_frame.fetchAndStoreAcqRel(
+            m_back_frame | FreshFrame);
+    m_back_frame = previous & ~FreshFrame;
+    return !(previous & FreshFrame);
+}
+
+/**
+ * called by the GUI thread to swap the front frame with the middle one, if
+ * the layout thread has published a frame since it was last taken
+ */
+bool GraphLayout::takeFrame(void)
+{
+    if (!(m_middle_frame.loadAcquire() & FreshFrame))
+    {
+        return false;
+    }
+    int previous = m_middle_frame.fetchAndStoreAcqRel(m_front_frame);
+    m_front_frame = previous & ~FreshFrame;
+    return true;
+}
+
 
 void GraphLayout::lockShape(ShapeObj* shape)
 {
@@ -1058,13 +1185,6 @@ void GraphLayout::lockShape(ShapeObj* shape)
     }
 }
 
-void GraphLayout::clearReturnPosInfos(void)
-{
-    retPositionsHandled = false;
-    for_each(retPositions.begin(), retPositions.end(), delete_object());
-    retPositions.clear();
-}
-
 void GraphLayout::addPinnedShapesToFixedList(void)
 {
     CanvasItemsList list;
@@ -1176,6 +1296,25 @@ void GraphLayout::addToResizedList(CanvasItemsList & objList) {
 void GraphLayout::apply(bool ignoreEdges)
 {
     this->ignoreEdges=ignoreEdges;
+    updateFixedPositions();
+
+    m_layout_signal_mutex.lock();
+    if (m_is_running || !m_threaded)
+    {
+        positionChangesFromDunnart = true;
+        m_layout_signal_mutex.unlock();
+    }
+    else
+    {
+        m_layout_signal_mutex.unlock();
+        // Wake the layout thread up:
+        m_layout_wait_condition.wakeAll();
+    }
+}
+
+
+void GraphLayout::updateFixedPositions(void)
+{
     m_changed_list_mutex.lock();
     // tell layout thread whatever has changed
     Actions& actions = m_canvas->getActions();
@@ -1194,18 +1333,37 @@ void GraphLayout::apply(bool ignoreEdges)
     addToFixedList(pinnedShapesList);
     addPinnedShapesToFixedList();
     m_changed_list_mutex.unlock();
+}
 
+
+void GraphLayout::setThreaded(bool threaded)
+{
     m_layout_signal_mutex.lock();
-    if (m_is_running)
-    {
-        positionChangesFromDunnart = true;
-        m_layout_signal_mutex.unlock();
-    }
-    else
+    assert(!m_is_running);
+    m_threaded = threaded;
+    m_layout_signal_mutex.unlock();
+}
+
+
+void GraphLayout::runToCompletion(bool ignoreEdges)
+{
+    assert(!m_threaded);
+    this->ignoreEdges = ignoreEdges;
+    updateFixedPositions();
+
+    // The layout thread does the same over successive runs: first with
+    // just the structural and placement constraints, then at runLevel 1
+    // with non-overlap and topology constraints.
+    for (unsigned level = 0; level <= 1; ++level)
     {
+        runLevel = level;
+        m_layout_signal_mutex.lock();
+        interruptFromDunnart = false;
+        positionChangesFromDunnart = false;
         m_layout_signal_mutex.unlock();
-        // Wake the layout thread up:
-        m_layout_wait_condition.wakeAll();
+
+        run(true);
+        processReturnPositions();
     }
 }
 
@@ -1236,6 +1394,13 @@ void GraphLayout::initialise(void)
     qDebug("GraphLayout::initialise: runlevel=%d",runLevel);
     if (m_graph!=NULL)
     {
+        // Most interrupts only move things, so try to reuse the graph
+        // data from the last run rather than building it again.
+        if (m_graph->updateFromCanvas(ignoreEdges, mode, topologyNodesCount))
+        {
+            qDebug("GraphLayout::initialise: reusing graph data");
+            return;
+        }
         delete m_graph;
     }
     bool beautify = (runLevel == 1) ? true : false;
@@ -1257,9 +1422,29 @@ void GraphLayout::run(const bool shouldReinitialise)
     PreIteration preIter(*this);
     PostIteration postIter(*this);
 
+    m_iteration_timer.start();
+    m_timed_iterations = 0;
+
     vector<double> elengths;
     m_graph->getEdgeLengths(elengths);
 
+    // Without constraints, clusters, fixed shapes or a topology to 
+    // preserve, the connected components don't affect each other.  When 
+    // nothing is waiting on intermediate frames, as in batch mode, the 
+    // final run lays out each component on its own, with path length 
+    // matrices only as large as the component, and then packs them.  
+    // Batch jobs already run in parallel processes, so one thread is used.
+    bool componentwise = !m_threaded && (runLevel == 1) && 
+            m_graph->ccs.empty() && 
+            m_graph->clusterHierarchy.clusters.empty() &&
+            fixedPositions.empty() && !m_canvas->m_opt_preserve_topology;
+    if (componentwise)
+    {
+        cola::layoutConnectedComponents(m_graph->rs, m_graph->edges,
+                m_canvas->optIdealEdgeLengthModifier(),
+                m_canvas->optPreventOverlaps(), elengths, 1);
+    }
+
     cola::ConstrainedFDLayout alg(m_graph->rs, m_graph->edges,
             m_canvas->optIdealEdgeLengthModifier(),
             m_canvas->optPreventOverlaps(), elengths, &postIter, &preIter);
@@ -1281,6 +1466,7 @@ void GraphLayout::run(const bool shouldReinitialise)
                     dynamic_cast<topology::ColaTopologyAddon *>
                     (alg.getTopology());
             assert(newTopology);
+            m_graph->freeTopology();
             m_graph->topologyNodes = newTopology->topologyNodes;
             m_graph->topologyRoutes = newTopology->topologyRoutes;
 
@@ -1298,7 +1484,23 @@ void GraphLayout::run(const bool shouldReinitialise)
         }
     }
     alg.setUnsatisfiableConstraintInfo(&unsatisfiableX,&unsatisfiableY);
-    alg.run(true,true);
+    if (componentwise)
+    {
+        // The components are already laid out, so publish the packed 
+        // positions, as made feasible above, as the final frame.
+        unsigned n = m_graph->rs.size();
+        valarray<double> X(n), Y(n);
+        for (unsigned i = 0; i < n; ++i)
+        {
+            X[i] = m_graph->rs[i]->getCentreX();
+            Y[i] = m_graph->rs[i]->getCentreY();
+        }
+        postIter(0, X, Y);
+    }
+    else
+    {
+        alg.run(true,true);
+    }
     if (outputDebugFiles)
     {
         alg.outputInstanceToSVG();
@@ -1311,19 +1513,20 @@ void GraphLayout::setOutputDebugFiles(const bool value)
     outputDebugFiles = value;
 }
 
-void GraphLayout::showUnsatisfiable(cola::UnsatisfiableConstraintInfo* i)
+void GraphLayout::showUnsatisfiable(LayoutFrame& frame,
+        cola::UnsatisfiableConstraintInfo* i)
 {
     qWarning("%s", i->toString().c_str());
 
     ShapeObj *s1 = m_graph->getShape(i->leftVarIndex);
     ShapeObj *s2 = m_graph->getShape(i->rightVarIndex);
     if(s1 && s2) {
-        retPositions.push_back(
+        frame.positions.push_back(
                 new TraceLinePosInfo(
                     s1->centrePos(), s2->centrePos(), 0));
     }
     
-    retPositions.push_back(new ConflictPosInfo(s1, s2));
+    frame.positions.push_back(new ConflictPosInfo(s1, s2));
 }
 
 }
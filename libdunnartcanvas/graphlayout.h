@@ -30,8 +30,11 @@
 #include <QMutex>
 #include <QWaitCondition>
 #include <QSet>
+#include <QAtomicInt>
+#include <QElapsedTimer>
 
 #include <set>
+#include <vector>
 
 #include "libcola/cola.h"
 #include "libdunnartcanvas/shape.h"
@@ -52,7 +55,8 @@ class LayoutThread;
  * A PosInfo is used primarily to pass position info for shapes and constraint
  * widgets between the GUI and graph layout threads.  At the end of each layout
  * iteration, the PostIteration callback creates a list of PosInfos containing
- * the updated positions of all objects.  The GUI thread later calls process()
+ * the updated positions of objects other than shapes, whose new centres are
+ * passed directly in a LayoutFrame.  The GUI thread later calls process()
  * to handle the updated positions.  Optionally, processHUD may be called by
  * the GUI thread to draw a debug "Head Up Display" for the associated
  * shape/widget.  PosInfos can also be created by the GUI thread to tell the
@@ -109,6 +113,33 @@ private:
 };
 typedef std::list<PosInfo *> PosInfos;
 
+/**
+ * The results of one layout iteration, as passed from the layout thread to
+ * the GUI.  Shape centres are stored by value, everything else as PosInfos
+ * owned by the frame.  Frames are reused, so the vectors keep their storage
+ * from one iteration to the next.
+ */
+struct LayoutFrame
+{
+    LayoutFrame();
+    ~LayoutFrame();
+
+    //! deletes the PosInfos and empties the frame
+    void clear(void);
+
+    //! shapes moved by layout, and their new centres
+    std::vector<ShapeObj *> shapes;
+    std::vector<QPointF> centres;
+    //! updates for constraint indicators, clusters, connectors, etc.
+    PosInfos positions;
+    //! value of GraphLayout's interrupt epoch when the frame was built
+    int epoch;
+    //! number of frames published by the layout thread, including this one
+    unsigned iteration;
+    //! layout iteration rate measured by the layout thread
+    double iterationsPerSecond;
+};
+
 struct ShapePosInfo;
 
 /**
@@ -153,6 +184,12 @@ public:
     bool ignoreEdges;
     //! (re)starts the layout thread
     void apply(bool ignoreEdges);
+    //! whether layout is run by the layout thread (the default), or only
+    //  by calls to runToCompletion(), e.g., when there is no GUI
+    void setThreaded(bool threaded);
+    //! runs layout at each run level to convergence on the calling thread
+    //  and applies the result.  Only valid when not threaded.
+    void runToCompletion(bool ignoreEdges);
     //! interrupt from the GUI thread, basically abondons any in-process layout
     void setInterruptFromDunnart(void);
     //! interrupt from the GUI thread caused by "alt-dragging"
@@ -182,6 +219,12 @@ public:
     void setOutputDebugFiles(const bool value);
     //! whether the layout thread is currently active.
     bool isRunning(void) const;
+    //! layout iterations per second, as of the last frame the GUI handled
+    double iterationsPerSecond(void) const;
+    //! time in milliseconds the GUI took to apply the last layout frame
+    double lastFrameTime(void) const;
+    //! number of frames replaced by newer ones before the GUI handled them
+    unsigned droppedFrameCount(void) const;
 
 private:
     Canvas *m_canvas;
@@ -189,12 +232,38 @@ private:
     //! the graph itself and mappings to/from dunnart objects
     GraphData *m_graph;
     bool m_is_running;
-    // The following are lists of PosInfo used to communicate between the GUI
-    PosInfos retPositions;
+    // Layout results are handed to the GUI through three frames.  The
+    // layout thread fills the back frame and swaps it with the middle one,
+    // which the GUI swaps with the front frame when it handles a
+    // LayoutUpdateEvent.  Neither thread waits for the other: if the GUI
+    // has not taken the middle frame by the time the next is published,
+    // it is dropped.
+    LayoutFrame m_frames[3];
+    //! index of the middle frame, plus FreshFrame if not yet taken
+    QAtomicInt m_middle_frame;
+    //! index of the frame being filled, used only by the layout thread
+    int m_back_frame;
+    //! index of the frame last taken, used only by the GUI thread
+    int m_front_frame;
+    //! incremented by setInterruptFromDunnart so that frames built from
+    //  the abandoned layout are discarded rather than applied
+    int m_layout_epoch;
+    // Layout thread counters.
+    unsigned m_published_frames;
+    QElapsedTimer m_iteration_timer;
+    unsigned m_timed_iterations;
+    double m_measured_iterations_per_second;
+    // GUI thread counters.
+    unsigned m_last_frame_iteration;
+    double m_iterations_per_second;
+    qint64 m_last_frame_nsecs;
+    unsigned m_dropped_frames;
     PosInfos fixedPositions;
-    bool retPositionsHandled;
     bool outputDebugFiles;
-    // The following control IPC between layout and GUI threads
+    // The following control IPC between layout and GUI threads.
+    // m_return_positions_mutex is held by the layout thread while it reads
+    // canvas items to build a frame, and by setInterruptFromDunnart, so
+    // that items are not deleted part way through.
     QMutex m_return_positions_mutex;
     QMutex m_layout_mutex;
     QWaitCondition m_layout_wait_condition;
@@ -209,15 +278,20 @@ private:
     bool freeShiftFromDunnart;
     bool restartFromDunnart;
     bool askedToFinish;
+    bool m_threaded;
     LayoutThread *m_layout_thread;
 
     cola::UnsatisfiableConstraintInfos unsatisfiableX, unsatisfiableY;
     void run(const bool shouldReinitialise);
-    void showUnsatisfiable(cola::UnsatisfiableConstraintInfo* i);
+    void showUnsatisfiable(LayoutFrame& frame,
+            cola::UnsatisfiableConstraintInfo* i);
     void addToFixedList(CanvasItemsList & objList);
     void addPinnedShapesToFixedList(void);
     void addToResizedList(CanvasItemsList & objList);
-    void clearReturnPosInfos(void);
+    void updateFixedPositions(void);
+    void countIteration(void);
+    bool publishFrame(void);
+    bool takeFrame(void);
 
     friend struct PreIteration;
     friend class PostIteration;
@@ -254,6 +254,7 @@ void Relationship::deactivate(bool by_undo)
         guide->relationships.removeOne(this);
         guide2->relationships.removeOne(this);
     }
+    notifyCanvas();
 }
 
 
@@ -276,6 +277,7 @@ void Relationship::activate(bool by_undo)
         guide->relationships.push_back(this);
         guide2->relationships.push_back(this);
     }
+    notifyCanvas();
 
     if (!by_undo)
     {
@@ -284,6 +286,17 @@ void Relationship::activate(bool by_undo)
 }
 
 
+void Relationship::notifyCanvas(void)
+{
+    // Relationships become constraints in the layout's GraphData.
+    Canvas *canvas = (guide) ? guide->canvas() : NULL;
+    if (canvas)
+    {
+        canvas->graphStructureChanged();
+    }
+}
+
+
 }
 // vim: filetype=cpp ts=4 sw=4 et tw=0 wm=0 cindent
 
@@ -60,6 +60,7 @@ class Relationship
         void removeGuideline(Guideline *deadguide);
    private:
         void commonInit(void);
+        void notifyCanvas(void);
 
 };
 
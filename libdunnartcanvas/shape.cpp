@@ -352,6 +352,11 @@ void ShapeObj::updateContainment(void)
         setZValue(ZORD_Cluster);
     }
     update();
+
+    if (canvas())
+    {
+        canvas()->graphStructureChanged();
+    }
 }
 
 void ShapeObj::addContainedShape(ShapeObj *shape)
@@ -419,6 +424,7 @@ void ShapeObj::setContainmentPadding(const QMarginsF &padding)
 
     if (canvas())
     {
+        canvas()->graphStructureChanged();
         canvas()->interrupt_graph_layout();
     }
 }
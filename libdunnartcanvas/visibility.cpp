@@ -24,9 +24,11 @@
 */
 
 #include <cstdlib>
+#include <algorithm>
 #include <cassert>
 #include <map>
 #include <utility>
+#include <vector>
 
 #include "libdunnartcanvas/shared.h"
 #include "libdunnartcanvas/shape.h"
@@ -300,25 +302,51 @@ static int calcConnectorIntersections(Canvas *canvas, PtOrderMap *ptOrders,
 
     int crossingsN = 0;
 
-    // Do segment splitting.
+    // Index the connector routes so that only pairs of connectors with
+    // nearby segments are compared.  Splitting segments below only adds
+    // points on existing segments, so the index remains valid throughout.
+    QList<Connector *> conns;
     QList<CanvasItem *> canvas_items = canvas->items();
     for (int i = 0; i < canvas_items.size(); ++i)
     {
-        Point lastInt(INFINITY, INFINITY);
-        Connector *conn = dynamic_cast<Connector *> (canvas_items.at(i));
-        if (!conn)
+        if (Connector *conn = dynamic_cast<Connector *> (canvas_items.at(i)))
         {
-            continue;
+            conns.append(conn);
         }
-        
-        for (int j = (i + 1); j < canvas_items.size(); ++j)
+    }
+    RouteIndex routeIndex;
+    std::map<unsigned int, int> positions;
+    routeIndex.beginUpdate();
+    for (int i = 0; i < conns.size(); ++i)
+    {
+        routeIndex.setRoute(conns.at(i)->avoidRef->id(),
+                conns.at(i)->avoidRef->displayRoute());
+        positions[conns.at(i)->avoidRef->id()] = i;
+    }
+    routeIndex.endUpdate();
+    std::vector<std::vector<int> > candidates(conns.size());
+    std::vector<unsigned int> candidateIds;
+    for (int i = 0; i < conns.size(); ++i)
+    {
+        routeIndex.candidates(conns.at(i)->avoidRef->id(), candidateIds);
+        for (size_t k = 0; k < candidateIds.size(); ++k)
         {
-            Point lastInt2(INFINITY, INFINITY);
-            Connector *conn2 = dynamic_cast<Connector *> (canvas_items.at(j));
-            if (!conn2)
+            int j = positions[candidateIds[k]];
+            if (j > i)
             {
-                continue;
+                candidates[i].push_back(j);
             }
+        }
+        std::sort(candidates[i].begin(), candidates[i].end());
+    }
+
+    // Do segment splitting.
+    for (int i = 0; i < conns.size(); ++i)
+    {
+        Connector *conn = conns.at(i);
+        for (size_t k = 0; k < candidates[i].size(); ++k)
+        {
+            Connector *conn2 = conns.at(candidates[i][k]);
             
             if (queryConn && (queryConn != conn) && (queryConn != conn2))
             {
@@ -337,23 +365,12 @@ static int calcConnectorIntersections(Canvas *canvas, PtOrderMap *ptOrders,
         }
     }
 
-    for (int i = 0; i < canvas_items.size(); ++i)
+    for (int i = 0; i < conns.size(); ++i)
     {
-        Point lastInt(INFINITY, INFINITY);
-        Connector *conn = dynamic_cast<Connector *> (canvas_items.at(i));
-        if (!conn)
+        Connector *conn = conns.at(i);
+        for (size_t k = 0; k < candidates[i].size(); ++k)
         {
-            continue;
-        }
-        
-        for (int j = (i + 1); j < canvas_items.size(); ++j)
-        {
-            Point lastInt2(INFINITY, INFINITY);
-            Connector *conn2 = dynamic_cast<Connector *> (canvas_items.at(j));
-            if (!conn2)
-            {
-                continue;
-            }
+            Connector *conn2 = conns.at(candidates[i][k]);
             
             if (queryConn && (queryConn != conn) && (queryConn != conn2))
             {
@@ -28,6 +28,11 @@
  * \author Tim Dwyer
  * \date Dec 2007
  */
+#include <cmath>
+#include <cfloat>
+#include <vector>
+#include <algorithm>
+
 #include "libvpsc/assertions.h"
 #include "libvpsc/constraint.h"
 #include "libcola/cola.h"
@@ -42,7 +47,7 @@ using vpsc::Rectangle;
 namespace topology {
 struct SegmentOpen;
 struct NodeOpen;
-typedef list<SegmentOpen*> OpenSegments;
+class OpenSegments;
 typedef map<double,NodeOpen*> OpenNodes;
 
 /*
@@ -206,19 +211,19 @@ struct SegmentEvent : Event {
  */
 struct SegmentOpen : SegmentEvent {
     /// position in openSegments
-    OpenSegments::iterator openListIndex;
+    size_t openListIndex;
+    /// extent of the segment along the scan line
+    double minPos, maxPos;
     SegmentOpen(vpsc::Dim dim, Segment *s)
         : SegmentEvent(dim, true,s->getMin(dim),s)
+        , openListIndex(0)
+        , minPos(min(s->start->pos(dim),s->end->pos(dim)))
+        , maxPos(max(s->start->pos(dim),s->end->pos(dim)))
     {
         scanDim = dim;
     }
     /// add to list of open segments
-    void process(OpenNodes& openNodes, OpenSegments& openSegments)
-    {
-        COLA_UNUSED(openNodes);
-
-        openListIndex=openSegments.insert(openSegments.end(),this);
-    }
+    void process(OpenNodes& openNodes, OpenSegments& openSegments);
     string toString() {
         stringstream s;
         s<<"SegmentOpen@"<<pos;
@@ -237,20 +242,135 @@ struct SegmentClose : SegmentEvent {
         COLA_ASSERT(opening->s==s);
         scanDim = dim;
     }
-    void process(OpenNodes& openNodes, OpenSegments& openSegments)
-    {
-        COLA_UNUSED(openNodes);
-
-        openSegments.erase(opening->openListIndex);
-        delete opening;
-        delete this;
-    }
+    void process(OpenNodes& openNodes, OpenSegments& openSegments);
     string toString() {
         stringstream s;
         s<<"SegmentClose@"<<pos;
         return s.str();
     }
 };
+/*
+ * The open segments, kept so that those which may lie within some range
+ * along the scan line can be found without visiting every open segment.
+ *
+ * All the segments that will be opened during the scan are added first.
+ * They are then held in a balanced binary tree, ordered by their minimum
+ * position along the scan line, in which each subtree records the maximum
+ * position reached by any of its open segments.  Opening or closing a 
+ * segment updates the path to the root, and a range query only descends
+ * into subtrees that may hold an open segment overlapping the range.
+ */
+class OpenSegments {
+public:
+    OpenSegments() : leafCount(0), openCount(0) {}
+    /// add a segment that will be opened during the scan
+    void add(SegmentOpen* so) {
+        COLA_ASSERT(maxPos.empty());
+        leaves.push_back(so);
+    }
+    /// build the tree, once all the segments have been added
+    void build();
+    void open(SegmentOpen* so) {
+        ++openCount;
+        update(so->openListIndex, so->maxPos);
+    }
+    void close(SegmentOpen* so) {
+        COLA_ASSERT(openCount>0);
+        --openCount;
+        update(so->openListIndex, -HUGE_VAL);
+    }
+    bool empty() const {
+        return openCount==0;
+    }
+    /*
+     * find the open segments whose extent along the scan line overlaps
+     * [lowerLimit,upperLimit].  The results are valid until the next call.
+     */
+    const vector<SegmentOpen*>& findInRange(double lowerLimit, 
+            double upperLimit);
+private:
+    void update(size_t index, double pos);
+    void findInRange(size_t node, double lowerLimit, double upperLimit);
+
+    // the segments, sorted by minimum position, as the tree's leaves
+    vector<SegmentOpen*> leaves;
+    size_t leafCount;
+    size_t openCount;
+    // for each tree node (the root is 1, and the children of i are 2i 
+    // and 2i+1) the minimum position of any segment in its subtree and the
+    // maximum position of any open segment in its subtree
+    vector<double> minPos, maxPos;
+    vector<SegmentOpen*> found;
+};
+struct CompareSegmentMinPos {
+    bool operator() (SegmentOpen *const &a, SegmentOpen *const &b) const {
+        return a->minPos < b->minPos;
+    }
+};
+void OpenSegments::build() {
+    // Allow for rounding in Segment::forwardIntersection(), which may 
+    // place the intersection slightly beyond the segment's end points.
+    for(vector<SegmentOpen*>::iterator i=leaves.begin();i!=leaves.end();++i) {
+        SegmentOpen* so=*i;
+        so->minPos-=1e-7*(1+fabs(so->minPos));
+        so->maxPos+=1e-7*(1+fabs(so->maxPos));
+    }
+    stable_sort(leaves.begin(),leaves.end(),CompareSegmentMinPos());
+    leafCount=1;
+    while(leafCount<leaves.size()) {
+        leafCount*=2;
+    }
+    minPos.assign(2*leafCount,HUGE_VAL);
+    maxPos.assign(2*leafCount,-HUGE_VAL);
+    for(size_t i=0;i<leaves.size();++i) {
+        leaves[i]->openListIndex=i;
+        minPos[leafCount+i]=leaves[i]->minPos;
+    }
+    for(size_t i=leafCount-1;i>0;--i) {
+        minPos[i]=min(minPos[2*i],minPos[2*i+1]);
+    }
+}
+void OpenSegments::update(size_t index, double pos) {
+    size_t i=leafCount+index;
+    maxPos[i]=pos;
+    for(i/=2;i>0;i/=2) {
+        maxPos[i]=max(maxPos[2*i],maxPos[2*i+1]);
+    }
+}
+const vector<SegmentOpen*>& OpenSegments::findInRange(double lowerLimit, 
+        double upperLimit) {
+    found.clear();
+    if(openCount>0) {
+        findInRange(1,lowerLimit,upperLimit);
+    }
+    return found;
+}
+void OpenSegments::findInRange(size_t node, double lowerLimit,
+        double upperLimit) {
+    if(maxPos[node]<lowerLimit || minPos[node]>upperLimit) {
+        return;
+    }
+    if(node>=leafCount) {
+        found.push_back(leaves[node-leafCount]);
+        return;
+    }
+    findInRange(2*node,lowerLimit,upperLimit);
+    findInRange(2*node+1,lowerLimit,upperLimit);
+}
+void SegmentOpen::process(OpenNodes& openNodes, OpenSegments& openSegments)
+{
+    COLA_UNUSED(openNodes);
+
+    openSegments.open(this);
+}
+void SegmentClose::process(OpenNodes& openNodes, OpenSegments& openSegments)
+{
+    COLA_UNUSED(openNodes);
+
+    openSegments.close(opening);
+    delete opening;
+    delete this;
+}
 /* 
  * Create topology constraint from scanpos in every open segment to node.
  * Segments must not be on-top-of rectangles.
@@ -261,7 +381,19 @@ void NodeEvent::createStraightConstraints(OpenSegments& openSegments,
     const double 
         leftLimit=leftNeighbour?leftNeighbour->rect->getCentreD(scanDim):-DBL_MAX,
         rightLimit=rightNeighbour?rightNeighbour->rect->getCentreD(scanDim):DBL_MAX;
-    for(OpenSegments::iterator j=openSegments.begin(); j!=openSegments.end();++j) {
+    // segments beyond a neighbour that spans the scan line are hidden 
+    // from this node, so only look for segments between such neighbours
+    const bool
+        leftBlocked=leftNeighbour
+            &&pos>leftNeighbour->rect->getMinD(vpsc::conjugate(scanDim))
+            &&pos<leftNeighbour->rect->getMaxD(vpsc::conjugate(scanDim)),
+        rightBlocked=rightNeighbour
+            &&pos>rightNeighbour->rect->getMinD(vpsc::conjugate(scanDim))
+            &&pos<rightNeighbour->rect->getMaxD(vpsc::conjugate(scanDim));
+    const vector<SegmentOpen*>& visible=openSegments.findInRange(
+            leftBlocked?leftLimit:-DBL_MAX, rightBlocked?rightLimit:DBL_MAX);
+    for(vector<SegmentOpen*>::const_iterator j=visible.begin(); 
+            j!=visible.end();++j) {
         Segment* s=(*j)->s;
         if ( (s->start->node->id==node->id 
                 && s->start->rectIntersect==EdgePoint::CENTRE)
@@ -702,6 +834,13 @@ TopologyConstraints::TopologyConstraints(const vpsc::Dim axisDim, Nodes& nodes,
         (*i)->forEach(CreateBendConstraints(dim),
                 CreateSegmentEvents(events, dim),true);
     }
+    for(vector<Event*>::iterator i=events.begin();i!=events.end();++i) {
+        SegmentOpen *so=dynamic_cast<SegmentOpen*>(*i);
+        if(so) {
+            openSegments.add(so);
+        }
+    }
+    openSegments.build();
     // process events in top to bottom order
     sort(events.begin(),events.end(),CompareEvents());
     for (vector<Event *>::iterator curr = events.begin();
@@ -28,6 +28,7 @@
 #include <set>
 #include <cstdlib>
 #include <algorithm>
+#include <iterator>
 #include <cstdio>
 
 #include "libvpsc/assertions.h"
@@ -111,45 +112,31 @@ void Rectangle::reset(unsigned d, double x, double X) {
 struct Node;
 struct CmpNodePos { bool operator()(const Node* u, const Node* v) const; };
 
-typedef set<Node*,CmpNodePos> NodeSet;
+/*
+ * The scanline holds every open rectangle, so it is a balanced tree and
+ * inserting and erasing stay O(log n).  The neighbour lists are vectors
+ * sorted by CmpNodePos, with their storage reused by
+ * OverlapConstraintGenerator between calls.  Each of their entries 
+ * becomes a constraint, so they only grow as long as the output, and
+ * shifting entries is cheaper than allocating tree nodes.
+ */
+typedef set<Node*,CmpNodePos> Scanline;
+typedef vector<Node*> NodeList;
 
 struct Node {
     Variable *v;
     Rectangle *r;
     double pos;
     Node *firstAbove, *firstBelow;
-    NodeSet *leftNeighbours, *rightNeighbours;
-    Node(Variable *v, Rectangle *r, double p) 
-        : v(v),r(r),pos(p),
-          firstAbove(NULL), firstBelow(NULL),
-          leftNeighbours(NULL), rightNeighbours(NULL)
-     
-    {
+    NodeList leftNeighbours, rightNeighbours;
+    void reset(Variable *v, Rectangle *r, double p) {
         COLA_ASSERT(r->width()<1e40);
-    }
-    ~Node() {
-        delete leftNeighbours;
-        delete rightNeighbours;
-    }
-    void addLeftNeighbour(Node *u) {
-        COLA_ASSERT(leftNeighbours!=NULL);
-        leftNeighbours->insert(u);
-    }
-    void addRightNeighbour(Node *u) {
-        COLA_ASSERT(rightNeighbours!=NULL);
-        rightNeighbours->insert(u);
-    }
-    void setNeighbours(NodeSet *left, NodeSet *right) {
-        leftNeighbours=left;
-        rightNeighbours=right;
-        for(NodeSet::iterator i=left->begin();i!=left->end();++i) {
-            Node *v=*(i);
-            v->addRightNeighbour(this);
-        }
-        for(NodeSet::iterator i=right->begin();i!=right->end();++i) {
-            Node *v=*(i);
-            v->addLeftNeighbour(this);
-        }
+        this->v=v;
+        this->r=r;
+        pos=p;
+        firstAbove=firstBelow=NULL;
+        leftNeighbours.clear();
+        rightNeighbours.clear();
     }
 };
 bool CmpNodePos::operator() (const Node* u, const Node* v) const {
@@ -164,35 +151,52 @@ bool CmpNodePos::operator() (const Node* u, const Node* v) const {
     return u < v;
 }
 
-NodeSet* getLeftNeighbours(NodeSet &scanline,Node *v) {
-    NodeSet *leftv = new NodeSet;
-    NodeSet::iterator i=scanline.find(v);
+static NodeList::iterator findNode(NodeList &l, Node *v) {
+    return std::lower_bound(l.begin(),l.end(),v,CmpNodePos());
+}
+static void insertNode(NodeList &l, Node *v) {
+    l.insert(findNode(l,v),v);
+}
+static size_t eraseNode(NodeList &l, Node *v) {
+    NodeList::iterator i=findNode(l,v);
+    if(i==l.end() || *i!=v) {
+        return 0;
+    }
+    l.erase(i);
+    return 1;
+}
+
+static void setNeighbours(Scanline &scanline, Node *v) {
+    Scanline::iterator vi=scanline.find(v);
+    Scanline::iterator i=vi;
     while(i!=scanline.begin()) {
         Node *u=*(--i);
         if(u->r->overlapX(v->r)<=0) {
-            leftv->insert(u);
-            return leftv;
+            insertNode(v->leftNeighbours,u);
+            break;
         }
         if(u->r->overlapX(v->r)<=u->r->overlapY(v->r)) {
-            leftv->insert(u);
+            insertNode(v->leftNeighbours,u);
         }
     }
-    return leftv;
-}
-NodeSet* getRightNeighbours(NodeSet &scanline,Node *v) {
-    NodeSet *rightv = new NodeSet;
-    NodeSet::iterator i=scanline.find(v);
-    for(++i;i!=scanline.end(); ++i) {
+    for(i=std::next(vi);i!=scanline.end(); ++i) {
         Node *u=*(i);
         if(u->r->overlapX(v->r)<=0) {
-            rightv->insert(u);
-            return rightv;
+            insertNode(v->rightNeighbours,u);
+            break;
         }
         if(u->r->overlapX(v->r)<=u->r->overlapY(v->r)) {
-            rightv->insert(u);
+            insertNode(v->rightNeighbours,u);
         }
     }
-    return rightv;
+    for(NodeList::iterator j=v->leftNeighbours.begin();
+            j!=v->leftNeighbours.end();++j) {
+        insertNode((*j)->rightNeighbours,v);
+    }
+    for(NodeList::iterator j=v->rightNeighbours.begin();
+            j!=v->rightNeighbours.end();++j) {
+        insertNode((*j)->leftNeighbours,v);
+    }
 }
 
 typedef enum {Open, Close} EventType;
@@ -202,68 +206,103 @@ struct Event {
     double pos;
     Event(EventType t, Node *v, double p) : type(t),v(v),pos(p) {};
 };
-int compare_events(const void *a, const void *b) {
-    Event *ea=*(Event**)a;
-    Event *eb=*(Event**)b;
-    if(ea->pos==eb->pos) {
-        // when comparing opening and closing
-        // open must come first
-        if(ea->type==Open) return -1;
-        return 1;
-    } else if(ea->pos > eb->pos) {
-        return 1;
-    } else if(ea->pos < eb->pos) {
-        return -1;
-    } else if(isNaN(ea->pos) != isNaN(ea->pos)) {
-        /* See comment in CmpNodePos. */
-        return ( isNaN(ea->pos)
-             ? -1
-             : 1 );
+/*
+ * Orders events by position, with open events before close events at the
+ * same position.  The remaining ties are broken by node so that the order,
+ * and therefore the generated constraints, are deterministic.
+ */
+struct CmpEvents {
+    bool operator()(const Event& a, const Event& b) const {
+        COLA_ASSERT(!isNaN(a.pos));
+        COLA_ASSERT(!isNaN(b.pos));
+        if (a.pos != b.pos) {
+            return a.pos < b.pos;
+        }
+        if (a.type != b.type) {
+            return a.type == Open;
+        }
+        return a.v < b.v;
+    }
+};
+
+struct Separation {
+    Separation(Variable *left, Variable *right, double gap)
+        : left(left), right(right), gap(gap) {}
+    bool operator==(const Separation& rhs) const {
+        return left==rhs.left && right==rhs.right && gap==rhs.gap;
+    }
+    Variable *left, *right;
+    double gap;
+};
+
+struct OverlapConstraintGenerator::Storage {
+    Storage() {
+        generated[0]=generated[1]=false;
     }
-    return 0;
+    vector<Node> nodes;
+    vector<Event> events;
+    Scanline scanline;
+    vector<Separation> current;
+    vector<Separation> previous[2];
+    bool generated[2];
+};
+
+OverlapConstraintGenerator::OverlapConstraintGenerator()
+    : m_storage(new Storage())
+{
+}
+
+OverlapConstraintGenerator::~OverlapConstraintGenerator()
+{
+    delete m_storage;
 }
 
 /*
- * Prepares constraints in order to apply VPSC horizontally.  Assumes 
- * variables have already been created.
- * useNeighbourLists determines whether or not a heuristic is used to 
- * deciding whether to resolve all overlap in the x pass, or leave some
- * overlaps for the y pass.
+ * Sweeps a scanline across the rectangles in the dimension other than dim,
+ * recording the separations needed in dimension dim between rectangles 
+ * that are adjacent in the scanline.  With neighbour lists, each 
+ * rectangle is instead separated from all rectangles that it overlaps
+ * less in dimension dim than in the other dimension.
  */
-void generateXConstraints(const Rectangles& rs, const Variables& vars,
-        Constraints& cs, const bool useNeighbourLists)
+void OverlapConstraintGenerator::sweep(const Dim dim, const Rectangles& rs,
+        const Variables& vars, const bool useNeighbourLists)
 {
     const unsigned n = rs.size();
     COLA_ASSERT(vars.size()>=n);
-    Event **events=new Event*[2*n];
-    unsigned i,ctr=0;
-    for(i=0;i<n;i++) {
-        vars[i]->desiredPosition=rs[i]->getCentreX();
-        Node *v = new Node(vars[i],rs[i],rs[i]->getCentreX());
-        events[ctr++]=new Event(Open,v,rs[i]->getMinY());
-        events[ctr++]=new Event(Close,v,rs[i]->getMaxY());
+    vector<Node>& nodes = m_storage->nodes;
+    vector<Event>& events = m_storage->events;
+    Scanline& scanline = m_storage->scanline;
+    vector<Separation>& seps = m_storage->current;
+    // Keep the nodes' neighbour lists, and their storage, from last time.
+    nodes.resize(n);
+    events.clear();
+    seps.clear();
+    for(unsigned i=0;i<n;i++) {
+        Rectangle *r=rs[i];
+        COLA_ASSERT(dim==XDIM || r->getMinX()<r->getMaxX());
+        double centre=r->getCentreD(dim);
+        vars[i]->desiredPosition=centre;
+        nodes[i].reset(vars[i],r,centre);
+        events.push_back(Event(Open,&nodes[i],r->getMinD(!dim)));
+        events.push_back(Event(Close,&nodes[i],r->getMaxD(!dim)));
     }
-    qsort((Event*)events, (size_t)2*n, sizeof(Event*), compare_events );
+    std::sort(events.begin(),events.end(),CmpEvents());
 
-    NodeSet scanline;
-    for(i=0;i<2*n;i++) {
-        Event *e=events[i];
-        Node *v=e->v;
-        if(e->type==Open) {
+    scanline.clear();
+    for(unsigned i=0;i<events.size();i++) {
+        const Event& e=events[i];
+        Node *v=e.v;
+        if(e.type==Open) {
             scanline.insert(v);
             if(useNeighbourLists) {
-                v->setNeighbours(
-                    getLeftNeighbours(scanline,v),
-                    getRightNeighbours(scanline,v)
-                );
+                setNeighbours(scanline,v);
             } else {
-                NodeSet::iterator it=scanline.find(v);
+                Scanline::iterator it=scanline.find(v);
                 if(it!=scanline.begin()) {
-                    Node *u=*(--it);
+                    Node *u=*std::prev(it);
                     v->firstAbove=u;
                     u->firstBelow=v;
                 }
-                it=scanline.find(v);
                 if(++it!=scanline.end()) {
                     Node *u=*it;
                     v->firstBelow=u;
@@ -274,46 +313,87 @@ void generateXConstraints(const Rectangles& rs, const Variables& vars,
             size_t result;
             // Close event
             if(useNeighbourLists) {
-                for(NodeSet::iterator i=v->leftNeighbours->begin();
-                    i!=v->leftNeighbours->end();i++
+                for(NodeList::iterator i=v->leftNeighbours.begin();
+                    i!=v->leftNeighbours.end();i++
                 ) {
                     Node *u=*i;
-                    double sep = (v->r->width()+u->r->width())/2.0;
-                    cs.push_back(new Constraint(u->v,v->v,sep));
-                    result=u->rightNeighbours->erase(v);
+                    double sep = (v->r->length(dim)+u->r->length(dim))/2.0;
+                    seps.push_back(Separation(u->v,v->v,sep));
+                    result=eraseNode(u->rightNeighbours,v);
                     COLA_ASSERT(result==1);
                 }
                 
-                for(NodeSet::iterator i=v->rightNeighbours->begin();
-                    i!=v->rightNeighbours->end();i++
+                for(NodeList::iterator i=v->rightNeighbours.begin();
+                    i!=v->rightNeighbours.end();i++
                 ) {
                     Node *u=*i;
-                    double sep = (v->r->width()+u->r->width())/2.0;
-                    cs.push_back(new Constraint(v->v,u->v,sep));
-                    result=u->leftNeighbours->erase(v);
+                    double sep = (v->r->length(dim)+u->r->length(dim))/2.0;
+                    seps.push_back(Separation(v->v,u->v,sep));
+                    result=eraseNode(u->leftNeighbours,v);
                     COLA_ASSERT(result==1);
                 }
             } else {
                 Node *l=v->firstAbove, *r=v->firstBelow;
                 if(l!=NULL) {
-                    double sep = (v->r->width()+l->r->width())/2.0;
-                    cs.push_back(new Constraint(l->v,v->v,sep));
+                    double sep = (v->r->length(dim)+l->r->length(dim))/2.0;
+                    seps.push_back(Separation(l->v,v->v,sep));
                     l->firstBelow=v->firstBelow;
                 }
                 if(r!=NULL) {
-                    double sep = (v->r->width()+r->r->width())/2.0;
-                    cs.push_back(new Constraint(v->v,r->v,sep));
+                    double sep = (v->r->length(dim)+r->r->length(dim))/2.0;
+                    seps.push_back(Separation(v->v,r->v,sep));
                     r->firstAbove=v->firstAbove;
                 }
             }
             result=scanline.erase(v);
             COLA_ASSERT(result==1);
-            delete v;
         }
-        delete e;
     }
     COLA_ASSERT(scanline.size()==0);
-    delete [] events;
+}
+
+bool OverlapConstraintGenerator::generate(const Dim dim, 
+        const Rectangles& rs, const Variables& vars, Constraints& cs, 
+        const bool useNeighbourLists)
+{
+    sweep(dim,rs,vars,useNeighbourLists);
+    vector<Separation>& seps = m_storage->current;
+    vector<Separation>& previous = m_storage->previous[dim];
+    if(m_storage->generated[dim] && seps==previous) {
+        return false;
+    }
+    for(unsigned i=0;i<seps.size();i++) {
+        cs.push_back(new Constraint(seps[i].left,seps[i].right,seps[i].gap));
+    }
+    previous.swap(seps);
+    m_storage->generated[dim]=true;
+    return true;
+}
+
+bool OverlapConstraintGenerator::generateXConstraints(const Rectangles& rs, 
+        const Variables& vars, Constraints& cs, const bool useNeighbourLists)
+{
+    return generate(XDIM,rs,vars,cs,useNeighbourLists);
+}
+
+bool OverlapConstraintGenerator::generateYConstraints(const Rectangles& rs, 
+        const Variables& vars, Constraints& cs)
+{
+    return generate(YDIM,rs,vars,cs,false);
+}
+
+/*
+ * Prepares constraints in order to apply VPSC horizontally.  Assumes 
+ * variables have already been created.
+ * useNeighbourLists determines whether or not a heuristic is used to 
+ * deciding whether to resolve all overlap in the x pass, or leave some
+ * overlaps for the y pass.
+ */
+void generateXConstraints(const Rectangles& rs, const Variables& vars,
+        Constraints& cs, const bool useNeighbourLists)
+{
+    OverlapConstraintGenerator generator;
+    generator.generateXConstraints(rs,vars,cs,useNeighbourLists);
 }
 
 /*
@@ -323,70 +403,8 @@ void generateXConstraints(const Rectangles& rs, const Variables& vars,
 void generateYConstraints(const Rectangles& rs, const Variables& vars,
         Constraints& cs)
 {
-    const unsigned n = rs.size();
-    COLA_ASSERT(vars.size()>=n);
-    Event **events=new Event*[2*n];
-    unsigned ctr=0;
-    Rectangles::const_iterator ri=rs.begin(), re=rs.end();
-    Variables::const_iterator vi=vars.begin(), ve=vars.end();
-    for(;ri!=re&&vi!=ve;++ri,++vi) {
-        Rectangle* r=*ri;
-        Variable* v=*vi;
-        v->desiredPosition=r->getCentreY();
-        Node *node = new Node(v,r,r->getCentreY());
-        COLA_ASSERT(r->getMinX()<r->getMaxX());
-        events[ctr++]=new Event(Open,node,r->getMinX());
-        events[ctr++]=new Event(Close,node,r->getMaxX());
-    }
-    COLA_ASSERT(ri==rs.end());
-    qsort((Event*)events, (size_t)2*n, sizeof(Event*), compare_events );
-    NodeSet scanline;
-#ifndef NDEBUG
-    size_t deletes=0;
-#endif
-    for(unsigned i=0;i<2*n;i++) {
-        Event *e=events[i];
-        Node *v=e->v;
-        if(e->type==Open) {
-            scanline.insert(v);
-            NodeSet::iterator it=scanline.find(v);
-            if(it!=scanline.begin()) {
-                Node *u=*(--it);
-                v->firstAbove=u;
-                u->firstBelow=v;
-            }
-            it=scanline.find(v);
-            if(++it!=scanline.end())     {
-                Node *u=*it;
-                v->firstBelow=u;
-                u->firstAbove=v;
-            }
-        } else {
-            // Close event
-            Node *l=v->firstAbove, *r=v->firstBelow;
-            if(l!=NULL) {
-                double sep = (v->r->height()+l->r->height())/2.0;
-                cs.push_back(new Constraint(l->v,v->v,sep));
-                l->firstBelow=v->firstBelow;
-            }
-            if(r!=NULL) {
-                double sep = (v->r->height()+r->r->height())/2.0;
-                cs.push_back(new Constraint(v->v,r->v,sep));
-                r->firstAbove=v->firstAbove;
-            }
-#ifndef NDEBUG
-            deletes++;
-            size_t erased=
-#endif
-            scanline.erase(v);
-            COLA_ASSERT(erased==1);
-            delete v;
-        }
-        delete e;
-    }
-    COLA_ASSERT(scanline.size()==0);
-    COLA_ASSERT(deletes==n);
-    delete [] events;
+    OverlapConstraintGenerator generator;
+    generator.generateYConstraints(rs,vars,cs);
 }
 #include "libvpsc/linesegment.h"
 using namespace linesegment;
@@ -257,6 +257,60 @@ void generateXConstraints(const Rectangles& rs, const Variables& vars,
 void generateYConstraints(const Rectangles& rs, const Variables& vars,
         Constraints& cs);
 
+/**
+ * @brief Generates the separation constraints that remove overlap between
+ *        rectangles, as for generateXConstraints() and
+ *        generateYConstraints(), for callers that do so repeatedly.
+ *
+ * The generator reuses its working storage between calls and remembers 
+ * the constraints it generated last time for each dimension.  If the new 
+ * constraints would be the same, i.e., the same pairs of variables with 
+ * the same separations, none are added and the caller may keep using the 
+ * constraints from the previous call.  In every case the variables' 
+ * desired positions are set to the centres of the rectangles.
+ */
+class OverlapConstraintGenerator {
+public:
+    OverlapConstraintGenerator();
+    ~OverlapConstraintGenerator();
+
+    /**
+     * @brief Generates constraints to remove overlap horizontally.
+     *
+     * @param[in]  rs    The rectangles.
+     * @param[in]  vars  The variables for the rectangles' x-positions.
+     * @param[out] cs    The vector the new constraints are added to.
+     * @param[in]  useNeighbourLists  Whether to resolve all overlap in
+     *                   this pass, rather than leaving some for the 
+     *                   vertical pass.
+     * @return  false if the constraints are the same as last time, in 
+     *          which case none are added to cs, or true otherwise.
+     */
+    bool generateXConstraints(const Rectangles& rs, const Variables& vars,
+            Constraints& cs, const bool useNeighbourLists);
+    /**
+     * @brief Generates constraints to remove all overlap vertically.
+     *
+     * @return  false if the constraints are the same as last time, in 
+     *          which case none are added to cs, or true otherwise.
+     */
+    bool generateYConstraints(const Rectangles& rs, const Variables& vars,
+            Constraints& cs);
+
+private:
+    OverlapConstraintGenerator(const OverlapConstraintGenerator&);
+    OverlapConstraintGenerator& operator=(const OverlapConstraintGenerator&);
+
+    void sweep(const Dim dim, const Rectangles& rs, const Variables& vars,
+            const bool useNeighbourLists);
+    bool generate(const Dim dim, const Rectangles& rs, 
+            const Variables& vars, Constraints& cs, 
+            const bool useNeighbourLists);
+
+    struct Storage;
+    Storage *m_storage;
+};
+
 /**
  * @brief Uses VPSC to remove overlaps between rectangles.
  *
@@ -100,6 +100,14 @@ private:
  * refinement after blocks are moved.  This version is preferred if you are 
  * using VPSC in an interactive context.
  *
+ * An instance may be kept and solved repeatedly: after changing the 
+ * desired positions or weights of the variables, call solve() or 
+ * satisfy() again.  The solver then starts from the blocks, i.e., the 
+ * active constraints, of the previous solution, so when only a few 
+ * variables have moved this is much cheaper than solving a new instance.
+ * The variables and constraints must not be passed to another solver in 
+ * the meantime, since that changes their block structure.
+ *
  * @sa Solver
  */
 class IncSolver : public Solver {